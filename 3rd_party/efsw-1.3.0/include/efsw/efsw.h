@@ -121,6 +121,12 @@ void EFSW_API efsw_removewatch_byid(efsw_watcher watcher, efsw_watchid watchid);
 /// Starts watching ( in other thread )
 void EFSW_API efsw_watch(efsw_watcher watcher);
 
+/// Threadless alternative to efsw_watch, see FileWatcher::getFileDescriptor
+int EFSW_API efsw_get_fd(efsw_watcher watcher);
+
+/// Delivers the pending events on the calling thread, see FileWatcher::dispatch
+void EFSW_API efsw_dispatch(efsw_watcher watcher);
+
 /**
  * Allow recursive watchers to follow symbolic links to other directories
  * followSymlinks is disabled by default
@@ -30,6 +30,7 @@
 
 #include <list>
 #include <string>
+#include <vector>
 
 #if defined( _WIN32 )
 #ifdef EFSW_DYNAMIC
@@ -86,6 +87,23 @@ enum Action {
 }
 typedef Actions::Action Action;
 
+/// Backends a FileWatcher can be created with
+namespace Backends {
+enum Backend {
+	/// The backend of the platform ( inotify, Win32, kqueue, FSEvents ), or Generic if it fails
+	Native,
+	/// Scans the watched directories periodically, works everywhere
+	Generic,
+	/// Linux only, needs CAP_SYS_ADMIN and CAP_DAC_READ_SEARCH and Linux 5.17. Marks whole file
+	/// systems, so the kernel resources don't grow with the watched trees, but every change on
+	/// them wakes the watcher up before being filtered, and the events report the real paths of
+	/// the directories. Only worth it for trees beyond the inotify watch limit. Falls back to
+	/// Native where it isn't available.
+	Fanotify
+};
+}
+typedef Backends::Backend Backend;
+
 /// Errors log namespace
 namespace Errors {
 
@@ -111,6 +129,29 @@ class EFSW_API Log {
 } // namespace Errors
 typedef Errors::Error Error;
 
+/// Instrumentation callbacks, see setTraceCallbacks
+typedef void ( *TraceBeginCallback )( const char* name );
+typedef void ( *TraceEndCallback )();
+
+/// Registers callbacks invoked around the watcher thread's units of work, so a
+/// profiler can record where the watcher spends its time. The name is a string
+/// literal. Only effective when efsw is built with EFSW_TRACE, otherwise a no-op.
+/// Set them before starting any watcher.
+EFSW_API void setTraceCallbacks( TraceBeginCallback begin, TraceEndCallback end );
+
+/// Selects the events of a watch by file name. The patterns match the bare names, with * for any
+/// run of characters and ? for any single one.
+/// The inotify and fanotify backends apply it before building the events, the others ignore it.
+struct WatchFilter {
+	/// If not empty, only the events of the names matching one of them are reported.
+	/// Subdirectories are still watched.
+	std::vector<std::string> Include;
+
+	/// The events of the names matching one of them are dropped, and the matching
+	/// subdirectories of recursive watches aren't watched at all
+	std::vector<std::string> Exclude;
+};
+
 /// Listens to files and directories and dispatches events
 /// to notify the listener of files and directories changes.
 /// @class FileWatcher
@@ -122,6 +163,9 @@ class EFSW_API FileWatcher {
 	/// Constructor that lets you force the use of the Generic File Watcher
 	explicit FileWatcher( bool useGenericFileWatcher );
 
+	/// Constructor that lets you pick the backend
+	explicit FileWatcher( Backend backend );
+
 	virtual ~FileWatcher();
 
 	/// Add a directory watch. Same as the other addWatch, but doesn't have recursive option.
@@ -133,6 +177,11 @@ class EFSW_API FileWatcher {
 	/// On error returns WatchID with Error type.
 	WatchID addWatch( const std::string& directory, FileWatchListener* watcher, bool recursive );
 
+	/// Add a directory watch reporting only the events selected by the filter
+	/// On error returns WatchID with Error type.
+	WatchID addWatch( const std::string& directory, FileWatchListener* watcher, bool recursive,
+					  const WatchFilter& filter );
+
 	/// Remove a directory watch. This is a brute force search O(nlogn).
 	void removeWatch( const std::string& directory );
 
@@ -142,9 +191,23 @@ class EFSW_API FileWatcher {
 	/// Starts watching ( in other thread )
 	void watch();
 
+	/// Threadless alternative to watch(): wait for getFileDescriptor() to become readable in
+	/// the application's own event loop ( poll, epoll... ), then call dispatch() to deliver the
+	/// pending events to the listeners on the calling thread. Don't call watch() in this mode.
+	/// @return The descriptor to wait on, or -1 if the backend has none. The generic watcher
+	/// then scans once per dispatch(), so call it at the desired poll interval. Backends without
+	/// a threadless mode ( Win32, kqueue, FSEvents ) start their thread on the first dispatch().
+	int getFileDescriptor();
+
+	/// Delivers the pending events without blocking
+	void dispatch();
+
 	/// @return Returns a list of the directories that are being watched
 	std::list<std::string> directories();
 
+	/// @return The name of the backend in use ( "Inotify", "Fanotify", "Generic"... )
+	const char* getBackendName() const;
+
 	/** Allow recursive watchers to follow symbolic links to other directories
 	 * followSymlinks is disabled by default
 	 */
@@ -169,6 +232,7 @@ class EFSW_API FileWatcher {
   private:
 	/// The implementation
 	FileWatcherImpl* mImpl;
+	const char* mBackendName;
 	bool mFollowSymlinks;
 	bool mOutOfScopeLinks;
 };
@@ -188,6 +252,50 @@ class FileWatchListener {
 	virtual void handleFileAction( WatchID watchid, const std::string& dir,
 								   const std::string& filename, Action action,
 								   std::string oldFilename = "" ) = 0;
+
+	/// Handles the loss of events below the directory, when the kernel queue overflowed.
+	/// Nothing tells which files changed, whatever is known about them must be rescanned.
+	/// @param watchid The watch id for the directory
+	/// @param dir The directory
+	virtual void handleMissedFileActions( WatchID watchid, const std::string& dir ) {}
+};
+
+/// A file event delivered as part of a batch. The strings are only valid during the
+/// handleFileActions call.
+struct FileEvent {
+	/// The watch id for the directory
+	WatchID ID;
+	/// The directory, shared by all the events of the watch. It is the current path of the
+	/// directory, which differs from the path at the time of the event if it was moved since.
+	const std::string* Directory;
+	/// The filename that was accessed (not full path)
+	const char* Filename;
+	/// The previous name for Actions::Moved, else empty
+	const char* OldFilename;
+	/// Action that was performed
+	Action Type;
+};
+
+/// Opt-in interface for listeners that handle bursts of events at once.
+/// Backends that support it deliver all the events of one read from the kernel in a single
+/// call, without allocating strings per event. The others call handleFileAction, which
+/// forwards every event as a batch of one.
+/// @class FileWatchBatchListener
+class FileWatchBatchListener : public FileWatchListener {
+  public:
+	/// Handles the events in the order they happened
+	virtual void handleFileActions( const FileEvent* events, size_t count ) = 0;
+
+	void handleFileAction( WatchID watchid, const std::string& dir, const std::string& filename,
+						   Action action, std::string oldFilename = "" ) {
+		FileEvent event;
+		event.ID = watchid;
+		event.Directory = &dir;
+		event.Filename = filename.c_str();
+		event.OldFilename = oldFilename.c_str();
+		event.Type = action;
+		handleFileActions( &event, 1 );
+	}
 };
 
 } // namespace efsw
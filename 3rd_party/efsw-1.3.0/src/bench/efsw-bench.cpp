@@ -0,0 +1,623 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <efsw/FileSystem.hpp>
+#include <efsw/System.hpp>
+#include <efsw/efsw.hpp>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#define makeDir( path ) _mkdir( path )
+#define REMOVE_TREE "rmdir /s /q "
+#else
+#include <sys/stat.h>
+#define makeDir( path ) mkdir( path, 0755 )
+#define REMOVE_TREE "rm -rf "
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/// Usage: efsw-bench rescan|events|filter|startup|renames [--fanotify] [directory] [counts...]
+/// rescan: measures the cost of the generic watcher passes against the number of files watched.
+/// events: measures the delivery of bursts of modifications, to a FileWatchListener and to a
+/// FileWatchBatchListener. With inotify also the time to read the events from the kernel, which
+/// efsw can't reduce.
+/// filter: measures the same bursts, one write in ten to a shader, with and without a filter
+/// keeping only the shaders.
+/// startup: measures a recursive addWatch against the number of directories, on Linux.
+/// renames: moves a deep directory around trees of several sizes, then to another watch, and
+/// checks the reported paths.
+/// The trees are created below directory ( the working directory by default ) and removed
+/// afterwards. rescan always measures the generic backend and startup the inotify one, the
+/// others the native backend, or fanotify with --fanotify. The backend measured is printed.
+
+typedef std::chrono::steady_clock Clock;
+
+/// Backend of the events, filter and renames modes
+static efsw::Backend BACKEND = efsw::Backends::Native;
+
+static const int FILES_PER_DIRECTORY = 100;
+
+/// Runs of the events and filter modes, the time to read the events varies a lot between them
+static const int EVENT_RUNS = 21;
+
+/// Levels of the directory moved around by the renames mode
+static const int RENAME_DEPTH = 64;
+
+class CountingListener : public efsw::FileWatchListener {
+  public:
+	CountingListener() : Events( 0 ) {}
+
+	void handleFileAction( efsw::WatchID, const std::string&, const std::string&, efsw::Action,
+						   std::string ) {
+		Events++;
+	}
+
+	long Events;
+};
+
+class CountingBatchListener : public efsw::FileWatchBatchListener {
+  public:
+	CountingBatchListener() : Events( 0 ) {}
+
+	void handleFileActions( const efsw::FileEvent*, size_t count ) { Events += count; }
+
+	long Events;
+};
+
+static double millisecondsSince( Clock::time_point start ) {
+	return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+}
+
+static void writeFile( const std::string& path, const std::string& content ) {
+	std::ofstream file( path.c_str() );
+	file << content;
+}
+
+static std::string directoryName( const std::string& root, int index ) {
+	char name[32];
+	snprintf( name, sizeof( name ), "d%05d/", index );
+	return root + name;
+}
+
+static void createTree( const std::string& root, int files ) {
+	makeDir( root.c_str() );
+
+	for ( int d = 0; d * FILES_PER_DIRECTORY < files; d++ ) {
+		std::string dir( directoryName( root, d ) );
+		makeDir( dir.c_str() );
+
+		for ( int f = 0; f < FILES_PER_DIRECTORY && d * FILES_PER_DIRECTORY + f < files; f++ ) {
+			writeFile( dir + "f" + std::to_string( f ) + ".txt", "x" );
+		}
+	}
+}
+
+/// What every pass of the generic watcher cost before: list and stat every entry into maps
+static size_t fullRescan( const std::string& dir ) {
+	efsw::FileInfoMap files = efsw::FileSystem::filesInfoFromPath( dir );
+	size_t count = files.size();
+
+	for ( efsw::FileInfoMap::iterator it = files.begin(); it != files.end(); ++it ) {
+		if ( it->second.isDirectory() ) {
+			count += fullRescan( it->second.Filepath );
+		}
+	}
+
+	return count;
+}
+
+static double median( std::vector<double> times ) {
+	std::sort( times.begin(), times.end() );
+	return times[times.size() / 2];
+}
+
+/// Median of several runs, in milliseconds
+template <typename F> static double measure( F function, int runs = 5 ) {
+	std::vector<double> times;
+
+	for ( int i = 0; i < runs; i++ ) {
+		Clock::time_point start = Clock::now();
+		function();
+		times.push_back( millisecondsSince( start ) );
+	}
+
+	return median( times );
+}
+
+static void benchRescan( const std::string& base, int files ) {
+	std::string root( base + "efsw-bench-" + std::to_string( files ) + "/" );
+	createTree( root, files );
+
+	/// Let the directory modification times settle, recent ones are always listed again
+	efsw::System::sleep( 3000 );
+
+	CountingListener listener;
+	efsw::FileWatcher watcher( efsw::Backends::Generic );
+
+	Clock::time_point start = Clock::now();
+	watcher.addWatch( root, &listener, true );
+	double addTime = millisecondsSince( start );
+
+	double fullTime = measure( [&] { fullRescan( root ); } );
+	double idleTime = measure( [&] { watcher.dispatch(); } );
+
+	int modified = 0;
+	double modifiedTime = measure( [&] {
+		writeFile( directoryName( root, 0 ) + "f0.txt", std::string( ++modified, 'y' ) );
+		watcher.dispatch();
+	} );
+
+	int created = 0;
+	double createdTime = measure( [&] {
+		writeFile( directoryName( root, 0 ) + "new" + std::to_string( created++ ) + ".txt", "z" );
+		watcher.dispatch();
+	} );
+
+	printf( "%8d %10.1f %14.1f %10.1f %12.1f %12.1f %8ld\n", files, addTime, fullTime, idleTime,
+			modifiedTime, createdTime, listener.Events );
+
+	system( ( REMOVE_TREE "\"" + root + "\"" ).c_str() );
+}
+
+#ifdef __linux__
+/// Reads the pending events like a bare inotify loop, the cost no backend can avoid
+/// @return The time it took in milliseconds
+static double drainInotify( int fd ) {
+	static char buffer[256 * 1024];
+
+	Clock::time_point start = Clock::now();
+
+	while ( read( fd, buffer, sizeof( buffer ) ) > 0 ) {
+	}
+
+	return millisecondsSince( start );
+}
+#endif
+
+/// Writes to the files of the tree, then measures how long the watcher takes to deliver the
+/// resulting events. Every shaderEvery-th write goes to a .glsl file instead, if not 0.
+/// Median of EVENT_RUNS runs, in milliseconds. With inotify, readTime is set to the median time
+/// a bare inotify loop takes to read the same events, else to -1.
+template <typename Listener>
+static double measureEvents( const std::string& root, int files, int writes, long& events,
+							 double& readTime,
+							 const efsw::WatchFilter& filter = efsw::WatchFilter(),
+							 int shaderEvery = 0 ) {
+	std::vector<double> times;
+	std::vector<double> readTimes;
+
+	for ( int run = 0; run < EVENT_RUNS; run++ ) {
+		Listener listener;
+		efsw::FileWatcher watcher( BACKEND );
+		watcher.addWatch( root, &listener, true, filter );
+
+		/// Allocates the read buffer, which would otherwise be measured along the first events
+		watcher.dispatch();
+
+#ifdef __linux__
+		int fd = -1;
+
+		if ( std::string( watcher.getBackendName() ) == "Inotify" ) {
+			fd = inotify_init1( IN_NONBLOCK );
+
+			for ( int d = 0; d * FILES_PER_DIRECTORY < files; d++ ) {
+				inotify_add_watch( fd, directoryName( root, d ).c_str(),
+								   IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_DELETE |
+									   IN_MOVED_FROM | IN_MOVED_TO );
+			}
+		}
+#endif
+
+		for ( int i = 0; i < writes; i++ ) {
+			int file = i % files;
+			bool shader = shaderEvery > 0 && i % shaderEvery == 0;
+			writeFile( directoryName( root, file / FILES_PER_DIRECTORY ) + "f" +
+						   std::to_string( file % FILES_PER_DIRECTORY ) +
+						   ( shader ? ".glsl" : ".txt" ),
+					   std::to_string( i ) );
+		}
+
+#ifdef __linux__
+		if ( fd != -1 ) {
+			readTimes.push_back( drainInotify( fd ) );
+			close( fd );
+		}
+#endif
+
+		Clock::time_point start = Clock::now();
+		watcher.dispatch();
+		times.push_back( millisecondsSince( start ) );
+
+		events = listener.Events;
+	}
+
+	readTime = readTimes.empty() ? -1.0 : median( readTimes );
+
+	return median( times );
+}
+
+static void benchEvents( const std::string& base, int writes ) {
+	static const int FILES = 1000;
+
+	std::string root( base + "efsw-bench-events/" );
+	createTree( root, FILES );
+
+	long classicEvents = 0;
+	long batchEvents = 0;
+	double classicRead = 0;
+	double batchRead = 0;
+	double classicTime =
+		measureEvents<CountingListener>( root, FILES, writes, classicEvents, classicRead );
+	double batchTime =
+		measureEvents<CountingBatchListener>( root, FILES, writes, batchEvents, batchRead );
+
+	if ( classicRead >= 0 ) {
+		printf( "%8d %8ld %10.2f %10.2f %10.2f %8.2fx\n", writes, classicEvents,
+				( classicRead + batchRead ) / 2, classicTime, batchTime,
+				batchTime > 0 ? classicTime / batchTime : 0.0 );
+	} else {
+		printf( "%8d %8ld %10s %10.2f %10.2f %8.2fx\n", writes, classicEvents, "-", classicTime,
+				batchTime, batchTime > 0 ? classicTime / batchTime : 0.0 );
+	}
+
+	system( ( REMOVE_TREE "\"" + root + "\"" ).c_str() );
+}
+
+static void benchFilter( const std::string& base, int writes ) {
+	static const int FILES = 1000;
+
+	std::string root( base + "efsw-bench-filter/" );
+	createTree( root, FILES );
+
+	efsw::WatchFilter filter;
+	filter.Include.push_back( "*.glsl" );
+
+	long allEvents = 0;
+	long filteredEvents = 0;
+	double readTime = 0;
+	double allTime = measureEvents<CountingListener>( root, FILES, writes, allEvents, readTime,
+													  efsw::WatchFilter(), 10 );
+	double filteredTime =
+		measureEvents<CountingListener>( root, FILES, writes, filteredEvents, readTime, filter, 10 );
+
+	printf( "%8d %8ld %12.2f %8ld %12.2f %8.2fx\n", writes, allEvents, allTime, filteredEvents,
+			filteredTime, filteredTime > 0 ? allTime / filteredTime : 0.0 );
+
+	system( ( REMOVE_TREE "\"" + root + "\"" ).c_str() );
+}
+
+/// Two levels, FANOUT subdirectories in each directory of the first level
+static void createDirectoryTree( const std::string& root, int directories, int files ) {
+	static const int FANOUT = 10;
+
+	makeDir( root.c_str() );
+
+	for ( int d = 0; d < directories; d++ ) {
+		std::string dir( directoryName( root, d / FANOUT ) );
+
+		if ( d % FANOUT == 0 ) {
+			makeDir( dir.c_str() );
+		}
+
+		dir += "s" + std::to_string( d % FANOUT ) + "/";
+		makeDir( dir.c_str() );
+
+		for ( int f = 0; f < files; f++ ) {
+			writeFile( dir + "f" + std::to_string( f ) + ".txt", "x" );
+		}
+	}
+}
+
+/// Remembers the last modified file, and the watch that reported it
+class PathListener : public efsw::FileWatchListener {
+  public:
+	PathListener() : Events( 0 ), LastWatch( 0 ) {}
+
+	void handleFileAction( efsw::WatchID watchid, const std::string& dir,
+						   const std::string& filename, efsw::Action action, std::string ) {
+		Events++;
+
+		if ( efsw::Actions::Modified == action ) {
+			LastModified = dir + filename;
+			LastWatch = watchid;
+		}
+	}
+
+	long Events;
+	std::string LastModified;
+	efsw::WatchID LastWatch;
+};
+
+/// Moves a deep subtree around a tree of the given size, alternating renames in place and moves
+/// to another directory, and checks after each one that the events of its deepest directory
+/// report the new path. Last it moves the subtree to another watch, whose listener and id must
+/// then report its events.
+static void benchRenames( const std::string& base, int directories ) {
+	static const int RENAMES = 50;
+
+	std::string root( base + "efsw-bench-renames-" + std::to_string( directories ) + "/" );
+	std::string otherRoot( base + "efsw-bench-renames-other/" );
+	createDirectoryTree( root, directories, 0 );
+	makeDir( otherRoot.c_str() );
+
+	std::string parents[2] = { directoryName( root, 0 ) + "s0/", directoryName( root, 1 ) + "s1/" };
+	std::string current( parents[0] + "deep0/" );
+	std::string chain;
+	makeDir( current.c_str() );
+
+	for ( int i = 0; i < RENAME_DEPTH; i++ ) {
+		chain += "c" + std::to_string( i ) + "/";
+		makeDir( ( current + chain ).c_str() );
+	}
+
+	PathListener listener;
+	PathListener otherListener;
+	efsw::FileWatcher watcher( BACKEND );
+	efsw::WatchID rootWatch = watcher.addWatch( root, &listener, true );
+	efsw::WatchID otherWatch = watcher.addWatch( otherRoot, &otherListener, true );
+
+	std::vector<double> times;
+	int failures = 0;
+
+	for ( int i = 1; i <= RENAMES; i++ ) {
+		/// Odd renames stay in the same directory, even ones move to the other parent
+		std::string next( parents[( i / 2 ) % 2] + "deep" + std::to_string( i ) + "/" );
+
+		if ( rename( current.substr( 0, current.size() - 1 ).c_str(),
+					 next.substr( 0, next.size() - 1 ).c_str() ) != 0 ) {
+			failures++;
+			break;
+		}
+
+		Clock::time_point start = Clock::now();
+		watcher.dispatch();
+		times.push_back( millisecondsSince( start ) );
+
+		current = next;
+
+		std::string file( current + chain + "f.txt" );
+		writeFile( file, std::to_string( i ) );
+		watcher.dispatch();
+
+		if ( listener.LastModified != file || listener.LastWatch != rootWatch ) {
+			failures++;
+		}
+	}
+
+	std::string moved( otherRoot + "deep/" );
+
+	if ( rename( current.substr( 0, current.size() - 1 ).c_str(),
+				 moved.substr( 0, moved.size() - 1 ).c_str() ) == 0 ) {
+		watcher.dispatch();
+
+		std::string file( moved + chain + "f.txt" );
+		listener.LastModified.clear();
+		writeFile( file, "moved" );
+		watcher.dispatch();
+
+		if ( otherListener.LastModified != file || otherListener.LastWatch != otherWatch ||
+			 !listener.LastModified.empty() ) {
+			failures++;
+		}
+	} else {
+		failures++;
+	}
+
+	printf( "%8d %8d %14.3f %10s\n", directories + directories / 10 + RENAME_DEPTH + 2, RENAMES,
+			times.empty() ? 0.0 : median( times ),
+			failures ? ( std::to_string( failures ) + " failed" ).c_str() : "ok" );
+
+	system( ( REMOVE_TREE "\"" + root + "\"" ).c_str() );
+	system( ( REMOVE_TREE "\"" + otherRoot + "\"" ).c_str() );
+}
+
+#ifdef __linux__
+/// How the inotify backend registered a tree before: a FileInfo, a statfs, a lstat and a full
+/// listing with a stat per entry for every directory
+static int serialRegistration( int fd, const std::string& dir, bool root ) {
+	efsw::FileInfo fi( dir );
+
+	if ( !fi.isDirectory() || !fi.isReadable() || ( !root && efsw::FileSystem::isRemoteFS( dir ) ) ) {
+		return 0;
+	}
+
+	std::string curPath;
+	efsw::FileSystem::getLinkRealPath( dir, curPath );
+
+	if ( inotify_add_watch( fd, dir.c_str(),
+							IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MOVED_FROM | IN_DELETE |
+								IN_MODIFY ) < 0 ) {
+		return 0;
+	}
+
+	int count = 1;
+	efsw::FileInfoMap files = efsw::FileSystem::filesInfoFromPath( dir );
+
+	for ( efsw::FileInfoMap::iterator it = files.begin(); it != files.end(); ++it ) {
+		if ( it->second.isDirectory() && it->second.isReadable() ) {
+			std::string path( it->second.Filepath );
+			efsw::FileSystem::dirAddSlashAtEnd( path );
+			count += serialRegistration( fd, path, false );
+		}
+	}
+
+	return count;
+}
+
+static void benchStartup( const std::string& base, int directories ) {
+	static const int FILES = 5;
+
+	std::string root( base + "efsw-bench-startup-" + std::to_string( directories ) + "/" );
+	createDirectoryTree( root, directories, FILES );
+
+	std::vector<double> serialTimes;
+	std::vector<double> addTimes;
+	int watches = 0;
+
+	for ( int run = 0; run < 3; run++ ) {
+		int fd = inotify_init();
+		Clock::time_point start = Clock::now();
+		watches = serialRegistration( fd, root, true );
+		serialTimes.push_back( millisecondsSince( start ) );
+		close( fd );
+
+		CountingListener listener;
+		efsw::FileWatcher watcher( efsw::Backends::Native );
+		start = Clock::now();
+		watcher.addWatch( root, &listener, true );
+		addTimes.push_back( millisecondsSince( start ) );
+	}
+
+	double serialTime = median( serialTimes );
+	double addTime = median( addTimes );
+
+	printf( "%8d %8d %12.1f %12.1f %8.2fx\n", watches, directories * FILES, serialTime, addTime,
+			addTime > 0 ? serialTime / addTime : 0.0 );
+
+	system( ( REMOVE_TREE "\"" + root + "\"" ).c_str() );
+}
+#endif
+
+/// The watchers fall back to another backend if the one asked for isn't available
+static void printBackend( efsw::Backend backend ) {
+	efsw::FileWatcher watcher( backend );
+	printf( "Backend: %s\n", watcher.getBackendName() );
+}
+
+int main( int argc, char** argv ) {
+	std::string mode( argc >= 2 ? argv[1] : "" );
+
+	if ( mode != "rescan" && mode != "events" && mode != "filter" && mode != "startup" &&
+		 mode != "renames" ) {
+		printf( "Usage: efsw-bench rescan|events|filter|startup|renames [--fanotify] "
+				"[directory] [counts...]\n" );
+		return 1;
+	}
+
+	int arg = 2;
+
+	if ( arg < argc && std::string( argv[arg] ) == "--fanotify" ) {
+		BACKEND = efsw::Backends::Fanotify;
+		arg++;
+	}
+
+	std::string base( arg < argc ? argv[arg] : efsw::FileSystem::getCurrentWorkingDirectory() );
+	efsw::FileSystem::dirAddSlashAtEnd( base );
+
+	std::vector<int> sizes;
+
+	for ( arg++; arg < argc; arg++ ) {
+		sizes.push_back( atoi( argv[arg] ) );
+	}
+
+	if ( mode == "startup" ) {
+#ifdef __linux__
+		if ( sizes.empty() ) {
+			sizes.push_back( 1000 );
+			sizes.push_back( 10000 );
+			sizes.push_back( 40000 );
+		}
+
+		printBackend( efsw::Backends::Native );
+		printf( "Recursive addWatch in ms ( median of 3 )\n" );
+		printf( "%8s %8s %12s %12s %9s\n", "watches", "files", "before", "addWatch", "speedup" );
+
+		for ( size_t i = 0; i < sizes.size(); i++ ) {
+			benchStartup( base, sizes[i] );
+		}
+
+		return 0;
+#else
+		printf( "startup is only measured against inotify\n" );
+		return 1;
+#endif
+	}
+
+	if ( mode == "renames" ) {
+		if ( sizes.empty() ) {
+			sizes.push_back( 1000 );
+			sizes.push_back( 10000 );
+			sizes.push_back( 40000 );
+		}
+
+		printBackend( BACKEND );
+		printf( "Moves of a %d levels deep directory, dispatch time in ms ( median )\n",
+				RENAME_DEPTH );
+		printf( "%8s %8s %14s %10s\n", "watches", "moves", "per move", "paths" );
+
+		for ( size_t i = 0; i < sizes.size(); i++ ) {
+			benchRenames( base, sizes[i] );
+		}
+
+		return 0;
+	}
+
+	if ( mode == "events" ) {
+		if ( sizes.empty() ) {
+			/// Stay below the default inotify queue size of 16384 events
+			sizes.push_back( 100 );
+			sizes.push_back( 1000 );
+			sizes.push_back( 5000 );
+		}
+
+		printBackend( BACKEND );
+		printf( "Delivery of the events of N file writes in ms ( median of %d ). read is the time a\n"
+				"bare inotify loop takes to read the same events ( inotify only ).\n",
+				EVENT_RUNS );
+		printf( "%8s %8s %10s %10s %10s %9s\n", "writes", "events", "read", "listener", "batch",
+				"speedup" );
+
+		for ( size_t i = 0; i < sizes.size(); i++ ) {
+			benchEvents( base, sizes[i] );
+		}
+
+		return 0;
+	}
+
+	if ( mode == "filter" ) {
+		if ( sizes.empty() ) {
+			sizes.push_back( 100 );
+			sizes.push_back( 1000 );
+			sizes.push_back( 5000 );
+		}
+
+		printBackend( BACKEND );
+		printf( "Delivery of the events of N file writes to a FileWatchListener in ms "
+				"( median of %d )\n",
+				EVENT_RUNS );
+		printf( "%8s %8s %12s %8s %12s %9s\n", "writes", "events", "unfiltered", "events",
+				"*.glsl", "speedup" );
+
+		for ( size_t i = 0; i < sizes.size(); i++ ) {
+			benchFilter( base, sizes[i] );
+		}
+
+		return 0;
+	}
+
+	if ( sizes.empty() ) {
+		sizes.push_back( 1000 );
+		sizes.push_back( 10000 );
+		sizes.push_back( 100000 );
+	}
+
+	printBackend( efsw::Backends::Generic );
+	printf( "Generic watcher pass cost in ms ( median of 5 )\n" );
+	printf( "%8s %10s %14s %10s %12s %12s %8s\n", "files", "addWatch", "full rescan", "idle",
+			"1 modified", "1 created", "events" );
+
+	for ( size_t i = 0; i < sizes.size(); i++ ) {
+		benchRescan( base, sizes[i] );
+	}
+
+	return 0;
+}
@@ -78,4 +78,30 @@ void efPRINTC( unsigned int cond, const char* format, ... ) {
 
 #endif
 
+#ifdef EFSW_TRACE
+
+static TraceBeginCallback sTraceBegin = NULL;
+static TraceEndCallback sTraceEnd = NULL;
+
+void setTraceCallbacks( TraceBeginCallback begin, TraceEndCallback end ) {
+	sTraceBegin = begin;
+	sTraceEnd = end;
+}
+
+TraceScope::TraceScope( const char* name ) {
+	if ( sTraceBegin )
+		sTraceBegin( name );
+}
+
+TraceScope::~TraceScope() {
+	if ( sTraceEnd )
+		sTraceEnd();
+}
+
+#else
+
+void setTraceCallbacks( TraceBeginCallback, TraceEndCallback ) {}
+
+#endif
+
 } // namespace efsw
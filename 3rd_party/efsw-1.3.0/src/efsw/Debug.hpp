@@ -55,6 +55,20 @@ void efPRINTC( unsigned int cond, const char* format, ... );
 
 #endif
 
+#ifdef EFSW_TRACE
+/// Calls the callbacks registered with setTraceCallbacks around a scope
+class TraceScope {
+  public:
+	explicit TraceScope( const char* name );
+
+	~TraceScope();
+};
+
+#define efTRACE_SCOPE( name ) efsw::TraceScope efTraceScope( name )
+#else
+#define efTRACE_SCOPE( name )
+#endif
+
 } // namespace efsw
 
 #endif
@@ -92,14 +92,15 @@ void DirWatcherGeneric::addChilds( bool reportNewFiles ) {
 		/// Create the subdirectories watchers
 		std::string dir;
 
-		for ( FileInfoMap::iterator it = DirSnap.Files.begin(); it != DirSnap.Files.end(); it++ ) {
-			if ( it->second.isDirectory() && it->second.isReadable() &&
-				 !FileSystem::isRemoteFS( it->second.Filepath ) ) {
+		for ( DirectorySnapshot::EntryList::iterator it = DirSnap.Entries.begin();
+			  it != DirSnap.Entries.end(); it++ ) {
+			if ( it->Info.isDirectory() && it->Info.isReadable() &&
+				 !FileSystem::isRemoteFS( it->Info.Filepath ) ) {
 				/// Check if the directory is a symbolic link
 				std::string curPath;
-				std::string link( FileSystem::getLinkRealPath( it->second.Filepath, curPath ) );
+				std::string link( FileSystem::getLinkRealPath( it->Info.Filepath, curPath ) );
 
-				dir = it->first;
+				dir = it->Name;
 
 				if ( "" != link ) {
 					/// Avoid adding symlinks directories if it's now enabled
@@ -135,13 +136,15 @@ void DirWatcherGeneric::addChilds( bool reportNewFiles ) {
 	}
 }
 
-void DirWatcherGeneric::watch( bool reportOwnChange ) {
+bool DirWatcherGeneric::watch( bool reportOwnChange ) {
 	DirectorySnapshotDiff Diff = DirSnap.scan();
+	bool changed = Diff.changed();
 
 	if ( reportOwnChange && Diff.DirChanged && NULL != Parent ) {
 		Watch->Listener->handleFileAction(
 			Watch->ID, FileSystem::pathRemoveFileName( DirSnap.DirectoryInfo.Filepath ),
 			FileSystem::fileNameFromPath( DirSnap.DirectoryInfo.Filepath ), Actions::Modified );
+		changed = true;
 	}
 
 	if ( Diff.changed() ) {
@@ -188,7 +191,19 @@ void DirWatcherGeneric::watch( bool reportOwnChange ) {
 	/// Process the subdirectories looking for changes
 	for ( DirWatchMap::iterator dit = Directories.begin(); dit != Directories.end(); ++dit ) {
 		/// Just watch
-		dit->second->watch();
+		if ( dit->second->watch() ) {
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+void DirWatcherGeneric::collectSnapshots( std::vector<DirectorySnapshot*>& snapshots ) {
+	snapshots.push_back( &DirSnap );
+
+	for ( DirWatchMap::iterator dit = Directories.begin(); dit != Directories.end(); ++dit ) {
+		dit->second->collectSnapshots( snapshots );
 	}
 }
 
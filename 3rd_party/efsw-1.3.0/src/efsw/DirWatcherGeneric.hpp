@@ -23,7 +23,11 @@ class DirWatcherGeneric {
 
 	~DirWatcherGeneric();
 
-	void watch( bool reportOwnChange = false );
+	/// @return If any event was reported, for this directory or below
+	bool watch( bool reportOwnChange = false );
+
+	/// Appends the snapshots of this directory and every subdirectory
+	void collectSnapshots( std::vector<DirectorySnapshot*>& snapshots );
 
 	void watchDir( std::string& dir );
 
@@ -1,11 +1,67 @@
+#include <algorithm>
+#include <ctime>
+#include <efsw/Debug.hpp>
 #include <efsw/DirectorySnapshot.hpp>
 #include <efsw/FileSystem.hpp>
+#include <efsw/Thread.hpp>
+#include <map>
+
+/// A listing is only trusted once the directory modification time is this many seconds older
+/// than the listing. The time has a resolution of a second, so an entry added in the same
+/// second as the listing wouldn't change it.
+#define LISTING_SETTLE_TIME 2
+
+/// Prefetching is only spread over threads for at least this many entries per thread
+#define PREFETCH_ENTRIES_PER_THREAD 1024
+#define PREFETCH_MAX_THREADS 8
 
 namespace efsw {
 
-DirectorySnapshot::DirectorySnapshot() {}
+namespace {
+
+Uint32 hashName( const std::string& name ) {
+	/// FNV-1a
+	Uint32 hash = 2166136261u;
+
+	for ( size_t i = 0; i < name.size(); i++ ) {
+		hash = ( hash ^ (unsigned char)name[i] ) * 16777619u;
+	}
+
+	return hash;
+}
+
+/// Stats path into fi, reusing its buffers
+void statInto( FileInfo& fi, const std::string& dir, const std::string& name ) {
+	fi.Filepath.assign( dir );
+	fi.Filepath.append( name );
+	fi.ModificationTime = 0;
+	fi.Size = 0;
+	fi.OwnerId = 0;
+	fi.GroupId = 0;
+	fi.Permissions = 0;
+	fi.Inode = 0;
+	fi.getInfo();
+}
+
+struct PrefetchRange {
+	const std::vector<DirectorySnapshot*>* Snapshots;
+	size_t Begin;
+	size_t End;
+
+	void operator()() {
+		for ( size_t i = Begin; i < End; i++ ) {
+			( *Snapshots )[i]->prefetch();
+		}
+	}
+};
+
+} // namespace
 
-DirectorySnapshot::DirectorySnapshot( std::string directory ) {
+DirectorySnapshot::DirectorySnapshot() :
+	mListed( false ), mListedAt( 0 ), mPrefetched( false ), mFetchedListing( false ) {}
+
+DirectorySnapshot::DirectorySnapshot( std::string directory ) :
+	mListed( false ), mListedAt( 0 ), mPrefetched( false ), mFetchedListing( false ) {
 	init( directory );
 }
 
@@ -21,19 +77,17 @@ bool DirectorySnapshot::exists() {
 }
 
 void DirectorySnapshot::deleteAll( DirectorySnapshotDiff& Diff ) {
-	FileInfo fi;
-
-	for ( FileInfoMap::iterator it = Files.begin(); it != Files.end(); it++ ) {
-		fi = it->second;
-
-		if ( fi.isDirectory() ) {
-			Diff.DirsDeleted.push_back( fi );
+	for ( EntryList::iterator it = Entries.begin(); it != Entries.end(); it++ ) {
+		if ( it->Info.isDirectory() ) {
+			Diff.DirsDeleted.push_back( it->Info );
 		} else {
-			Diff.FilesDeleted.push_back( fi );
+			Diff.FilesDeleted.push_back( it->Info );
 		}
 	}
 
-	Files.clear();
+	Entries.clear();
+	mIndex.clear();
+	mListed = false;
 }
 
 void DirectorySnapshot::setDirectoryInfo( std::string directory ) {
@@ -41,21 +95,90 @@ void DirectorySnapshot::setDirectoryInfo( std::string directory ) {
 }
 
 void DirectorySnapshot::initFiles() {
-	Files = FileSystem::filesInfoFromPath( DirectoryInfo.Filepath );
+	DirectorySnapshotDiff Diff;
+
+	mListed = false;
+	prefetch();
+	mPrefetched = false;
+	applyListing( Diff );
+}
+
+void DirectorySnapshot::prefetch() {
+	std::string path( DirectoryInfo.Filepath );
+	FileSystem::dirAddSlashAtEnd( path );
 
-	FileInfoMap::iterator it = Files.begin();
-	std::list<std::string> eraseFiles;
+	mFetchedDirInfo = FileInfo( DirectoryInfo.Filepath );
+	mFetchedListing = !mListed || mFetchedDirInfo != DirectoryInfo ||
+					  mFetchedDirInfo.ModificationTime + LISTING_SETTLE_TIME > mListedAt;
 
-	/// Remove all non regular files and non directories
-	for ( ; it != Files.end(); it++ ) {
-		if ( !it->second.isRegularFile() && !it->second.isDirectory() ) {
-			eraseFiles.push_back( it->first );
+	if ( mFetchedListing ) {
+		mListedAt = (Uint64)time( NULL );
+		mFetchedNames = FileSystem::fileNamesFromPath( path );
+		std::sort( mFetchedNames.begin(), mFetchedNames.end() );
+
+		mFetchedInfos.resize( mFetchedNames.size() );
+
+		for ( size_t i = 0; i < mFetchedNames.size(); i++ ) {
+			statInto( mFetchedInfos[i], path, mFetchedNames[i] );
+		}
+	} else {
+		/// Nothing was added, removed or renamed, only the files themselves can have changed
+		mFetchedInfos.resize( Entries.size() );
+
+		for ( size_t i = 0; i < Entries.size(); i++ ) {
+			statInto( mFetchedInfos[i], path, Entries[i].Name );
 		}
 	}
 
-	for ( std::list<std::string>::iterator eit = eraseFiles.begin(); eit != eraseFiles.end();
-		  eit++ ) {
-		Files.erase( *eit );
+	mPrefetched = true;
+}
+
+void DirectorySnapshot::prefetch( const std::vector<DirectorySnapshot*>& snapshots ) {
+	efTRACE_SCOPE( "DirectorySnapshot::prefetch" );
+
+	size_t entries = 0;
+
+	for ( size_t i = 0; i < snapshots.size(); i++ ) {
+		entries += snapshots[i]->Entries.size() + 1;
+	}
+
+	size_t threadCount =
+		std::min<size_t>( PREFETCH_MAX_THREADS, entries / PREFETCH_ENTRIES_PER_THREAD );
+
+	if ( threadCount < 2 ) {
+		for ( size_t i = 0; i < snapshots.size(); i++ ) {
+			snapshots[i]->prefetch();
+		}
+
+		return;
+	}
+
+	/// Split the snapshots in ranges of about the same number of entries, the last range is
+	/// prefetched on the calling thread
+	std::vector<Thread*> threads;
+	size_t perThread = entries / threadCount;
+	size_t begin = 0;
+	size_t count = 0;
+
+	for ( size_t i = 0; i < snapshots.size() && threads.size() + 1 < threadCount; i++ ) {
+		count += snapshots[i]->Entries.size() + 1;
+
+		if ( count >= perThread ) {
+			PrefetchRange range = { &snapshots, begin, i + 1 };
+			Thread* thread = new Thread( range );
+			thread->launch();
+			threads.push_back( thread );
+
+			begin = i + 1;
+			count = 0;
+		}
+	}
+
+	PrefetchRange range = { &snapshots, begin, snapshots.size() };
+	range();
+
+	for ( size_t i = 0; i < threads.size(); i++ ) {
+		efSAFE_DELETE( threads[i] );
 	}
 }
 
@@ -64,139 +187,234 @@ DirectorySnapshotDiff DirectorySnapshot::scan() {
 
 	Diff.clear();
 
-	FileInfo curFI( DirectoryInfo.Filepath );
+	if ( !mPrefetched ) {
+		prefetch();
+	}
+
+	mPrefetched = false;
 
-	Diff.DirChanged = DirectoryInfo != curFI;
+	Diff.DirChanged = DirectoryInfo != mFetchedDirInfo;
 
 	if ( Diff.DirChanged ) {
-		DirectoryInfo = curFI;
+		DirectoryInfo = mFetchedDirInfo;
 	}
 
 	/// If the directory was erased, create the events for files and directories deletion
-	if ( !curFI.exists() ) {
+	if ( !mFetchedDirInfo.isDirectory() ) {
 		deleteAll( Diff );
 
 		return Diff;
 	}
 
-	FileInfoMap files = FileSystem::filesInfoFromPath( DirectoryInfo.Filepath );
-
-	if ( files.empty() && Files.empty() ) {
-		return Diff;
+	if ( mFetchedListing ) {
+		applyListing( Diff );
+	} else {
+		applyStats( Diff );
 	}
 
-	FileInfo fi;
-	FileInfoMap FilesCpy;
-	FileInfoMap::iterator it;
-	FileInfoMap::iterator fiIt;
+	return Diff;
+}
 
-	if ( Diff.DirChanged ) {
-		FilesCpy = Files;
+void DirectorySnapshot::applyStats( DirectorySnapshotDiff& Diff ) {
+	for ( size_t i = 0; i < Entries.size() && i < mFetchedInfos.size(); i++ ) {
+		const FileInfo& fi = mFetchedInfos[i];
+		Entry& entry = Entries[i];
+
+		/// Removed after the directory was stat'ed, the next listing will report it
+		if ( !fi.isRegularFile() && !fi.isDirectory() ) {
+			continue;
+		}
+
+		/// File changed?
+		if ( entry.Info != fi ) {
+			entry.Info = fi;
+
+			if ( fi.isDirectory() ) {
+				Diff.DirsModified.push_back( fi );
+			} else {
+				Diff.FilesModified.push_back( fi );
+			}
+		}
 	}
+}
+
+void DirectorySnapshot::applyListing( DirectorySnapshotDiff& Diff ) {
+	EntryList entries;
+	std::vector<bool> kept( Entries.size(), false );
+	std::vector<size_t> created;
 
-	for ( it = files.begin(); it != files.end(); it++ ) {
-		fi = it->second;
+	entries.reserve( mFetchedNames.size() );
 
-		/// File existed before?
-		fiIt = Files.find( it->first );
+	for ( size_t i = 0; i < mFetchedNames.size(); i++ ) {
+		const FileInfo& fi = mFetchedInfos[i];
+
+		/// Only add regular files or directories
+		if ( !fi.isRegularFile() && !fi.isDirectory() ) {
+			continue;
+		}
 
-		if ( fiIt != Files.end() ) {
-			/// Erase from the file list copy
-			FilesCpy.erase( it->first );
+		Uint32 hash = hashName( mFetchedNames[i] );
+		long old = findIndex( mFetchedNames[i], hash );
 
-			/// File changed?
-			if ( ( *fiIt ).second != fi ) {
-				/// Update the new file info
-				Files[it->first] = fi;
+		if ( old >= 0 ) {
+			kept[old] = true;
 
-				/// handle modified event
+			if ( Entries[old].Info != fi ) {
 				if ( fi.isDirectory() ) {
 					Diff.DirsModified.push_back( fi );
 				} else {
 					Diff.FilesModified.push_back( fi );
 				}
 			}
+		} else {
+			created.push_back( entries.size() );
 		}
-		/// Only add regular files or directories
-		else if ( fi.isRegularFile() || fi.isDirectory() ) {
-			/// New file found
-			Files[it->first] = fi;
 
-			FileInfoMap::iterator fit;
-			std::string oldFile = "";
+		entries.push_back( Entry() );
+		entries.back().Name.swap( mFetchedNames[i] );
+		entries.back().Info = fi;
+		entries.back().Hash = hash;
+	}
 
-			/// Check if the same inode already existed
-			if ( ( fit = nodeInFiles( fi ) ) != Files.end() ) {
-				oldFile = fit->first;
+	/// The entries that are gone were either renamed to one of the new names or deleted
+	std::map<Uint64, size_t> vanishedInodes;
 
-				/// Avoid firing a Delete event
-				FilesCpy.erase( fit->first );
+	if ( !created.empty() && FileInfo::inodeSupported() ) {
+		for ( size_t i = 0; i < Entries.size(); i++ ) {
+			if ( !kept[i] ) {
+				vanishedInodes[Entries[i].Info.Inode] = i;
+			}
+		}
+	}
 
-				/// Delete the old file name
-				Files.erase( fit->first );
+	for ( size_t i = 0; i < created.size(); i++ ) {
+		const FileInfo& fi = entries[created[i]].Info;
+		std::map<Uint64, size_t>::iterator it = vanishedInodes.find( fi.Inode );
 
-				if ( fi.isDirectory() ) {
-					Diff.DirsMoved.push_back( std::make_pair( oldFile, fi ) );
-				} else {
-					Diff.FilesMoved.push_back( std::make_pair( oldFile, fi ) );
-				}
+		if ( it != vanishedInodes.end() &&
+			 Entries[it->second].Info.isDirectory() == fi.isDirectory() ) {
+			kept[it->second] = true;
+
+			if ( fi.isDirectory() ) {
+				Diff.DirsMoved.push_back( std::make_pair( Entries[it->second].Name, fi ) );
 			} else {
-				if ( fi.isDirectory() ) {
-					Diff.DirsCreated.push_back( fi );
-				} else {
-					Diff.FilesCreated.push_back( fi );
-				}
+				Diff.FilesMoved.push_back( std::make_pair( Entries[it->second].Name, fi ) );
 			}
+
+			vanishedInodes.erase( it );
+		} else if ( fi.isDirectory() ) {
+			Diff.DirsCreated.push_back( fi );
+		} else {
+			Diff.FilesCreated.push_back( fi );
 		}
 	}
 
-	if ( !Diff.DirChanged ) {
-		return Diff;
+	for ( size_t i = 0; i < Entries.size(); i++ ) {
+		if ( !kept[i] ) {
+			if ( Entries[i].Info.isDirectory() ) {
+				Diff.DirsDeleted.push_back( Entries[i].Info );
+			} else {
+				Diff.FilesDeleted.push_back( Entries[i].Info );
+			}
+		}
 	}
 
-	/// The files or directories that remains were deleted
-	for ( it = FilesCpy.begin(); it != FilesCpy.end(); it++ ) {
-		fi = it->second;
+	Entries.swap( entries );
+	rebuildIndex();
+	mListed = true;
+}
 
-		if ( fi.isDirectory() ) {
-			Diff.DirsDeleted.push_back( fi );
-		} else {
-			Diff.FilesDeleted.push_back( fi );
+long DirectorySnapshot::findIndex( const std::string& name, Uint32 hash ) const {
+	if ( mIndex.empty() ) {
+		return -1;
+	}
+
+	size_t mask = mIndex.size() - 1;
+
+	for ( size_t pos = hash & mask;; pos = ( pos + 1 ) & mask ) {
+		Uint32 slot = mIndex[pos];
+
+		if ( 0 == slot ) {
+			return -1;
 		}
 
-		/// Remove the file or directory from the list of files
-		Files.erase( it->first );
-	}
+		const Entry& entry = Entries[slot - 1];
 
-	return Diff;
+		if ( entry.Hash == hash && entry.Name == name ) {
+			return slot - 1;
+		}
+	}
 }
 
-FileInfoMap::iterator DirectorySnapshot::nodeInFiles( FileInfo& fi ) {
-	FileInfoMap::iterator it;
+void DirectorySnapshot::rebuildIndex() {
+	size_t size = 16;
 
-	if ( FileInfo::inodeSupported() ) {
-		for ( it = Files.begin(); it != Files.end(); it++ ) {
-			if ( it->second.sameInode( fi ) && it->second.Filepath != fi.Filepath ) {
-				return it;
-			}
+	while ( size < Entries.size() * 2 ) {
+		size <<= 1;
+	}
+
+	mIndex.assign( size, 0 );
+
+	size_t mask = size - 1;
+
+	for ( size_t i = 0; i < Entries.size(); i++ ) {
+		size_t pos = Entries[i].Hash & mask;
+
+		while ( 0 != mIndex[pos] ) {
+			pos = ( pos + 1 ) & mask;
 		}
+
+		mIndex[pos] = i + 1;
 	}
+}
 
-	return Files.end();
+DirectorySnapshot::Entry* DirectorySnapshot::find( const std::string& name ) {
+	long index = findIndex( name, hashName( name ) );
+
+	return index >= 0 ? &Entries[index] : NULL;
 }
 
 void DirectorySnapshot::addFile( std::string path ) {
 	std::string name( FileSystem::fileNameFromPath( path ) );
-	Files[name] = FileInfo( path );
+
+	/// Invalidates a prefetch, which is parallel to the entries
+	mPrefetched = false;
+
+	if ( Entry* entry = find( name ) ) {
+		entry->Info = FileInfo( path );
+		return;
+	}
+
+	Entry entry;
+	entry.Name = name;
+	entry.Info = FileInfo( path );
+	entry.Hash = hashName( name );
+	Entries.push_back( entry );
+
+	if ( Entries.size() * 2 > mIndex.size() ) {
+		rebuildIndex();
+		return;
+	}
+
+	size_t mask = mIndex.size() - 1;
+	size_t pos = entry.Hash & mask;
+
+	while ( 0 != mIndex[pos] ) {
+		pos = ( pos + 1 ) & mask;
+	}
+
+	mIndex[pos] = Entries.size();
 }
 
 void DirectorySnapshot::removeFile( std::string path ) {
 	std::string name( FileSystem::fileNameFromPath( path ) );
 
-	FileInfoMap::iterator it = Files.find( name );
+	long index = findIndex( name, hashName( name ) );
 
-	if ( Files.end() != it ) {
-		Files.erase( it );
+	if ( index >= 0 ) {
+		mPrefetched = false;
+		Entries.erase( Entries.begin() + index );
+		rebuildIndex();
 	}
 }
 
@@ -2,13 +2,26 @@
 #define EFSW_DIRECTORYSNAPSHOT_HPP
 
 #include <efsw/DirectorySnapshotDiff.hpp>
+#include <vector>
 
 namespace efsw {
 
+/// Last known state of the entries of a directory.
+/// The entries are kept in a flat array, sorted by name, with an open addressing index of
+/// their name hashes. The directory is only listed again when its own stat changed, otherwise
+/// only the known entries are stat'ed to find modified files.
 class DirectorySnapshot {
   public:
+	struct Entry {
+		std::string Name;
+		FileInfo Info;
+		Uint32 Hash;
+	};
+
+	typedef std::vector<Entry> EntryList;
+
 	FileInfo DirectoryInfo;
-	FileInfoMap Files;
+	EntryList Entries;
 
 	void setDirectoryInfo( std::string directory );
 
@@ -22,9 +35,19 @@ class DirectorySnapshot {
 
 	bool exists();
 
+	/// Reads the current state of the directory for the next scan(). Only touches this
+	/// snapshot, so different snapshots can be prefetched from different threads.
+	void prefetch();
+
+	/// Prefetches every snapshot, spread over several threads when there are many entries
+	static void prefetch( const std::vector<DirectorySnapshot*>& snapshots );
+
+	/// Compares the prefetched state, or the current one if there is none, with the snapshot
+	/// and updates the snapshot
 	DirectorySnapshotDiff scan();
 
-	FileInfoMap::iterator nodeInFiles( FileInfo& fi );
+	/// @return The entry with the given name, or NULL
+	Entry* find( const std::string& name );
 
 	void addFile( std::string path );
 
@@ -35,9 +58,37 @@ class DirectorySnapshot {
 	void updateFile( std::string path );
 
   protected:
+	/// Entries + 1, 0 for empty slots. Sized to a power of two of at least twice the entries.
+	std::vector<Uint32> mIndex;
+
+	/// If the entries were listed from the directory at least once
+	bool mListed;
+
+	/// Time of the last listing, in the units of FileInfo::ModificationTime
+	Uint64 mListedAt;
+
+	/// Result of prefetch(), consumed by the next scan()
+	bool mPrefetched;
+	bool mFetchedListing;
+	FileInfo mFetchedDirInfo;
+	/// Names of the new listing, if mFetchedListing
+	std::vector<std::string> mFetchedNames;
+	/// Parallel to mFetchedNames if mFetchedListing, else to Entries. Reused between scans.
+	std::vector<FileInfo> mFetchedInfos;
+
 	void initFiles();
 
 	void deleteAll( DirectorySnapshotDiff& Diff );
+
+	/// Applies a new listing of the directory
+	void applyListing( DirectorySnapshotDiff& Diff );
+
+	/// Applies the new stats of the known entries
+	void applyStats( DirectorySnapshotDiff& Diff );
+
+	long findIndex( const std::string& name, Uint32 hash ) const;
+
+	void rebuildIndex();
 };
 
 } // namespace efsw
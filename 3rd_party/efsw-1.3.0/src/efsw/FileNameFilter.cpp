@@ -0,0 +1,147 @@
+#include <efsw/FileNameFilter.hpp>
+#include <string.h>
+
+namespace efsw {
+
+FileNameFilter::FileNameFilter( const WatchFilter& filter ) {
+	for ( size_t i = 0; i < filter.Include.size(); ++i ) {
+		mInclude.push_back( compile( filter.Include[i] ) );
+	}
+
+	for ( size_t i = 0; i < filter.Exclude.size(); ++i ) {
+		mExclude.push_back( compile( filter.Exclude[i] ) );
+	}
+}
+
+bool FileNameFilter::reports( const char* name ) const {
+	return ( mInclude.empty() || matches( mInclude, name ) ) && !matches( mExclude, name );
+}
+
+bool FileNameFilter::excludes( const char* name ) const {
+	return matches( mExclude, name );
+}
+
+bool FileNameFilter::accepts( const char* name, bool isDirectory ) const {
+	return isDirectory ? !matches( mExclude, name ) : reports( name );
+}
+
+FileNameFilter::Pattern FileNameFilter::compile( const std::string& pattern ) {
+	Pattern compiled;
+	compiled.Text = pattern;
+
+	if ( std::string::npos != pattern.find( '?' ) ) {
+		compiled.Type = Glob;
+		return compiled;
+	}
+
+	size_t first = pattern.find( '*' );
+
+	if ( std::string::npos == first ) {
+		compiled.Type = Literal;
+		return compiled;
+	}
+
+	size_t last = pattern.find_last_not_of( '*' );
+
+	if ( std::string::npos == last ) {
+		compiled.Type = All;
+		compiled.Text.clear();
+		return compiled;
+	}
+
+	/// Where the literal part starts and ends
+	size_t begin = pattern.find_first_not_of( '*' );
+	size_t end = last + 1;
+
+	if ( std::string::npos != pattern.substr( begin, end - begin ).find( '*' ) ) {
+		compiled.Type = Glob;
+		return compiled;
+	}
+
+	compiled.Text = pattern.substr( begin, end - begin );
+
+	if ( begin > 0 && end < pattern.size() ) {
+		compiled.Type = Contains;
+	} else if ( begin > 0 ) {
+		compiled.Type = Suffix;
+	} else {
+		compiled.Type = Prefix;
+	}
+
+	return compiled;
+}
+
+bool FileNameFilter::matches( const std::vector<Pattern>& patterns, const char* name ) {
+	if ( patterns.empty() ) {
+		return false;
+	}
+
+	size_t length = strlen( name );
+
+	for ( size_t i = 0; i < patterns.size(); ++i ) {
+		const Pattern& pattern = patterns[i];
+		const std::string& text = pattern.Text;
+
+		switch ( pattern.Type ) {
+			case Literal:
+				if ( length == text.size() && 0 == memcmp( name, text.c_str(), length ) ) {
+					return true;
+				}
+				break;
+			case Prefix:
+				if ( length >= text.size() && 0 == memcmp( name, text.c_str(), text.size() ) ) {
+					return true;
+				}
+				break;
+			case Suffix:
+				if ( length >= text.size() &&
+					 0 == memcmp( name + length - text.size(), text.c_str(), text.size() ) ) {
+					return true;
+				}
+				break;
+			case Contains:
+				if ( NULL != strstr( name, text.c_str() ) ) {
+					return true;
+				}
+				break;
+			case All:
+				return true;
+			case Glob:
+				if ( matchGlob( text.c_str(), name ) ) {
+					return true;
+				}
+				break;
+		}
+	}
+
+	return false;
+}
+
+bool FileNameFilter::matchGlob( const char* pattern, const char* name ) {
+	/// Backtracks to the last *, enough without character classes
+	const char* star = NULL;
+	const char* resume = NULL;
+
+	while ( *name ) {
+		if ( *pattern == '*' ) {
+			star = pattern++;
+			resume = name;
+		} else if ( *pattern == '?' || *pattern == *name ) {
+			++pattern;
+			++name;
+		} else if ( NULL != star ) {
+			pattern = star + 1;
+			name = ++resume;
+		} else {
+			return false;
+		}
+	}
+
+	while ( *pattern == '*' ) {
+		++pattern;
+	}
+
+	return !*pattern;
+}
+
+} // namespace efsw
@@ -0,0 +1,60 @@
+#ifndef EFSW_FILENAMEFILTER_HPP
+#define EFSW_FILENAMEFILTER_HPP
+
+#include <efsw/base.hpp>
+#include <efsw/efsw.hpp>
+#include <string>
+#include <vector>
+
+namespace efsw {
+
+/// A WatchFilter compiled once for the watch. Most patterns are a literal with a wildcard at one
+/// end or both, those are matched with a single comparison on the bare name.
+class FileNameFilter {
+  public:
+	FileNameFilter( const WatchFilter& filter );
+
+	/// @return If the events of the name are reported
+	bool reports( const char* name ) const;
+
+	/// @return If the name matches an exclude pattern
+	bool excludes( const char* name ) const;
+
+	/// @return If the event must be handled: directories only need not to be excluded, they
+	/// are still watched when they don't match the includes
+	bool accepts( const char* name, bool isDirectory ) const;
+
+  protected:
+	enum Kind {
+		/// The whole name
+		Literal,
+		/// literal*
+		Prefix,
+		/// *literal
+		Suffix,
+		/// *literal*
+		Contains,
+		/// Any name
+		All,
+		/// Anything else, matched with backtracking
+		Glob
+	};
+
+	struct Pattern {
+		Kind Type;
+		std::string Text;
+	};
+
+	std::vector<Pattern> mInclude;
+	std::vector<Pattern> mExclude;
+
+	static Pattern compile( const std::string& pattern );
+
+	static bool matches( const std::vector<Pattern>& patterns, const char* name );
+
+	static bool matchGlob( const char* pattern, const char* name );
+};
+
+} // namespace efsw
+
+#endif
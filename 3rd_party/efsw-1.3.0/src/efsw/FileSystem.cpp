@@ -17,6 +17,12 @@ FileInfoMap FileSystem::filesInfoFromPath( std::string path ) {
 	return Platform::FileSystem::filesInfoFromPath( path );
 }
 
+std::vector<std::string> FileSystem::fileNamesFromPath( std::string path ) {
+	dirAddSlashAtEnd( path );
+
+	return Platform::FileSystem::fileNamesFromPath( path );
+}
+
 char FileSystem::getOSSlash() {
 	return Platform::FileSystem::getOSSlash();
 }
@@ -4,6 +4,7 @@
 #include <efsw/FileInfo.hpp>
 #include <efsw/base.hpp>
 #include <map>
+#include <vector>
 
 namespace efsw {
 
@@ -13,6 +14,9 @@ class FileSystem {
 
 	static FileInfoMap filesInfoFromPath( std::string path );
 
+	/// Names of the entries of a directory, without stat'ing them
+	static std::vector<std::string> fileNamesFromPath( std::string path );
+
 	static char getOSSlash();
 
 	static bool slashAtEnd( std::string& dir );
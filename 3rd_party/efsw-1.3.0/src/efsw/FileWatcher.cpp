@@ -8,6 +8,7 @@
 #define FILEWATCHER_IMPL FileWatcherWin32
 #define BACKEND_NAME "Win32"
 #elif EFSW_PLATFORM == EFSW_PLATFORM_INOTIFY
+#include <efsw/FileWatcherFanotify.hpp>
 #include <efsw/FileWatcherInotify.hpp>
 #define FILEWATCHER_IMPL FileWatcherInotify
 #define BACKEND_NAME "Inotify"
@@ -28,39 +29,62 @@
 
 namespace efsw {
 
-FileWatcher::FileWatcher() : mFollowSymlinks( false ), mOutOfScopeLinks( false ) {
-	efDEBUG( "Using backend: %s\n", BACKEND_NAME );
+static FileWatcherImpl* createPlatformImpl( FileWatcher* parent, Backend backend,
+											const char*& name ) {
+	FileWatcherImpl* impl;
 
-	mImpl = new FILEWATCHER_IMPL( this );
+	if ( Backends::Generic == backend ) {
+		efDEBUG( "Using backend: Generic\n" );
 
-	if ( !mImpl->initOK() ) {
-		efSAFE_DELETE( mImpl );
+		name = "Generic";
+		return new FileWatcherGeneric( parent );
+	}
 
-		efDEBUG( "Falled back to backend: %s\n", BACKEND_NAME );
+#if EFSW_PLATFORM == EFSW_PLATFORM_INOTIFY
+	if ( Backends::Fanotify == backend ) {
+		/// Only usable with enough privileges, else inotify does the job
+		efDEBUG( "Using backend: Fanotify\n" );
 
-		mImpl = new FileWatcherGeneric( this );
-	}
-}
+		impl = new FileWatcherFanotify( parent );
 
-FileWatcher::FileWatcher( bool useGenericFileWatcher ) :
-	mFollowSymlinks( false ), mOutOfScopeLinks( false ) {
-	if ( useGenericFileWatcher ) {
-		efDEBUG( "Using backend: Generic\n" );
+		if ( impl->initOK() ) {
+			name = "Fanotify";
+			return impl;
+		}
 
-		mImpl = new FileWatcherGeneric( this );
-	} else {
-		efDEBUG( "Using backend: %s\n", BACKEND_NAME );
+		efSAFE_DELETE( impl );
+	}
+#endif
 
-		mImpl = new FILEWATCHER_IMPL( this );
+	efDEBUG( "Using backend: %s\n", BACKEND_NAME );
 
-		if ( !mImpl->initOK() ) {
-			efSAFE_DELETE( mImpl );
+	impl = new FILEWATCHER_IMPL( parent );
+	name = BACKEND_NAME;
 
-			efDEBUG( "Falled back to backend: %s\n", BACKEND_NAME );
+	if ( !impl->initOK() ) {
+		efSAFE_DELETE( impl );
 
-			mImpl = new FileWatcherGeneric( this );
-		}
+		efDEBUG( "Falled back to backend: Generic\n" );
+
+		impl = new FileWatcherGeneric( parent );
+		name = "Generic";
 	}
+
+	return impl;
+}
+
+FileWatcher::FileWatcher() : mFollowSymlinks( false ), mOutOfScopeLinks( false ) {
+	mImpl = createPlatformImpl( this, Backends::Native, mBackendName );
+}
+
+FileWatcher::FileWatcher( bool useGenericFileWatcher ) :
+	mFollowSymlinks( false ), mOutOfScopeLinks( false ) {
+	mImpl = createPlatformImpl( this, useGenericFileWatcher ? Backends::Generic : Backends::Native,
+								mBackendName );
+}
+
+FileWatcher::FileWatcher( Backend backend ) : mFollowSymlinks( false ), mOutOfScopeLinks( false ) {
+	mImpl = createPlatformImpl( this, backend, mBackendName );
 }
 
 FileWatcher::~FileWatcher() {
@@ -84,6 +108,15 @@ WatchID FileWatcher::addWatch( const std::string& directory, FileWatchListener*
 	}
 }
 
+WatchID FileWatcher::addWatch( const std::string& directory, FileWatchListener* watcher,
+							   bool recursive, const WatchFilter& filter ) {
+	if ( mImpl->mIsGeneric || !FileSystem::isRemoteFS( directory ) ) {
+		return mImpl->addFilteredWatch( directory, watcher, recursive, filter );
+	} else {
+		return Errors::Log::createLastError( Errors::FileRemote, directory );
+	}
+}
+
 void FileWatcher::removeWatch( const std::string& directory ) {
 	mImpl->removeWatch( directory );
 }
@@ -96,10 +129,22 @@ void FileWatcher::watch() {
 	mImpl->watch();
 }
 
+int FileWatcher::getFileDescriptor() {
+	return mImpl->getFileDescriptor();
+}
+
+void FileWatcher::dispatch() {
+	mImpl->dispatch();
+}
+
 std::list<std::string> FileWatcher::directories() {
 	return mImpl->directories();
 }
 
+const char* FileWatcher::getBackendName() const {
+	return mBackendName;
+}
+
 void FileWatcher::followSymlinks( bool follow ) {
 	mFollowSymlinks = follow;
 }
@@ -96,6 +96,14 @@ void efsw_watch( efsw_watcher watcher ) {
 	( (efsw::FileWatcher*)watcher )->watch();
 }
 
+int efsw_get_fd( efsw_watcher watcher ) {
+	return ( (efsw::FileWatcher*)watcher )->getFileDescriptor();
+}
+
+void efsw_dispatch( efsw_watcher watcher ) {
+	( (efsw::FileWatcher*)watcher )->dispatch();
+}
+
 void efsw_follow_symlinks( efsw_watcher watcher, int enable ) {
 	( (efsw::FileWatcher*)watcher )->followSymlinks( TOBOOL( enable ) );
 }
@@ -0,0 +1,904 @@
+#include <efsw/FileWatcherFanotify.hpp>
+
+#if EFSW_PLATFORM == EFSW_PLATFORM_INOTIFY
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/capability.h>
+#include <mntent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/fanotify.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <efsw/Debug.hpp>
+#include <efsw/FileInfo.hpp>
+#include <efsw/FileSystem.hpp>
+#include <efsw/FileWatcherInotify.hpp>
+#include <efsw/Lock.hpp>
+
+/// Only declared by recent kernel headers, the kernel tells if it supports them when marking
+#ifndef FAN_RENAME
+#define FAN_RENAME 0x10000000
+#endif
+
+#ifndef FAN_EVENT_INFO_TYPE_OLD_DFID_NAME
+#define FAN_EVENT_INFO_TYPE_OLD_DFID_NAME 10
+#define FAN_EVENT_INFO_TYPE_NEW_DFID_NAME 12
+#endif
+
+#define FANOTIFY_MARK_MASK \
+	( FAN_CREATE | FAN_DELETE | FAN_RENAME | FAN_MODIFY | FAN_CLOSE_WRITE | FAN_ONDIR )
+
+#define BUFF_SIZE ( 256 * 1024 )
+
+/// The directory paths resolved from file handles are forgotten past this many
+#define PATHS_CACHE_MAX 4096
+
+/// Keeps the ids apart from the inotify watch descriptors of the fallback
+#define FIRST_WATCH_ID ( 1 << 24 )
+
+namespace efsw {
+
+namespace {
+
+bool hasCapabilities() {
+	struct __user_cap_header_struct header;
+	struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3];
+
+	memset( &header, 0, sizeof( header ) );
+	header.version = _LINUX_CAPABILITY_VERSION_3;
+
+	if ( syscall( SYS_capget, &header, data ) != 0 ) {
+		return false;
+	}
+
+	/// Marking file systems, and opening the file handles of the events
+	Uint32 needed = ( 1u << CAP_SYS_ADMIN ) | ( 1u << CAP_DAC_READ_SEARCH );
+
+	return ( data[0].effective & needed ) == needed;
+}
+
+Uint64 fileSystemID( const int* fsid ) {
+	return ( (Uint64)(Uint32)fsid[0] << 32 ) | (Uint32)fsid[1];
+}
+
+const char* fileName( const fanotify_event_info_fid* info ) {
+	const struct file_handle* handle = (const struct file_handle*)info->handle;
+
+	return (const char*)handle->f_handle + handle->handle_bytes;
+}
+
+} // namespace
+
+FileWatcherFanotify::FileWatcherFanotify( FileWatcher* parent ) :
+	FileWatcherImpl( parent ),
+	mFD( -1 ),
+	mEpollFD( -1 ),
+	mEventFD( -1 ),
+	mThread( NULL ),
+	mBuffer( NULL ),
+	mLastWatchID( FIRST_WATCH_ID ),
+	mFallback( NULL ) {
+	if ( !hasCapabilities() ) {
+		efDEBUG( "fanotify needs CAP_SYS_ADMIN and CAP_DAC_READ_SEARCH\n" );
+		return;
+	}
+
+	/// The default queue size bounds the kernel memory, the marks see every write of the file
+	/// systems and a threadless host may not read them for a while. Overflows are reported.
+	mFD = fanotify_init( FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK | FAN_REPORT_DFID_NAME,
+						 O_RDONLY | O_CLOEXEC | O_LARGEFILE );
+
+	if ( mFD < 0 ) {
+		efDEBUG( "Error: %s\n", strerror( errno ) );
+		return;
+	}
+
+	mEpollFD = epoll_create1( EPOLL_CLOEXEC );
+	mEventFD = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+	if ( mEpollFD < 0 || mEventFD < 0 ) {
+		efDEBUG( "Error: %s\n", strerror( errno ) );
+		return;
+	}
+
+	int fds[] = { mFD, mEventFD };
+
+	for ( size_t i = 0; i < sizeof( fds ) / sizeof( fds[0] ); ++i ) {
+		struct epoll_event ev;
+		memset( &ev, 0, sizeof( ev ) );
+		ev.events = EPOLLIN;
+		ev.data.fd = fds[i];
+
+		if ( epoll_ctl( mEpollFD, EPOLL_CTL_ADD, fds[i], &ev ) < 0 ) {
+			efDEBUG( "Error: %s\n", strerror( errno ) );
+			return;
+		}
+	}
+
+	mInitOK = true;
+}
+
+FileWatcherFanotify::~FileWatcherFanotify() {
+	mInitOK = false;
+
+	/// The thread sees mInitOK once woken up, and must not wait for mInitLock while joined
+	wakeup();
+
+	efSAFE_DELETE( mThread );
+
+	Lock initLock( mInitLock );
+
+	efSAFE_DELETE( mFallback );
+
+	Lock l( mWatchesLock );
+
+	for ( WatchMap::iterator it = mWatches.begin(); it != mWatches.end(); ++it ) {
+		efSAFE_DELETE( it->second );
+	}
+
+	mWatches.clear();
+
+	for ( size_t i = 0; i < mRetiredWatches.size(); ++i ) {
+		efSAFE_DELETE( mRetiredWatches[i] );
+	}
+
+	mRetiredWatches.clear();
+
+	/// Closing the fanotify descriptor removes the marks
+	mMarks.clear();
+
+	delete[] mBuffer;
+	mBuffer = NULL;
+
+	int* fds[] = { &mFD, &mEpollFD, &mEventFD };
+
+	for ( size_t i = 0; i < sizeof( fds ) / sizeof( fds[0] ); ++i ) {
+		if ( *fds[i] != -1 ) {
+			close( *fds[i] );
+			*fds[i] = -1;
+		}
+	}
+}
+
+WatchID FileWatcherFanotify::addWatch( const std::string& directory, FileWatchListener* watcher,
+									   bool recursive ) {
+	return addFilteredWatch( directory, watcher, recursive, WatchFilter() );
+}
+
+WatchID FileWatcherFanotify::addFilteredWatch( const std::string& directory,
+											   FileWatchListener* watcher, bool recursive,
+											   const WatchFilter& filter ) {
+	if ( !mInitOK )
+		return Errors::Log::createLastError( Errors::Unspecified, directory );
+	Lock initLock( mInitLock );
+
+	std::string dir( directory );
+
+	FileSystem::dirAddSlashAtEnd( dir );
+
+	FileInfo fi( dir );
+
+	if ( !fi.isDirectory() ) {
+		return Errors::Log::createLastError( Errors::FileNotFound, dir );
+	} else if ( !fi.isReadable() ) {
+		return Errors::Log::createLastError( Errors::FileNotReadable, dir );
+	}
+
+	/// The events report the real paths of the directories
+	char* realPath = realpath( dir.c_str(), NULL );
+
+	if ( NULL == realPath ) {
+		return Errors::Log::createLastError( Errors::FileNotFound, dir );
+	}
+
+	std::string path( realPath );
+	free( realPath );
+	FileSystem::dirAddSlashAtEnd( path );
+
+	if ( pathInWatches( path ) ) {
+		return Errors::Log::createLastError( Errors::FileRepeated, directory );
+	}
+
+	/// Symbolic links can take the tree anywhere, it isn't bounded by its path anymore
+	if ( recursive && mFileWatcher->followSymlinks() ) {
+		return fallback()->addFilteredWatch( directory, watcher, recursive, filter );
+	}
+
+	Uint64 fileSystem;
+
+	if ( !addMark( path, fileSystem ) ) {
+		return fallback()->addFilteredWatch( directory, watcher, recursive, filter );
+	}
+
+	WatcherFanotify* watch = new WatcherFanotify( ++mLastWatchID, path, watcher, recursive );
+	watch->FileSystems.push_back( fileSystem );
+
+	if ( !filter.Include.empty() || !filter.Exclude.empty() ) {
+		watch->Filter = std::make_shared<FileNameFilter>( filter );
+	}
+
+	if ( recursive ) {
+		addMountMarks( watch );
+	}
+
+	Lock lock( mWatchesLock );
+	mWatches.insert( std::make_pair( watch->ID, watch ) );
+
+	return watch->ID;
+}
+
+bool FileWatcherFanotify::addMark( const std::string& directory, Uint64& fileSystem ) {
+	int fd = open( directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+
+	if ( fd < 0 ) {
+		return false;
+	}
+
+	struct statfs st;
+
+	if ( fstatfs( fd, &st ) != 0 ) {
+		close( fd );
+		return false;
+	}
+
+	fileSystem = fileSystemID( (const int*)&st.f_fsid );
+
+	std::map<Uint64, Mark>::iterator it = mMarks.find( fileSystem );
+
+	if ( it != mMarks.end() ) {
+		it->second.Watches++;
+		close( fd );
+		return true;
+	}
+
+	int result = fanotify_mark( mFD, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, FANOTIFY_MARK_MASK, fd,
+								NULL );
+	close( fd );
+
+	if ( result != 0 ) {
+		efDEBUG( "Error marking the file system of %s: %s\n", directory.c_str(),
+				 strerror( errno ) );
+		return false;
+	}
+
+	Mark mark;
+	mark.Directory = directory;
+	mark.Watches = 1;
+	mMarks.insert( std::make_pair( fileSystem, mark ) );
+
+	return true;
+}
+
+int FileWatcherFanotify::openFileSystem( Uint64 fileSystem, const Mark& mark ) {
+	std::vector<const std::string*> candidates( 1, &mark.Directory );
+
+	{
+		/// The directory of the mark may have been removed, the watches on the file system are
+		/// other candidates
+		Lock lock( mWatchesLock );
+
+		for ( WatchMap::iterator it = mWatches.begin(); it != mWatches.end(); ++it ) {
+			if ( it->second->Directory != mark.Directory ) {
+				candidates.push_back( &it->second->Directory );
+			}
+		}
+	}
+
+	for ( size_t i = 0; i < candidates.size(); ++i ) {
+		int fd = open( candidates[i]->c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+
+		if ( fd < 0 ) {
+			continue;
+		}
+
+		struct statfs st;
+
+		/// Once unmounted, the path leads to the file system below
+		if ( fstatfs( fd, &st ) == 0 && fileSystemID( (const int*)&st.f_fsid ) == fileSystem ) {
+			return fd;
+		}
+
+		close( fd );
+	}
+
+	return -1;
+}
+
+void FileWatcherFanotify::removeMark( Uint64 fileSystem ) {
+	std::map<Uint64, Mark>::iterator it = mMarks.find( fileSystem );
+
+	if ( it == mMarks.end() || --it->second.Watches > 0 ) {
+		return;
+	}
+
+	/// An unmounted file system took its mark along
+	int fd = openFileSystem( fileSystem, it->second );
+
+	if ( fd >= 0 ) {
+		if ( fanotify_mark( mFD, FAN_MARK_REMOVE | FAN_MARK_FILESYSTEM, FANOTIFY_MARK_MASK, fd,
+							NULL ) != 0 ) {
+			efDEBUG( "Error removing a file system mark: %s\n", strerror( errno ) );
+		}
+
+		close( fd );
+	}
+
+	mMarks.erase( it );
+}
+
+void FileWatcherFanotify::addMountMarks( WatcherFanotify* watch ) {
+	FILE* mounts = setmntent( "/proc/self/mounts", "r" );
+
+	if ( NULL == mounts ) {
+		return;
+	}
+
+	struct mntent* entry;
+
+	while ( NULL != ( entry = getmntent( mounts ) ) ) {
+		std::string mountPoint( entry->mnt_dir );
+		FileSystem::dirAddSlashAtEnd( mountPoint );
+
+		if ( mountPoint.size() <= watch->Directory.size() ||
+			 0 != mountPoint.compare( 0, watch->Directory.size(), watch->Directory ) ) {
+			continue;
+		}
+
+		/// Like inotify, the trees don't extend into remote file systems
+		Uint64 fileSystem;
+
+		if ( !FileSystem::isRemoteFS( mountPoint ) && addMark( mountPoint, fileSystem ) ) {
+			watch->FileSystems.push_back( fileSystem );
+		}
+	}
+
+	endmntent( mounts );
+}
+
+void FileWatcherFanotify::removeWatchLocked( WatcherFanotify* watch ) {
+	mWatches.erase( watch->ID );
+
+	for ( size_t i = 0; i < watch->FileSystems.size(); ++i ) {
+		removeMark( watch->FileSystems[i] );
+	}
+
+	/// The events being delivered may still point to it
+	mRetiredWatches.push_back( watch );
+}
+
+void FileWatcherFanotify::removeWatch( const std::string& directory ) {
+	if ( !mInitOK )
+		return;
+	Lock initLock( mInitLock );
+
+	std::string dir( directory );
+
+	/// The watches keep the real paths
+	char* realPath = realpath( directory.c_str(), NULL );
+
+	if ( NULL != realPath ) {
+		dir = realPath;
+		free( realPath );
+	}
+
+	FileSystem::dirAddSlashAtEnd( dir );
+
+	{
+		Lock lock( mWatchesLock );
+
+		for ( WatchMap::iterator it = mWatches.begin(); it != mWatches.end(); ++it ) {
+			if ( it->second->Directory == dir ) {
+				removeWatchLocked( it->second );
+				return;
+			}
+		}
+	}
+
+	if ( NULL != mFallback ) {
+		mFallback->removeWatch( directory );
+	}
+}
+
+void FileWatcherFanotify::removeWatch( WatchID watchid ) {
+	if ( !mInitOK )
+		return;
+	Lock initLock( mInitLock );
+
+	{
+		Lock lock( mWatchesLock );
+		WatchMap::iterator it = mWatches.find( watchid );
+
+		if ( it != mWatches.end() ) {
+			removeWatchLocked( it->second );
+			return;
+		}
+	}
+
+	if ( NULL != mFallback ) {
+		mFallback->removeWatch( watchid );
+	}
+}
+
+FileWatcherImpl* FileWatcherFanotify::fallback() {
+	if ( NULL == mFallback ) {
+		mFallback = new FileWatcherInotify( mFileWatcher );
+
+		if ( NULL != mThread ) {
+			mFallback->watch();
+		} else if ( mFallback->getFileDescriptor() != -1 ) {
+			/// Threadless, the host waits on our descriptor for both
+			struct epoll_event ev;
+			memset( &ev, 0, sizeof( ev ) );
+			ev.events = EPOLLIN;
+			ev.data.fd = mFallback->getFileDescriptor();
+
+			if ( epoll_ctl( mEpollFD, EPOLL_CTL_ADD, ev.data.fd, &ev ) < 0 ) {
+				efDEBUG( "Error: %s\n", strerror( errno ) );
+			}
+		}
+	}
+
+	return mFallback;
+}
+
+void FileWatcherFanotify::watch() {
+	Lock initLock( mInitLock );
+
+	if ( NULL == mThread ) {
+		if ( NULL != mFallback ) {
+			/// Its own thread handles its events from now on
+			if ( mFallback->getFileDescriptor() != -1 ) {
+				epoll_ctl( mEpollFD, EPOLL_CTL_DEL, mFallback->getFileDescriptor(), NULL );
+			}
+
+			mFallback->watch();
+		}
+
+		mThread = new Thread( &FileWatcherFanotify::run, this );
+		mThread->launch();
+	}
+}
+
+void FileWatcherFanotify::wakeup() {
+	if ( mEventFD == -1 )
+		return;
+
+	uint64_t value = 1;
+
+	if ( write( mEventFD, &value, sizeof( value ) ) < 0 && errno != EAGAIN ) {
+		efDEBUG( "Error waking up the watcher thread: %s\n", strerror( errno ) );
+	}
+}
+
+void FileWatcherFanotify::run() {
+	do {
+		processEvents( -1 );
+	} while ( mInitOK );
+}
+
+int FileWatcherFanotify::getFileDescriptor() {
+	return mInitOK ? mEpollFD : -1;
+}
+
+void FileWatcherFanotify::dispatch() {
+	/// Events are already delivered by the thread once watch() was called
+	if ( NULL != mThread || !mInitOK )
+		return;
+
+	/// Drain everything, a host waiting edge triggered on the descriptor wouldn't wake up again
+	while ( mInitOK && processEvents( 0 ) ) {
+	}
+}
+
+bool FileWatcherFanotify::processEvents( int timeoutMs ) {
+	if ( NULL == mBuffer ) {
+		mBuffer = new char[BUFF_SIZE];
+	}
+
+	struct epoll_event events[3];
+	int count = epoll_wait( mEpollFD, events, 3, timeoutMs );
+
+	if ( count < 0 ) {
+		if ( errno != EINTR ) {
+			efDEBUG( "Error: %s\n", strerror( errno ) );
+		}
+
+		return false;
+	}
+
+	bool fanotifyReady = false;
+	bool fallbackReady = false;
+
+	for ( int e = 0; e < count; ++e ) {
+		if ( events[e].data.fd == mFD ) {
+			fanotifyReady = true;
+		} else if ( events[e].data.fd == mEventFD ) {
+			uint64_t value;
+
+			/// Reset the counter, the caller checks mInitOK
+			if ( read( mEventFD, &value, sizeof( value ) ) < 0 && errno != EAGAIN ) {
+				efDEBUG( "Error: %s\n", strerror( errno ) );
+			}
+		} else {
+			fallbackReady = true;
+		}
+	}
+
+	if ( fallbackReady && NULL != mFallback ) {
+		mFallback->dispatch();
+	}
+
+	if ( fanotifyReady ) {
+		efTRACE_SCOPE( "FileWatcherFanotify::readEvents" );
+		ssize_t len = read( mFD, mBuffer, BUFF_SIZE );
+
+		if ( len > 0 ) {
+			Lock initLock( mInitLock );
+			const fanotify_event_metadata* event = (const fanotify_event_metadata*)mBuffer;
+
+			while ( mInitOK && FAN_EVENT_OK( event, len ) ) {
+				if ( event->vers == FANOTIFY_METADATA_VERSION ) {
+					handleEvent( event );
+				}
+
+				event = FAN_EVENT_NEXT( event, len );
+			}
+
+			flushBatch();
+		}
+
+		deleteRetiredWatches();
+	}
+
+	return count > 0;
+}
+
+void FileWatcherFanotify::handleEvent( const fanotify_event_metadata* event ) {
+	if ( event->fd >= 0 ) {
+		close( event->fd );
+	}
+
+	if ( event->mask & FAN_Q_OVERFLOW ) {
+		reportMissedEvents();
+		return;
+	}
+
+	const fanotify_event_info_fid* dirInfo = NULL;
+	const fanotify_event_info_fid* oldInfo = NULL;
+	const fanotify_event_info_fid* newInfo = NULL;
+	const char* record = (const char*)event + event->metadata_len;
+	const char* end = (const char*)event + event->event_len;
+
+	while ( record + sizeof( fanotify_event_info_header ) <= end ) {
+		const fanotify_event_info_header* header = (const fanotify_event_info_header*)record;
+
+		if ( 0 == header->len || record + header->len > end ) {
+			break;
+		}
+
+		const fanotify_event_info_fid* info = (const fanotify_event_info_fid*)record;
+
+		switch ( header->info_type ) {
+			case FAN_EVENT_INFO_TYPE_DFID_NAME:
+				dirInfo = info;
+				break;
+			case FAN_EVENT_INFO_TYPE_OLD_DFID_NAME:
+				oldInfo = info;
+				break;
+			case FAN_EVENT_INFO_TYPE_NEW_DFID_NAME:
+				newInfo = info;
+				break;
+		}
+
+		record += header->len;
+	}
+
+	bool isDirectory = ( event->mask & FAN_ONDIR ) != 0;
+
+	if ( event->mask & FAN_RENAME ) {
+		/// The paths cached below the directory changed
+		if ( isDirectory ) {
+			mPaths.clear();
+		}
+
+		bool hasOld = NULL != oldInfo && directoryPath( oldInfo, mOldDirectory );
+		bool hasNew = NULL != newInfo && directoryPath( newInfo, mDirectory );
+
+		if ( hasOld && hasNew && mOldDirectory == mDirectory ) {
+			notify( mDirectory, fileName( newInfo ), Actions::Moved, fileName( oldInfo ) );
+		} else {
+			/// Moved between directories, reported like inotify does
+			if ( hasOld ) {
+				notify( mOldDirectory, fileName( oldInfo ), Actions::Delete );
+			}
+
+			if ( hasNew ) {
+				notify( mDirectory, fileName( newInfo ), Actions::Add );
+				notify( mDirectory, fileName( newInfo ), Actions::Modified );
+			}
+		}
+
+		return;
+	}
+
+	if ( NULL == dirInfo || !directoryPath( dirInfo, mDirectory ) ) {
+		return;
+	}
+
+	const char* name = fileName( dirInfo );
+
+	/// Events on the same file may be merged into one, report them in the likely order
+	if ( event->mask & FAN_CREATE ) {
+		notify( mDirectory, name, Actions::Add );
+	}
+
+	if ( event->mask & ( FAN_MODIFY | FAN_CLOSE_WRITE ) ) {
+		notify( mDirectory, name, Actions::Modified );
+	}
+
+	if ( event->mask & FAN_DELETE ) {
+		notify( mDirectory, name, Actions::Delete );
+
+		if ( isDirectory ) {
+			mPaths.clear();
+		}
+	}
+}
+
+bool FileWatcherFanotify::directoryPath( const fanotify_event_info_fid* info, std::string& path ) {
+	const struct file_handle* handle = (const struct file_handle*)info->handle;
+	Uint64 fileSystem = fileSystemID( (const int*)&info->fsid );
+
+	mPathKey.assign( (const char*)&fileSystem, sizeof( fileSystem ) );
+	mPathKey.append( (const char*)&handle->handle_type, sizeof( handle->handle_type ) );
+	mPathKey.append( (const char*)handle->f_handle, handle->handle_bytes );
+
+	std::unordered_map<std::string, std::string>::iterator it = mPaths.find( mPathKey );
+
+	if ( it != mPaths.end() ) {
+		path = it->second;
+		return true;
+	}
+
+	std::map<Uint64, Mark>::iterator mark = mMarks.find( fileSystem );
+
+	if ( mark == mMarks.end() ) {
+		return false;
+	}
+
+	/// Only on cache misses, the directories of a burst of events are usually the same
+	int mountFD = openFileSystem( fileSystem, mark->second );
+
+	if ( mountFD < 0 ) {
+		return false;
+	}
+
+	int fd = open_by_handle_at( mountFD, (struct file_handle*)handle, O_PATH | O_CLOEXEC );
+	close( mountFD );
+
+	if ( fd < 0 ) {
+		return false;
+	}
+
+	char link[32];
+	char buffer[PATH_MAX];
+	snprintf( link, sizeof( link ), "/proc/self/fd/%d", fd );
+	ssize_t len = readlink( link, buffer, sizeof( buffer ) );
+	close( fd );
+
+	if ( len <= 0 || len == (ssize_t)sizeof( buffer ) ) {
+		return false;
+	}
+
+	static const char deleted[] = " (deleted)";
+	static const size_t deletedLength = sizeof( deleted ) - 1;
+
+	/// Removed while something still holds it
+	if ( (size_t)len > deletedLength &&
+		 0 == memcmp( buffer + len - deletedLength, deleted, deletedLength ) ) {
+		return false;
+	}
+
+	path.assign( buffer, len );
+	FileSystem::dirAddSlashAtEnd( path );
+
+	if ( mPaths.size() >= PATHS_CACHE_MAX ) {
+		mPaths.clear();
+	}
+
+	mPaths.insert( std::make_pair( mPathKey, path ) );
+
+	return true;
+}
+
+void FileWatcherFanotify::notify( const std::string& directory, const char* filename,
+								  Action action, const char* oldFilename ) {
+	Lock lock( mWatchesLock );
+
+	for ( WatchMap::iterator it = mWatches.begin(); it != mWatches.end(); ++it ) {
+		WatcherFanotify* watch = it->second;
+
+		if ( !watch->inScope( directory ) ) {
+			continue;
+		}
+
+		if ( NULL == watch->Filter ) {
+			report( watch, directory, filename, action, oldFilename );
+		} else if ( Actions::Moved == action ) {
+			bool newReported = watch->Filter->reports( filename );
+			bool oldReported = watch->Filter->reports( oldFilename );
+
+			/// Renamed across the filter, reported like a move between directories
+			if ( newReported && oldReported ) {
+				report( watch, directory, filename, action, oldFilename );
+			} else if ( newReported ) {
+				report( watch, directory, filename, Actions::Add );
+				report( watch, directory, filename, Actions::Modified );
+			} else if ( oldReported ) {
+				report( watch, directory, oldFilename, Actions::Delete );
+			}
+		} else if ( watch->Filter->reports( filename ) ) {
+			report( watch, directory, filename, action, oldFilename );
+		}
+	}
+}
+
+void FileWatcherFanotify::report( WatcherFanotify* watch, const std::string& directory,
+								  const char* filename, Action action, const char* oldFilename ) {
+	if ( NULL != watch->BatchListener ) {
+		BatchEvent event;
+		event.Listener = watch->BatchListener;
+		event.ID = watch->ID;
+		event.Type = action;
+
+		if ( mBatchDirectories.empty() || mBatchDirectories.back() != directory ) {
+			mBatchDirectories.push_back( directory );
+		}
+
+		event.Directory = mBatchDirectories.size() - 1;
+
+		event.Filename = mBatchNames.size();
+		mBatchNames.insert( mBatchNames.end(), filename, filename + strlen( filename ) + 1 );
+
+		event.OldFilename = mBatchNames.size();
+		mBatchNames.insert( mBatchNames.end(), oldFilename,
+							oldFilename + strlen( oldFilename ) + 1 );
+
+		mBatch.push_back( event );
+	} else {
+		watch->Listener->handleFileAction( watch->ID, directory, filename, action, oldFilename );
+	}
+}
+
+void FileWatcherFanotify::flushBatch() {
+	if ( mBatch.empty() ) {
+		return;
+	}
+
+	efTRACE_SCOPE( "FileWatcherFanotify::flushBatch" );
+
+	/// Usually there is a single listener, deliver the events of each one in order
+	size_t first = 0;
+
+	while ( mInitOK && first < mBatch.size() ) {
+		FileWatchBatchListener* listener = mBatch[first].Listener;
+		size_t next = mBatch.size();
+
+		mBatchEvents.clear();
+
+		for ( size_t i = first; i < mBatch.size(); ++i ) {
+			BatchEvent& event = mBatch[i];
+
+			if ( event.Listener == listener ) {
+				FileEvent fileEvent;
+				fileEvent.ID = event.ID;
+				fileEvent.Directory = &mBatchDirectories[event.Directory];
+				fileEvent.Filename = &mBatchNames[event.Filename];
+				fileEvent.OldFilename = &mBatchNames[event.OldFilename];
+				fileEvent.Type = event.Type;
+				mBatchEvents.push_back( fileEvent );
+
+				/// Mark as delivered
+				event.Listener = NULL;
+			} else if ( NULL != event.Listener && next == mBatch.size() ) {
+				next = i;
+			}
+		}
+
+		listener->handleFileActions( &mBatchEvents[0], mBatchEvents.size() );
+
+		first = next;
+	}
+
+	mBatch.clear();
+	mBatchDirectories.clear();
+	mBatchNames.clear();
+}
+
+void FileWatcherFanotify::reportMissedEvents() {
+	efDEBUG( "fanotify queue overflow, events were lost\n" );
+
+	/// The events read before the overflow come first
+	flushBatch();
+
+	/// Nothing tells which directories changed, every watch has to be rescanned
+	std::vector<WatcherFanotify*> watches;
+
+	{
+		Lock lock( mWatchesLock );
+
+		for ( WatchMap::iterator it = mWatches.begin(); it != mWatches.end(); ++it ) {
+			watches.push_back( it->second );
+		}
+	}
+
+	for ( size_t i = 0; mInitOK && i < watches.size(); ++i ) {
+		{
+			Lock lock( mWatchesLock );
+			WatchMap::iterator found = mWatches.find( watches[i]->ID );
+
+			/// Removed by a listener meanwhile, it stays alive until the read is done
+			if ( found == mWatches.end() || found->second != watches[i] ) {
+				continue;
+			}
+		}
+
+		watches[i]->Listener->handleMissedFileActions( watches[i]->ID, watches[i]->Directory );
+	}
+}
+
+void FileWatcherFanotify::deleteRetiredWatches() {
+	Lock lock( mWatchesLock );
+
+	for ( size_t i = 0; i < mRetiredWatches.size(); ++i ) {
+		efSAFE_DELETE( mRetiredWatches[i] );
+	}
+
+	mRetiredWatches.clear();
+}
+
+void FileWatcherFanotify::handleAction( Watcher*, const std::string&, unsigned long,
+										std::string ) {}
+
+std::list<std::string> FileWatcherFanotify::directories() {
+	std::list<std::string> dirs;
+
+	{
+		Lock l( mWatchesLock );
+
+		for ( WatchMap::iterator it = mWatches.begin(); it != mWatches.end(); ++it ) {
+			dirs.push_back( it->second->Directory );
+		}
+	}
+
+	if ( NULL != mFallback ) {
+		std::list<std::string> fallbackDirs( mFallback->directories() );
+		dirs.splice( dirs.end(), fallbackDirs );
+	}
+
+	return dirs;
+}
+
+bool FileWatcherFanotify::pathInWatches( const std::string& path ) {
+	Lock l( mWatchesLock );
+
+	for ( WatchMap::iterator it = mWatches.begin(); it != mWatches.end(); ++it ) {
+		if ( it->second->Directory == path ) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+} // namespace efsw
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef EFSW_FILEWATCHERFANOTIFY_HPP
+#define EFSW_FILEWATCHERFANOTIFY_HPP
+
+#include <efsw/FileWatcherImpl.hpp>
+
+#if EFSW_PLATFORM == EFSW_PLATFORM_INOTIFY
+
+#include <efsw/WatcherFanotify.hpp>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+struct fanotify_event_metadata;
+struct fanotify_event_info_fid;
+
+namespace efsw {
+
+/// Implementation for Linux based on fanotify, used when the process may mark whole file
+/// systems (CAP_SYS_ADMIN, and CAP_DAC_READ_SEARCH to resolve the file handles). A single mark
+/// per file system reports the changes in every directory on it, so the kernel resources don't
+/// grow with the watched trees. The events outside of the watches are dropped in user space.
+/// Watches that can't be served this way (file systems that can't be marked, kernels without
+/// FAN_RENAME, recursive watches following symlinks) are left to inotify.
+/// @class FileWatcherFanotify
+class FileWatcherFanotify : public FileWatcherImpl {
+  public:
+	typedef std::map<WatchID, WatcherFanotify*> WatchMap;
+
+	FileWatcherFanotify( FileWatcher* parent );
+
+	virtual ~FileWatcherFanotify();
+
+	/// Add a directory watch
+	/// On error returns WatchID with Error type.
+	WatchID addWatch( const std::string& directory, FileWatchListener* watcher, bool recursive );
+
+	/// Add a directory watch reporting only the events selected by the filter
+	/// On error returns WatchID with Error type.
+	WatchID addFilteredWatch( const std::string& directory, FileWatchListener* watcher,
+							  bool recursive, const WatchFilter& filter );
+
+	/// Remove a directory watch. This is a brute force lazy search O(nlogn).
+	void removeWatch( const std::string& directory );
+
+	/// Remove a directory watch. This is a map lookup O(logn).
+	void removeWatch( WatchID watchid );
+
+	/// Updates the watcher. Must be called often.
+	void watch();
+
+	/// @return The epoll file descriptor, readable when dispatch() has work to do
+	int getFileDescriptor();
+
+	/// Handles the pending events without blocking, if watch() wasn't called
+	void dispatch();
+
+	/// Not used, the events are reported as they are read
+	void handleAction( Watcher* watch, const std::string& filename, unsigned long action,
+					   std::string oldFilename = "" );
+
+	/// @return Returns a list of the directories that are being watched
+	std::list<std::string> directories();
+
+  protected:
+	/// The mark of a file system, shared by the watches on it
+	struct Mark {
+		/// The directory the file system was marked through. Only opened while needed, an open
+		/// descriptor would keep the file system from being unmounted.
+		std::string Directory;
+		int Watches;
+	};
+
+	WatchMap mWatches;
+
+	/// Marks by file system id
+	std::map<Uint64, Mark> mMarks;
+
+	/// Paths of the directories by file system id and file handle, filled as events arrive
+	std::unordered_map<std::string, std::string> mPaths;
+
+	/// Key of the last mPaths lookup, reused between the events
+	std::string mPathKey;
+
+	/// Directories of the event being handled, reused between the events
+	std::string mDirectory;
+	std::string mOldDirectory;
+
+	/// An event for a batch listener, delivered at the end of processEvents()
+	struct BatchEvent {
+		FileWatchBatchListener* Listener;
+		WatchID ID;
+		/// Index in mBatchDirectories
+		size_t Directory;
+		/// Offsets of the names in mBatchNames
+		size_t Filename;
+		size_t OldFilename;
+		Action Type;
+	};
+
+	std::vector<BatchEvent> mBatch;
+
+	/// The directories of mBatch, consecutive events share theirs
+	std::vector<std::string> mBatchDirectories;
+
+	/// The file names of mBatch, NUL terminated. Reused between reads.
+	std::vector<char> mBatchNames;
+
+	std::vector<FileEvent> mBatchEvents;
+
+	/// fanotify file descriptor
+	int mFD;
+
+	/// epoll instance waiting on mFD, mEventFD and the descriptor of mFallback
+	int mEpollFD;
+
+	/// Signaled to wake up the thread, e.g. to shut it down
+	int mEventFD;
+
+	Thread* mThread;
+
+	/// Buffer for read(), allocated on first use
+	char* mBuffer;
+
+	WatchID mLastWatchID;
+
+	/// Inotify, watching the directories that can't be marked. Created on first use.
+	FileWatcherImpl* mFallback;
+
+	/// Removed watches, kept alive until processEvents() is done with them.
+	/// Protected by mWatchesLock.
+	std::vector<WatcherFanotify*> mRetiredWatches;
+
+	Mutex mWatchesLock;
+	Mutex mInitLock;
+
+	bool pathInWatches( const std::string& path );
+
+  private:
+	void run();
+
+	/// Waits up to timeoutMs (-1 for no limit) and handles the events that arrived
+	/// @return false if the wait timed out
+	bool processEvents( int timeoutMs );
+
+	void handleEvent( const fanotify_event_metadata* event );
+
+	/// Resolves the directory of a file handle from an event, with a slash at the end
+	/// @return false if the directory doesn't exist anymore
+	bool directoryPath( const fanotify_event_info_fid* info, std::string& path );
+
+	/// Reports the event to every watch the directory belongs to
+	void notify( const std::string& directory, const char* filename, Action action,
+				 const char* oldFilename = "" );
+
+	/// Reports the event to the listener of the watch, or queues it if it handles batches
+	void report( WatcherFanotify* watch, const std::string& directory, const char* filename,
+				 Action action, const char* oldFilename = "" );
+
+	/// Delivers the queued events, one call per batch listener
+	void flushBatch();
+
+	/// Tells the listener of every watch that events were lost
+	void reportMissedEvents();
+
+	/// Marks the file system of the directory, or takes a reference to its mark
+	/// @return false if it can't be marked
+	bool addMark( const std::string& directory, Uint64& fileSystem );
+
+	/// Opens a directory of the file system, for open_by_handle_at and removing the mark
+	/// @return -1 if no known directory is on the file system anymore, e.g. it was unmounted
+	int openFileSystem( Uint64 fileSystem, const Mark& mark );
+
+	/// Drops a reference to the mark, removing it with the last one
+	void removeMark( Uint64 fileSystem );
+
+	/// Marks the local file systems mounted below a recursive watch
+	void addMountMarks( WatcherFanotify* watch );
+
+	void deleteRetiredWatches();
+
+	/// Interrupts the epoll_wait of the thread
+	void wakeup();
+
+	FileWatcherImpl* fallback();
+
+	/// Must be called with mWatchesLock locked
+	void removeWatchLocked( WatcherFanotify* watch );
+};
+
+} // namespace efsw
+
+#endif
+
+#endif
@@ -1,7 +1,22 @@
+#include <efsw/DirWatcherGeneric.hpp>
 #include <efsw/FileSystem.hpp>
 #include <efsw/FileWatcherGeneric.hpp>
 #include <efsw/Lock.hpp>
 #include <efsw/System.hpp>
+#include <efsw/Thread.hpp>
+#include <algorithm>
+#include <chrono>
+
+/// The poll interval starts at the minimum, doubles after every scan without changes up to the
+/// maximum, and drops back to the minimum on a change
+#define POLL_INTERVAL_MIN_MS 500
+#define POLL_INTERVAL_MAX_MS 4000
+
+/// Keeps the watcher thread busy at most 1 / POLL_SCAN_COST_FACTOR of the time on large trees
+#define POLL_SCAN_COST_FACTOR 4
+
+/// Sleeps are split in slices of this length, to notice the destruction of the watcher
+#define POLL_SLEEP_SLICE_MS 100
 
 namespace efsw {
 
@@ -106,20 +121,57 @@ void FileWatcherGeneric::watch() {
 	}
 }
 
+void FileWatcherGeneric::dispatch() {
+	if ( NULL != mThread )
+		return;
+
+	scan();
+}
+
+bool FileWatcherGeneric::scan() {
+	Lock lock( mWatchesLock );
+
+	/// Stat the directories of every watch at once, so the work can be spread over threads
+	std::vector<DirectorySnapshot*> snapshots;
+	WatchList::iterator it = mWatches.begin();
+
+	for ( ; it != mWatches.end(); ++it ) {
+		( *it )->collectSnapshots( snapshots );
+	}
+
+	DirectorySnapshot::prefetch( snapshots );
+
+	bool changed = false;
+
+	for ( it = mWatches.begin(); it != mWatches.end(); ++it ) {
+		if ( ( *it )->DirWatch->watch() ) {
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
 void FileWatcherGeneric::run() {
-	do {
-		{
-			Lock lock( mWatchesLock );
+	unsigned long interval = POLL_INTERVAL_MIN_MS;
 
-			WatchList::iterator it = mWatches.begin();
+	do {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-			for ( ; it != mWatches.end(); ++it ) {
-				( *it )->watch();
-			}
+		if ( scan() ) {
+			interval = POLL_INTERVAL_MIN_MS;
+		} else {
+			interval = std::min<unsigned long>( interval * 2, POLL_INTERVAL_MAX_MS );
 		}
 
-		if ( mInitOK )
-			System::sleep( 1000 );
+		unsigned long cost = (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+								 std::chrono::steady_clock::now() - start )
+								 .count();
+		unsigned long wait = std::max<unsigned long>( interval, cost * POLL_SCAN_COST_FACTOR );
+
+		for ( unsigned long slept = 0; slept < wait && mInitOK; slept += POLL_SLEEP_SLICE_MS ) {
+			System::sleep( POLL_SLEEP_SLICE_MS );
+		}
 	} while ( mInitOK );
 }
 
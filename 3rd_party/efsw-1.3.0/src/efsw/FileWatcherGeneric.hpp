@@ -31,6 +31,9 @@ class FileWatcherGeneric : public FileWatcherImpl {
 	/// Updates the watcher. Must be called often.
 	void watch();
 
+	/// Scans the watched directories once, if watch() wasn't called
+	void dispatch();
+
 	/// Handles the action
 	void handleAction( Watcher* watch, const std::string& filename, unsigned long action,
 					   std::string oldFilename = "" );
@@ -53,6 +56,9 @@ class FileWatcherGeneric : public FileWatcherImpl {
 
   private:
 	void run();
+
+	/// @return If any event was reported
+	bool scan();
 };
 
 } // namespace efsw
@@ -15,6 +15,20 @@ bool FileWatcherImpl::initOK() {
 	return static_cast<bool>( mInitOK );
 }
 
+WatchID FileWatcherImpl::addFilteredWatch( const std::string& directory,
+										   FileWatchListener* watcher, bool recursive,
+										   const WatchFilter& ) {
+	return addWatch( directory, watcher, recursive );
+}
+
+int FileWatcherImpl::getFileDescriptor() {
+	return -1;
+}
+
+void FileWatcherImpl::dispatch() {
+	watch();
+}
+
 bool FileWatcherImpl::linkAllowed( const std::string& curPath, const std::string& link ) {
 	return ( mFileWatcher->followSymlinks() && mFileWatcher->allowOutOfScopeLinks() ) ||
 		   -1 != String::strStartsWith( curPath, link );
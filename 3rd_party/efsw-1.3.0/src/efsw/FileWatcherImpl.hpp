@@ -21,6 +21,11 @@ class FileWatcherImpl {
 	virtual WatchID addWatch( const std::string& directory, FileWatchListener* watcher,
 							  bool recursive ) = 0;
 
+	/// Add a directory watch reporting only the events selected by the filter.
+	/// Backends without filters ignore it.
+	virtual WatchID addFilteredWatch( const std::string& directory, FileWatchListener* watcher,
+									  bool recursive, const WatchFilter& filter );
+
 	/// Remove a directory watch. This is a brute force lazy search O(nlogn).
 	virtual void removeWatch( const std::string& directory ) = 0;
 
@@ -30,6 +35,13 @@ class FileWatcherImpl {
 	/// Updates the watcher. Must be called often.
 	virtual void watch() = 0;
 
+	/// @return A descriptor that becomes readable when dispatch() has work, -1 if there is none
+	virtual int getFileDescriptor();
+
+	/// Delivers the pending events on the calling thread. Backends without a threadless mode
+	/// start their thread instead.
+	virtual void dispatch();
+
 	/// Handles the action
 	virtual void handleAction( Watcher* watch, const std::string& filename, unsigned long action,
 							   std::string oldFilename = "" ) = 0;
@@ -6,7 +6,10 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 
 #ifdef EFSW_INOTIFY_NOSYS
@@ -17,32 +20,79 @@
 
 #include <efsw/Debug.hpp>
 #include <efsw/FileSystem.hpp>
+#include <efsw/InotifyTreeWalker.hpp>
 #include <efsw/Lock.hpp>
 #include <efsw/String.hpp>
 #include <efsw/System.hpp>
 
 #define BUFF_SIZE ( ( sizeof( struct inotify_event ) + FILENAME_MAX ) * 1024 )
 
+/// Time to wait for the IN_MOVED_TO of a pending IN_MOVED_FROM before the file is considered
+/// moved outside the watches. Both events are queued together by the kernel, so the wait only
+/// matters when they end up in different reads.
+#define MOVE_PAIR_TIMEOUT_MS 10
+
+#define INOTIFY_WATCH_MASK \
+	( IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MOVED_FROM | IN_DELETE | IN_MODIFY )
+
 namespace efsw {
 
 FileWatcherInotify::FileWatcherInotify( FileWatcher* parent ) :
-	FileWatcherImpl( parent ), mFD( -1 ), mThread( NULL ) {
+	FileWatcherImpl( parent ),
+	mFD( -1 ),
+	mEpollFD( -1 ),
+	mEventFD( -1 ),
+	mTimerFD( -1 ),
+	mThread( NULL ),
+	mBuffer( NULL ),
+	mCurrentMoveFrom( NULL ),
+	mCurrentMoveCookie( -1 ),
+	mLastWasMovedFrom( false ),
+	mMoveTimerArmed( false ) {
 	mFD = inotify_init();
 
 	if ( mFD < 0 ) {
 		efDEBUG( "Error: %s\n", strerror( errno ) );
-	} else {
-		mInitOK = true;
+		return;
+	}
+
+	mEpollFD = epoll_create1( EPOLL_CLOEXEC );
+	mEventFD = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	mTimerFD = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+
+	if ( mEpollFD < 0 || mEventFD < 0 || mTimerFD < 0 ) {
+		efDEBUG( "Error: %s\n", strerror( errno ) );
+		return;
 	}
+
+	int fds[] = { mFD, mEventFD, mTimerFD };
+
+	for ( size_t i = 0; i < sizeof( fds ) / sizeof( fds[0] ); ++i ) {
+		struct epoll_event ev;
+		memset( &ev, 0, sizeof( ev ) );
+		ev.events = EPOLLIN;
+		ev.data.fd = fds[i];
+
+		if ( epoll_ctl( mEpollFD, EPOLL_CTL_ADD, fds[i], &ev ) < 0 ) {
+			efDEBUG( "Error: %s\n", strerror( errno ) );
+			return;
+		}
+	}
+
+	mInitOK = true;
 }
 
 FileWatcherInotify::~FileWatcherInotify() {
 	mInitOK = false;
 
-	Lock initLock( mInitLock );
+	/// Wake up the thread so it sees mInitOK right away instead of sleeping until the next event.
+	/// It must not wait for mInitLock while joined, flushBatch() takes it.
+	wakeup();
 
 	efSAFE_DELETE( mThread );
 
+	Lock initLock( mInitLock );
+
 	Lock l( mWatchesLock );
 	Lock l2( mRealWatchesLock );
 	WatchMap::iterator iter = mWatches.begin();
@@ -53,23 +103,56 @@ FileWatcherInotify::~FileWatcherInotify() {
 	}
 
 	mWatches.clear();
+	mWatchesByPath.clear();
+
+	for ( size_t i = 0; i < mRetiredWatches.size(); ++i ) {
+		efSAFE_DELETE( mRetiredWatches[i] );
+	}
+
+	mRetiredWatches.clear();
 
-	if ( mFD != -1 ) {
-		close( mFD );
-		mFD = -1;
+	delete[] mBuffer;
+	mBuffer = NULL;
+
+	int* fds[] = { &mFD, &mEpollFD, &mEventFD, &mTimerFD };
+
+	for ( size_t i = 0; i < sizeof( fds ) / sizeof( fds[0] ); ++i ) {
+		if ( *fds[i] != -1 ) {
+			close( *fds[i] );
+			*fds[i] = -1;
+		}
 	}
 }
 
 WatchID FileWatcherInotify::addWatch( const std::string& directory, FileWatchListener* watcher,
 									  bool recursive ) {
+	return addFilteredWatch( directory, watcher, recursive, WatchFilter() );
+}
+
+WatchID FileWatcherInotify::addFilteredWatch( const std::string& directory,
+											  FileWatchListener* watcher, bool recursive,
+											  const WatchFilter& filter ) {
 	if ( !mInitOK )
 		return Errors::Log::createLastError( Errors::Unspecified, directory );
 	Lock initLock( mInitLock );
-	return addWatch( directory, watcher, recursive, NULL );
+
+	std::shared_ptr<const FileNameFilter> compiled;
+
+	if ( !filter.Include.empty() || !filter.Exclude.empty() ) {
+		compiled = std::make_shared<FileNameFilter>( filter );
+	}
+
+	WatchID id = addWatch( directory, watcher, recursive, NULL, compiled );
+
+	/// Let the thread pick up the events queued while the tree was being registered
+	wakeup();
+
+	return id;
 }
 
 WatchID FileWatcherInotify::addWatch( const std::string& directory, FileWatchListener* watcher,
-									  bool recursive, WatcherInotify* parent ) {
+									  bool recursive, WatcherInotify* parent,
+									  const std::shared_ptr<const FileNameFilter>& filter ) {
 	std::string dir( directory );
 
 	FileSystem::dirAddSlashAtEnd( dir );
@@ -107,9 +190,7 @@ WatchID FileWatcherInotify::addWatch( const std::string& directory, FileWatchLis
 		}
 	}
 
-	int wd = inotify_add_watch( mFD, dir.c_str(),
-								IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MOVED_FROM |
-									IN_DELETE | IN_MODIFY );
+	int wd = inotify_add_watch( mFD, dir.c_str(), INOTIFY_WATCH_MASK );
 
 	if ( wd < 0 ) {
 		if ( errno == ENOENT ) {
@@ -120,19 +201,37 @@ WatchID FileWatcherInotify::addWatch( const std::string& directory, FileWatchLis
 		}
 	}
 
+	{
+		Lock lock( mWatchesLock );
+		WatchMap::iterator existing = mWatches.find( wd );
+
+		if ( existing != mWatches.end() ) {
+			/// A watched directory that was moved here from another watched directory
+			if ( NULL != parent && NULL != existing->second->Parent ) {
+				moveWatchLocked( existing->second, dir, parent );
+				return wd;
+			}
+
+			return Errors::Log::createLastError( Errors::FileRepeated, directory );
+		}
+	}
+
 	efDEBUG( "Added watch %s with id: %d\n", dir.c_str(), wd );
 
 	WatcherInotify* pWatch = new WatcherInotify();
 	pWatch->Listener = watcher;
+	pWatch->BatchListener = dynamic_cast<FileWatchBatchListener*>( watcher );
 	pWatch->ID = parent ? parent->ID : wd;
 	pWatch->InotifyID = wd;
 	pWatch->Directory = dir;
 	pWatch->Recursive = recursive;
-	pWatch->Parent = parent;
+	pWatch->Filter = parent ? parent->Filter : filter;
 
 	{
 		Lock lock( mWatchesLock );
 		mWatches.insert( std::make_pair( wd, pWatch ) );
+		indexWatch( pWatch );
+		linkWatch( pWatch, parent );
 	}
 
 	if ( NULL == pWatch->Parent ) {
@@ -141,28 +240,175 @@ WatchID FileWatcherInotify::addWatch( const std::string& directory, FileWatchLis
 	}
 
 	if ( pWatch->Recursive ) {
-		std::map<std::string, FileInfo> files = FileSystem::filesInfoFromPath( pWatch->Directory );
-		std::map<std::string, FileInfo>::iterator it = files.begin();
+		addSubdirectories( pWatch );
+	}
 
-		for ( ; it != files.end(); ++it ) {
-			if ( !mInitOK )
-				break;
+	return wd;
+}
+
+void FileWatcherInotify::addSubdirectories( WatcherInotify* watch ) {
+	efTRACE_SCOPE( "FileWatcherInotify::addSubdirectories" );
+
+	/// Directories added by the user are their own watches
+	std::unordered_set<std::string> skip;
 
-			const FileInfo& cfi = it->second;
+	{
+		Lock l( mRealWatchesLock );
 
-			if ( cfi.isDirectory() && cfi.isReadable() ) {
-				addWatch( cfi.Filepath, watcher, recursive, pWatch );
+		for ( WatchMap::iterator it = mRealWatches.begin(); it != mRealWatches.end(); ++it ) {
+			if ( it->second != watch ) {
+				skip.insert( it->second->Directory );
 			}
 		}
 	}
 
-	return wd;
+	InotifyTreeWalker walker( mFD, INOTIFY_WATCH_MASK, skip, watch->Filter.get() );
+	walker.walk( watch->Directory );
+
+	std::vector<WatcherInotify*> added;
+
+	{
+		Lock lock( mWatchesLock );
+
+		for ( size_t i = 0; i < walker.Directories.size(); ++i ) {
+			const InotifyTreeWalker::Directory& directory = walker.Directories[i];
+
+			/// Already watched through another path
+			if ( mWatches.find( directory.InotifyID ) != mWatches.end() ) {
+				continue;
+			}
+
+			WatcherInotify* pWatch = new WatcherInotify();
+			pWatch->Listener = watch->Listener;
+			pWatch->BatchListener = watch->BatchListener;
+			pWatch->ID = watch->ID;
+			pWatch->InotifyID = directory.InotifyID;
+			pWatch->Directory = directory.Path;
+			pWatch->Recursive = true;
+			pWatch->Filter = watch->Filter;
+
+			mWatches.insert( std::make_pair( directory.InotifyID, pWatch ) );
+			indexWatch( pWatch );
+			added.push_back( pWatch );
+		}
+
+		/// The walk finished, every parent is known now
+		for ( size_t i = 0; i < added.size(); ++i ) {
+			std::string parentPath( FileSystem::pathRemoveFileName( added[i]->Directory ) );
+			std::unordered_map<std::string, WatcherInotify*>::iterator parent =
+				mWatchesByPath.find( parentPath );
+
+			linkWatch( added[i], parent != mWatchesByPath.end() ? parent->second : watch );
+		}
+	}
+
+	efDEBUG( "Added %d watches below %s\n", (int)added.size(), watch->Directory.c_str() );
+
+	/// Symbolic links need the checks of a regular watch
+	for ( size_t i = 0; i < walker.Links.size(); ++i ) {
+		std::string parentPath( FileSystem::pathRemoveFileName( walker.Links[i] ) );
+		WatcherInotify* parent = watch;
+
+		{
+			Lock lock( mWatchesLock );
+
+			std::unordered_map<std::string, WatcherInotify*>::iterator it =
+				mWatchesByPath.find( parentPath );
+
+			if ( it != mWatchesByPath.end() ) {
+				parent = it->second;
+			}
+		}
+
+		addWatch( walker.Links[i], watch->Listener, true, parent );
+	}
+}
+
+void FileWatcherInotify::indexWatch( WatcherInotify* watch ) {
+	mWatchesByPath[watch->Directory] = watch;
+}
+
+void FileWatcherInotify::unindexWatch( WatcherInotify* watch ) {
+	std::unordered_map<std::string, WatcherInotify*>::iterator it =
+		mWatchesByPath.find( watch->Directory );
+
+	if ( it != mWatchesByPath.end() && it->second == watch ) {
+		mWatchesByPath.erase( it );
+	}
+}
+
+void FileWatcherInotify::linkWatch( WatcherInotify* watch, WatcherInotify* parent ) {
+	watch->Parent = parent;
+
+	if ( NULL != parent ) {
+		watch->ChildIndex = parent->Children.size();
+		parent->Children.push_back( watch );
+	}
+}
+
+void FileWatcherInotify::unlinkWatch( WatcherInotify* watch ) {
+	if ( NULL == watch->Parent ) {
+		return;
+	}
+
+	std::vector<WatcherInotify*>& siblings = watch->Parent->Children;
+	siblings[watch->ChildIndex] = siblings.back();
+	siblings[watch->ChildIndex]->ChildIndex = watch->ChildIndex;
+	siblings.pop_back();
+}
+
+void FileWatcherInotify::moveWatchLocked( WatcherInotify* watch, const std::string& directory,
+										  WatcherInotify* parent ) {
+	std::string oldDirectory( watch->Directory );
+
+	/// The move replaced whatever was there
+	std::unordered_map<std::string, WatcherInotify*>::iterator replaced =
+		mWatchesByPath.find( directory );
+
+	if ( replaced != mWatchesByPath.end() && replaced->second != watch ) {
+		removeWatchTreeLocked( replaced->second );
+	}
+
+	if ( parent != watch->Parent ) {
+		unlinkWatch( watch );
+		linkWatch( watch, parent );
+	}
+
+	std::vector<WatcherInotify*> subtree( 1, watch );
+
+	while ( !subtree.empty() ) {
+		WatcherInotify* current = subtree.back();
+		subtree.pop_back();
+
+		unindexWatch( current );
+		/// The subtree may come from another watch added by the user, it now reports to this one
+		current->ID = parent->ID;
+		current->Listener = parent->Listener;
+		current->BatchListener = parent->BatchListener;
+		current->Filter = parent->Filter;
+		current->Directory = directory + current->Directory.substr( oldDirectory.size() );
+		current->DirInfo.Filepath = current->Directory;
+		indexWatch( current );
+
+		subtree.insert( subtree.end(), current->Children.begin(), current->Children.end() );
+	}
+
+	watch->DirInfo = FileInfo( directory );
 }
 
 void FileWatcherInotify::removeWatchLocked( WatchID watchid ) {
 	WatchMap::iterator iter = mWatches.find( watchid );
 
-	WatcherInotify* watch = iter->second;
+	if ( iter != mWatches.end() ) {
+		removeWatchTreeLocked( iter->second );
+	}
+}
+
+void FileWatcherInotify::removeWatchTreeLocked( WatcherInotify* watch ) {
+	/// Every child unlinks itself
+	while ( !watch->Children.empty() ) {
+		removeWatchTreeLocked( watch->Children.back() );
+	}
 
 	for ( std::vector<std::pair<WatcherInotify*, std::string>>::iterator itm =
 			  mMovedOutsideWatches.begin();
@@ -173,25 +419,12 @@ void FileWatcherInotify::removeWatchLocked( WatchID watchid ) {
 		}
 	}
 
-	if ( watch->Recursive ) {
-		WatchMap::iterator it = mWatches.begin();
-		std::list<WatchID> eraseWatches;
-
-		for ( ; it != mWatches.end(); ++it ) {
-			if ( it->second != watch && it->second->inParentTree( watch ) ) {
-				eraseWatches.push_back( it->second->InotifyID );
-			}
-		}
-
-		for ( std::list<WatchID>::iterator eit = eraseWatches.begin(); eit != eraseWatches.end();
-			  ++eit ) {
-			removeWatch( *eit );
-		}
-	}
-
-	mWatches.erase( iter );
+	mWatches.erase( watch->InotifyID );
+	unindexWatch( watch );
+	unlinkWatch( watch );
 
 	if ( NULL == watch->Parent ) {
+		Lock l( mRealWatchesLock );
 		WatchMap::iterator eraseit = mRealWatches.find( watch->InotifyID );
 
 		if ( eraseit != mRealWatches.end() ) {
@@ -199,15 +432,16 @@ void FileWatcherInotify::removeWatchLocked( WatchID watchid ) {
 		}
 	}
 
-	int err = inotify_rm_watch( mFD, watchid );
+	int err = inotify_rm_watch( mFD, watch->InotifyID );
 
 	if ( err < 0 ) {
-		efDEBUG( "Error removing watch %d: %s\n", watchid, strerror( errno ) );
+		efDEBUG( "Error removing watch %d: %s\n", watch->InotifyID, strerror( errno ) );
 	} else {
-		efDEBUG( "Removed watch %s with id: %d\n", watch->Directory.c_str(), watchid );
+		efDEBUG( "Removed watch %s with id: %d\n", watch->Directory.c_str(), watch->InotifyID );
 	}
 
-	efSAFE_DELETE( watch );
+	/// Batched events of this read may still point to its directory
+	mRetiredWatches.push_back( watch );
 }
 
 void FileWatcherInotify::removeWatch( const std::string& directory ) {
@@ -215,53 +449,14 @@ void FileWatcherInotify::removeWatch( const std::string& directory ) {
 		return;
 	Lock initLock( mInitLock );
 	Lock lock( mWatchesLock );
-	Lock l( mRealWatchesLock );
-
-	WatchMap::iterator iter = mWatches.begin();
-
-	for ( ; iter != mWatches.end(); ++iter ) {
-		if ( directory == iter->second->Directory ) {
-			WatcherInotify* watch = iter->second;
-
-			if ( watch->Recursive ) {
-				WatchMap::iterator it = mWatches.begin();
-				std::list<WatchID> eraseWatches;
-
-				for ( ; it != mWatches.end(); ++it ) {
-					if ( it->second->inParentTree( watch ) ) {
-						eraseWatches.push_back( it->second->InotifyID );
-					}
-				}
-
-				for ( std::list<WatchID>::iterator eit = eraseWatches.begin();
-					  eit != eraseWatches.end(); ++eit ) {
-					removeWatchLocked( *eit );
-				}
-			}
-
-			mWatches.erase( iter );
-
-			if ( NULL == watch->Parent ) {
-				WatchMap::iterator eraseit = mRealWatches.find( watch->InotifyID );
-
-				if ( eraseit != mRealWatches.end() ) {
-					mRealWatches.erase( eraseit );
-				}
-			}
-
-			int err = inotify_rm_watch( mFD, watch->InotifyID );
 
-			if ( err < 0 ) {
-				efDEBUG( "Error removing watch %d: %s\n", watch->InotifyID, strerror( errno ) );
-			} else {
-				efDEBUG( "Removed watch %s with id: %d\n", watch->Directory.c_str(),
-						 watch->InotifyID );
-			}
+	std::string dir( directory );
+	FileSystem::dirAddSlashAtEnd( dir );
 
-			efSAFE_DELETE( watch );
+	std::unordered_map<std::string, WatcherInotify*>::iterator it = mWatchesByPath.find( dir );
 
-			break;
-		}
+	if ( it != mWatchesByPath.end() ) {
+		removeWatchTreeLocked( it->second );
 	}
 }
 
@@ -287,166 +482,376 @@ void FileWatcherInotify::watch() {
 	}
 }
 
-Watcher* FileWatcherInotify::watcherContainsDirectory( std::string dir ) {
-	FileSystem::dirRemoveSlashAtEnd( dir );
-	std::string watcherPath = FileSystem::pathRemoveFileName( dir );
-	FileSystem::dirAddSlashAtEnd( watcherPath );
-	Lock lock( mWatchesLock );
+void FileWatcherInotify::wakeup() {
+	if ( mEventFD == -1 )
+		return;
 
-	for ( WatchMap::iterator it = mWatches.begin(); it != mWatches.end(); ++it ) {
-		Watcher* watcher = it->second;
+	uint64_t value = 1;
 
-		if ( watcher->Directory == watcherPath ) {
-			return watcher;
-		}
+	if ( write( mEventFD, &value, sizeof( value ) ) < 0 && errno != EAGAIN ) {
+		efDEBUG( "Error waking up the watcher thread: %s\n", strerror( errno ) );
 	}
+}
 
-	return NULL;
+void FileWatcherInotify::setMoveTimer( bool armed ) {
+	struct itimerspec spec;
+	memset( &spec, 0, sizeof( spec ) );
+
+	if ( armed ) {
+		spec.it_value.tv_sec = MOVE_PAIR_TIMEOUT_MS / 1000;
+		spec.it_value.tv_nsec = ( MOVE_PAIR_TIMEOUT_MS % 1000 ) * 1000000;
+	}
+
+	if ( timerfd_settime( mTimerFD, 0, &spec, NULL ) < 0 ) {
+		efDEBUG( "Error setting the move timer: %s\n", strerror( errno ) );
+	}
 }
 
 void FileWatcherInotify::run() {
-	char* buff = new char[BUFF_SIZE];
-	memset( buff, 0, BUFF_SIZE );
-	WatchMap::iterator wit;
+	do {
+		processEvents( -1 );
+	} while ( mInitOK );
+}
 
-	WatcherInotify* currentMoveFrom = NULL;
-	u_int32_t currentMoveCookie = -1;
-	bool lastWasMovedFrom = false;
-	std::string prevOldFileName;
+int FileWatcherInotify::getFileDescriptor() {
+	return mInitOK ? mEpollFD : -1;
+}
 
-	do {
-		fd_set rfds;
-		FD_ZERO( &rfds );
-		FD_SET( mFD, &rfds );
-		timeval timeout;
-		timeout.tv_sec = 0;
-		timeout.tv_usec = 100000;
+void FileWatcherInotify::dispatch() {
+	/// Events are already delivered by the thread once watch() was called
+	if ( NULL != mThread || !mInitOK )
+		return;
+
+	/// Drain everything, a host waiting edge triggered on the descriptor wouldn't wake up again
+	while ( mInitOK && processEvents( 0 ) ) {
+	}
+}
+
+bool FileWatcherInotify::processEvents( int timeoutMs ) {
+	if ( NULL == mBuffer ) {
+		mBuffer = new char[BUFF_SIZE];
+		memset( mBuffer, 0, BUFF_SIZE );
+	}
+
+	char* buff = mBuffer;
 
-		if ( select( FD_SETSIZE, &rfds, NULL, NULL, &timeout ) > 0 ) {
-			ssize_t len;
+	/// Sleeps until there are events, the eventfd is signaled or the move timer expires
+	struct epoll_event events[3];
+	int count = epoll_wait( mEpollFD, events, 3, timeoutMs );
 
-			len = read( mFD, buff, BUFF_SIZE );
+	if ( count < 0 ) {
+		if ( errno != EINTR ) {
+			efDEBUG( "Error: %s\n", strerror( errno ) );
+		}
+
+		return false;
+	}
+
+	bool inotifyReady = false;
+	bool moveTimerExpired = false;
 
-			if ( len != -1 ) {
-				ssize_t i = 0;
+	for ( int e = 0; e < count; ++e ) {
+		uint64_t value;
+
+		if ( events[e].data.fd == mFD ) {
+			inotifyReady = true;
+		} else if ( events[e].data.fd == mTimerFD ) {
+			moveTimerExpired = read( mTimerFD, &value, sizeof( value ) ) > 0;
+		} else if ( events[e].data.fd == mEventFD ) {
+			/// Reset the counter, the caller checks mInitOK
+			if ( read( mEventFD, &value, sizeof( value ) ) < 0 && errno != EAGAIN ) {
+				efDEBUG( "Error: %s\n", strerror( errno ) );
+			}
+		}
+	}
 
-				while ( i < len ) {
-					struct inotify_event* pevent = (struct inotify_event*)&buff[i];
+	if ( inotifyReady ) {
+		efTRACE_SCOPE( "FileWatcherInotify::readEvents" );
+		ssize_t len;
+		int cachedWd = -1;
+		/// The watch of cachedWd, NULL if not found. Not an iterator: removeWatch() may erase the
+		/// node meanwhile, while the watch stays alive in mRetiredWatches until the read is done.
+		WatcherInotify* watch = NULL;
 
-					{
-						{
-							Lock lock( mWatchesLock );
+		len = read( mFD, buff, BUFF_SIZE );
 
-							wit = mWatches.find( pevent->wd );
+		if ( len != -1 ) {
+			ssize_t i = 0;
+
+			while ( i < len ) {
+				struct inotify_event* pevent = (struct inotify_event*)&buff[i];
+
+				if ( pevent->mask & IN_Q_OVERFLOW ) {
+					reportMissedEvents();
+					i += sizeof( struct inotify_event ) + pevent->len;
+					continue;
+				}
+
+				{
+					/// Events usually come in runs for the same directory
+					if ( pevent->wd != cachedWd ) {
+						Lock lock( mWatchesLock );
+
+						WatchMap::iterator wit = mWatches.find( pevent->wd );
+						watch = wit != mWatches.end() ? wit->second : NULL;
+						cachedWd = NULL != watch ? pevent->wd : -1;
+					}
+
+					/// Dropped before building any string, not even taking part in the move
+					/// pairing: a file renamed from a filtered name is reported as added
+					if ( NULL != watch && NULL != watch->Filter && pevent->len > 0 &&
+						 !watch->Filter->accepts( pevent->name,
+												  ( pevent->mask & IN_ISDIR ) != 0 ) ) {
+						i += sizeof( struct inotify_event ) + pevent->len;
+						continue;
+					}
+
+					if ( NULL != watch ) {
+						if ( NULL != watch->BatchListener &&
+							 ( pevent->mask & ( IN_CLOSE_WRITE | IN_MODIFY ) ) ) {
+							/// The most frequent events, queued without building any string
+							queueBatchEvent( watch, pevent->name, Actions::Modified );
+						} else {
+							handleAction( watch, (char*)pevent->name, pevent->mask );
+
+							/// It may have added or removed watches
+							cachedWd = -1;
 						}
 
-						if ( wit != mWatches.end() ) {
-							handleAction( wit->second, (char*)pevent->name, pevent->mask );
-
-							if ( ( pevent->mask & IN_MOVED_TO ) && wit->second == currentMoveFrom &&
-								 pevent->cookie == currentMoveCookie ) {
-								/// make pair success
-								currentMoveFrom = NULL;
-								currentMoveCookie = -1;
-							} else if ( pevent->mask & IN_MOVED_FROM ) {
-								// Previous event was moved from and current event is moved from
-								// Treat it as a DELETE or moved ouside watches
-								if ( lastWasMovedFrom && currentMoveFrom ) {
-									mMovedOutsideWatches.push_back(
-										std::make_pair( currentMoveFrom, prevOldFileName ) );
-								}
-
-								currentMoveFrom = wit->second;
-								currentMoveCookie = pevent->cookie;
-							} else {
-								/// Keep track of the IN_MOVED_FROM events to know
-								/// if the IN_MOVED_TO event is also fired
-								if ( currentMoveFrom ) {
-									mMovedOutsideWatches.push_back(
-										std::make_pair( currentMoveFrom, prevOldFileName ) );
-								}
-
-								currentMoveFrom = NULL;
-								currentMoveCookie = -1;
+						if ( ( pevent->mask & IN_MOVED_TO ) && watch == mCurrentMoveFrom &&
+							 pevent->cookie == mCurrentMoveCookie ) {
+							/// make pair success
+							mCurrentMoveFrom = NULL;
+							mCurrentMoveCookie = -1;
+						} else if ( pevent->mask & IN_MOVED_FROM ) {
+							// Previous event was moved from and current event is moved from
+							// Treat it as a DELETE or moved ouside watches
+							if ( mLastWasMovedFrom && mCurrentMoveFrom ) {
+								mMovedOutsideWatches.push_back(
+									std::make_pair( mCurrentMoveFrom, mPrevOldFileName ) );
+							}
+
+							mCurrentMoveFrom = watch;
+							mCurrentMoveCookie = pevent->cookie;
+						} else {
+							/// Keep track of the IN_MOVED_FROM events to know
+							/// if the IN_MOVED_TO event is also fired
+							if ( mCurrentMoveFrom ) {
+								mMovedOutsideWatches.push_back(
+									std::make_pair( mCurrentMoveFrom, mPrevOldFileName ) );
 							}
-						}
 
-						lastWasMovedFrom = ( pevent->mask & IN_MOVED_FROM ) != 0;
-						if ( pevent->mask & IN_MOVED_FROM )
-							prevOldFileName = std::string( (char*)pevent->name );
+							mCurrentMoveFrom = NULL;
+							mCurrentMoveCookie = -1;
+						}
 					}
 
-					i += sizeof( struct inotify_event ) + pevent->len;
+					mLastWasMovedFrom = ( pevent->mask & IN_MOVED_FROM ) != 0;
+					if ( pevent->mask & IN_MOVED_FROM )
+						mPrevOldFileName = std::string( (char*)pevent->name );
 				}
+
+				i += sizeof( struct inotify_event ) + pevent->len;
 			}
-		} else {
-			// Here means no event received
-			// If last event is IN_MOVED_FROM, we assume no IN_MOVED_TO
-			if ( currentMoveFrom ) {
-				mMovedOutsideWatches.push_back(
-					std::make_pair( currentMoveFrom, currentMoveFrom->OldFileName ) );
+		}
+
+		/// Restart the wait for the IN_MOVED_TO with every read, like a quiet period
+		if ( mCurrentMoveFrom || mMoveTimerArmed ) {
+			setMoveTimer( mCurrentMoveFrom != NULL );
+			mMoveTimerArmed = mCurrentMoveFrom != NULL;
+		}
+	} else if ( moveTimerExpired ) {
+		// Here means no event received since the IN_MOVED_FROM
+		// If last event is IN_MOVED_FROM, we assume no IN_MOVED_TO
+		if ( mCurrentMoveFrom ) {
+			mMovedOutsideWatches.push_back(
+				std::make_pair( mCurrentMoveFrom, mCurrentMoveFrom->OldFileName ) );
+		}
+
+		mCurrentMoveFrom = NULL;
+		mCurrentMoveCookie = -1;
+		mMoveTimerArmed = false;
+	}
+
+	if ( !mMovedOutsideWatches.empty() ) {
+		efTRACE_SCOPE( "FileWatcherInotify::movedOutside" );
+		// We need to make a copy since the element mMovedOutsideWatches could be modified
+		// during the iteration.
+		std::vector<std::pair<WatcherInotify*, std::string>> movedOutsideWatches(
+			mMovedOutsideWatches );
+
+		/// In case that the IN_MOVED_TO is never fired means that the file was moved to other
+		/// folder
+		for ( std::vector<std::pair<WatcherInotify*, std::string>>::iterator it =
+				  movedOutsideWatches.begin();
+			  it != movedOutsideWatches.end(); ++it ) {
+			WatcherInotify* watch = ( *it ).first;
+			const std::string& oldFileName = ( *it ).second;
+
+			{
+				Lock lock( mWatchesLock );
+				WatchMap::iterator found = mWatches.find( watch->InotifyID );
+
+				/// Removed along with another directory moved outside
+				if ( found == mWatches.end() || found->second != watch ) {
+					continue;
+				}
+			}
+
+			/// Otherwise the next IN_MOVED_TO of the directory would be taken as a rename
+			if ( watch != mCurrentMoveFrom ) {
+				watch->OldFileName = "";
 			}
 
-			currentMoveFrom = NULL;
-			currentMoveCookie = -1;
+			/// If it was a watched directory, the delete removes its whole subtree
+			handleAction( watch, oldFileName, IN_DELETE );
 		}
 
-		if ( !mMovedOutsideWatches.empty() ) {
-			// We need to make a copy since the element mMovedOutsideWatches could be modified
-			// during the iteration.
-			std::vector<std::pair<WatcherInotify*, std::string>> movedOutsideWatches(
-				mMovedOutsideWatches );
+		mMovedOutsideWatches.clear();
+	}
 
-			/// In case that the IN_MOVED_TO is never fired means that the file was moved to other
-			/// folder
-			for ( std::vector<std::pair<WatcherInotify*, std::string>>::iterator it =
-					  movedOutsideWatches.begin();
-				  it != movedOutsideWatches.end(); ++it ) {
-				Watcher* watch = ( *it ).first;
-				const std::string& oldFileName = ( *it ).second;
+	flushBatch();
 
-				/// Check if the file move was a folder already being watched
-				std::list<Watcher*> eraseWatches;
+	deleteRetiredWatches();
 
-				{
-					Lock lock( mWatchesLock );
+	return count > 0;
+}
 
-					for ( ; wit != mWatches.end(); ++wit ) {
-						Watcher* oldWatch = wit->second;
+void FileWatcherInotify::notify( Watcher* watch, const std::string& filename, Action action,
+								 const std::string& oldFilename ) {
+	WatcherInotify* iwatch = static_cast<WatcherInotify*>( watch );
 
-						if ( oldWatch != watch &&
-							 -1 != String::strStartsWith( watch->Directory + oldFileName + "/",
-														  oldWatch->Directory ) ) {
-							eraseWatches.push_back( oldWatch );
-						}
-					}
-				}
+	/// The directories that don't match the includes are only watched
+	if ( NULL != iwatch->Filter && !iwatch->Filter->reports( filename.c_str() ) ) {
+		return;
+	}
 
-				/// Remove invalid watches
-				eraseWatches.sort();
-
-				if ( eraseWatches.empty() ) {
-					handleAction( watch, oldFileName, IN_DELETE );
-				} else {
-					for ( std::list<Watcher*>::reverse_iterator eit = eraseWatches.rbegin();
-						  eit != eraseWatches.rend(); ++eit ) {
-						Watcher* rmWatch = *eit;
-
-						/// Create Delete event for removed watches that have been moved too
-						if ( Watcher* cntWatch = watcherContainsDirectory( rmWatch->Directory ) ) {
-							handleAction( cntWatch,
-										  FileSystem::fileNameFromPath( rmWatch->Directory ),
-										  IN_DELETE );
-						}
-					}
+	if ( NULL != iwatch->BatchListener ) {
+		/// The strings are temporaries, unlike the names in the read buffer
+		mBatchStrings.push_back( filename );
+		const char* name = mBatchStrings.back().c_str();
+		const char* oldName = "";
+
+		if ( !oldFilename.empty() ) {
+			mBatchStrings.push_back( oldFilename );
+			oldName = mBatchStrings.back().c_str();
+		}
+
+		queueBatchEvent( iwatch, name, action, oldName );
+	} else {
+		watch->Listener->handleFileAction( watch->ID, watch->Directory, filename, action,
+										   oldFilename );
+	}
+}
+
+void FileWatcherInotify::queueBatchEvent( WatcherInotify* watch, const char* filename,
+										  Action action, const char* oldFilename ) {
+	FileEvent event;
+	event.ID = watch->ID;
+	event.Directory = &watch->Directory;
+	event.Filename = filename;
+	event.OldFilename = oldFilename;
+	event.Type = action;
+
+	mBatch.push_back( event );
+	mBatchListeners.push_back( watch->BatchListener );
+}
+
+void FileWatcherInotify::flushBatch() {
+	if ( mBatch.empty() ) {
+		return;
+	}
+
+	efTRACE_SCOPE( "FileWatcherInotify::flushBatch" );
+
+	Lock initLock( mInitLock );
+
+	/// Usually there is a single listener, which gets the events as they were queued
+	FileWatchBatchListener* single = mBatchListeners[0];
+
+	for ( size_t i = 1; i < mBatchListeners.size() && NULL != single; ++i ) {
+		if ( mBatchListeners[i] != single ) {
+			single = NULL;
+		}
+	}
+
+	if ( NULL != single ) {
+		if ( mInitOK ) {
+			single->handleFileActions( &mBatch[0], mBatch.size() );
+		}
+	} else {
+		/// Else deliver the events of each one in order
+		size_t first = 0;
+
+		while ( mInitOK && first < mBatch.size() ) {
+			FileWatchBatchListener* listener = mBatchListeners[first];
+			size_t next = mBatch.size();
+
+			mBatchEvents.clear();
+
+			for ( size_t i = first; i < mBatch.size(); ++i ) {
+				if ( mBatchListeners[i] == listener ) {
+					mBatchEvents.push_back( mBatch[i] );
+
+					/// Mark as delivered
+					mBatchListeners[i] = NULL;
+				} else if ( NULL != mBatchListeners[i] && next == mBatch.size() ) {
+					next = i;
 				}
 			}
 
-			mMovedOutsideWatches.clear();
+			listener->handleFileActions( &mBatchEvents[0], mBatchEvents.size() );
+
+			first = next;
 		}
-	} while ( mInitOK );
+	}
+
+	mBatch.clear();
+	mBatchListeners.clear();
+	mBatchStrings.clear();
+}
+
+void FileWatcherInotify::reportMissedEvents() {
+	efDEBUG( "inotify queue overflow, events were lost\n" );
+
+	/// The events read before the overflow come first
+	flushBatch();
+
+	std::vector<WatcherInotify*> watches;
+
+	{
+		Lock lock( mRealWatchesLock );
+
+		for ( WatchMap::iterator it = mRealWatches.begin(); it != mRealWatches.end(); ++it ) {
+			watches.push_back( it->second );
+		}
+	}
+
+	Lock initLock( mInitLock );
+
+	for ( size_t i = 0; mInitOK && i < watches.size(); ++i ) {
+		{
+			Lock lock( mRealWatchesLock );
+			WatchMap::iterator found = mRealWatches.find( watches[i]->InotifyID );
 
-	delete[] buff;
+			/// Removed by a listener meanwhile, it stays alive until the read is done
+			if ( found == mRealWatches.end() || found->second != watches[i] ) {
+				continue;
+			}
+		}
+
+		watches[i]->Listener->handleMissedFileActions( watches[i]->ID, watches[i]->Directory );
+	}
+}
+
+void FileWatcherInotify::deleteRetiredWatches() {
+	Lock lock( mWatchesLock );
+
+	for ( size_t i = 0; i < mRetiredWatches.size(); ++i ) {
+		efSAFE_DELETE( mRetiredWatches[i] );
+	}
+
+	mRetiredWatches.clear();
 }
 
 void FileWatcherInotify::checkForNewWatcher( Watcher* watch, std::string fpath ) {
@@ -460,12 +865,7 @@ void FileWatcherInotify::checkForNewWatcher( Watcher* watch, std::string fpath )
 			Lock lock( mWatchesLock );
 
 			/// First check if exists
-			for ( WatchMap::iterator it = mWatches.begin(); it != mWatches.end(); ++it ) {
-				if ( it->second->Directory == fpath ) {
-					found = true;
-					break;
-				}
-			}
+			found = mWatchesByPath.find( fpath ) != mWatchesByPath.end();
 		}
 
 		if ( !found ) {
@@ -482,29 +882,26 @@ void FileWatcherInotify::handleAction( Watcher* watch, const std::string& filena
 	}
 
 	Lock initLock( mInitLock );
+	efTRACE_SCOPE( "FileWatcherInotify::handleAction" );
 
 	std::string fpath( watch->Directory + filename );
 
 	if ( ( IN_CLOSE_WRITE & action ) || ( IN_MODIFY & action ) ) {
-		watch->Listener->handleFileAction( watch->ID, watch->Directory, filename,
-										   Actions::Modified );
+		notify( watch, filename, Actions::Modified );
 	} else if ( IN_MOVED_TO & action ) {
 		/// If OldFileName doesn't exist means that the file has been moved from other folder, so we
 		/// just send the Add event
 		if ( watch->OldFileName.empty() ) {
-			watch->Listener->handleFileAction( watch->ID, watch->Directory, filename,
-											   Actions::Add );
+			notify( watch, filename, Actions::Add );
 
-			watch->Listener->handleFileAction( watch->ID, watch->Directory, filename,
-											   Actions::Modified );
+			notify( watch, filename, Actions::Modified );
 
 			checkForNewWatcher( watch, fpath );
 		} else {
-			watch->Listener->handleFileAction( watch->ID, watch->Directory, filename,
-											   Actions::Moved, watch->OldFileName );
+			notify( watch, filename, Actions::Moved, watch->OldFileName );
 		}
 
-		if ( watch->Recursive && FileSystem::isDirectory( fpath ) ) {
+		if ( !watch->OldFileName.empty() && watch->Recursive && FileSystem::isDirectory( fpath ) ) {
 			/// Update the new directory path
 			std::string opath( watch->Directory + watch->OldFileName );
 			FileSystem::dirAddSlashAtEnd( opath );
@@ -512,26 +909,23 @@ void FileWatcherInotify::handleAction( Watcher* watch, const std::string& filena
 
 			Lock lock( mWatchesLock );
 
-			for ( WatchMap::iterator it = mWatches.begin(); it != mWatches.end(); ++it ) {
-				if ( it->second->Directory == opath ) {
-					it->second->Directory = fpath;
-					it->second->DirInfo = FileInfo( fpath );
-				} else if ( -1 != String::strStartsWith( opath, it->second->Directory ) ) {
-					it->second->Directory = fpath + it->second->Directory.substr( opath.size() );
-					it->second->DirInfo.Filepath = it->second->Directory;
-				}
+			std::unordered_map<std::string, WatcherInotify*>::iterator it =
+				mWatchesByPath.find( opath );
+
+			if ( it != mWatchesByPath.end() ) {
+				moveWatchLocked( it->second, fpath, static_cast<WatcherInotify*>( watch ) );
 			}
 		}
 
 		watch->OldFileName = "";
 	} else if ( IN_CREATE & action ) {
-		watch->Listener->handleFileAction( watch->ID, watch->Directory, filename, Actions::Add );
+		notify( watch, filename, Actions::Add );
 
 		checkForNewWatcher( watch, fpath );
 	} else if ( IN_MOVED_FROM & action ) {
 		watch->OldFileName = filename;
 	} else if ( IN_DELETE & action ) {
-		watch->Listener->handleFileAction( watch->ID, watch->Directory, filename, Actions::Delete );
+		notify( watch, filename, Actions::Delete );
 
 		FileSystem::dirAddSlashAtEnd( fpath );
 
@@ -539,11 +933,11 @@ void FileWatcherInotify::handleAction( Watcher* watch, const std::string& filena
 		if ( watch->Recursive ) {
 			Lock l( mWatchesLock );
 
-			for ( WatchMap::iterator it = mWatches.begin(); it != mWatches.end(); ++it ) {
-				if ( it->second->Directory == fpath ) {
-					removeWatchLocked( it->second->InotifyID );
-					break;
-				}
+			std::unordered_map<std::string, WatcherInotify*>::iterator it =
+				mWatchesByPath.find( fpath );
+
+			if ( it != mWatchesByPath.end() ) {
+				removeWatchLocked( it->second->InotifyID );
 			}
 		}
 	}
@@ -6,7 +6,9 @@
 #if EFSW_PLATFORM == EFSW_PLATFORM_INOTIFY
 
 #include <efsw/WatcherInotify.hpp>
+#include <deque>
 #include <map>
+#include <unordered_map>
 #include <vector>
 
 namespace efsw {
@@ -26,6 +28,11 @@ class FileWatcherInotify : public FileWatcherImpl {
 	/// On error returns WatchID with Error type.
 	WatchID addWatch( const std::string& directory, FileWatchListener* watcher, bool recursive );
 
+	/// Add a directory watch reporting only the events selected by the filter
+	/// On error returns WatchID with Error type.
+	WatchID addFilteredWatch( const std::string& directory, FileWatchListener* watcher,
+							  bool recursive, const WatchFilter& filter );
+
 	/// Remove a directory watch. This is a brute force lazy search O(nlogn).
 	void removeWatch( const std::string& directory );
 
@@ -35,6 +42,12 @@ class FileWatcherInotify : public FileWatcherImpl {
 	/// Updates the watcher. Must be called often.
 	void watch();
 
+	/// @return The epoll file descriptor, readable when dispatch() has work to do
+	int getFileDescriptor();
+
+	/// Handles the pending events without blocking, if watch() wasn't called
+	void dispatch();
+
 	/// Handles the action
 	void handleAction( Watcher* watch, const std::string& filename, unsigned long action,
 					   std::string oldFilename = "" );
@@ -49,29 +62,120 @@ class FileWatcherInotify : public FileWatcherImpl {
 	/// User added watches
 	WatchMap mRealWatches;
 
+	/// The watches by directory, protected by mWatchesLock
+	std::unordered_map<std::string, WatcherInotify*> mWatchesByPath;
+
 	/// inotify file descriptor
 	int mFD;
 
+	/// epoll instance waiting on mFD, mEventFD and mTimerFD
+	int mEpollFD;
+
+	/// Signaled to wake up the thread, e.g. to shut it down
+	int mEventFD;
+
+	/// Armed only while an IN_MOVED_FROM waits for its IN_MOVED_TO
+	int mTimerFD;
+
 	Thread* mThread;
 
+	/// Buffer for read(), allocated on first use
+	char* mBuffer;
+
+	/// Move pairing state, kept between the reads
+	WatcherInotify* mCurrentMoveFrom;
+	u_int32_t mCurrentMoveCookie;
+	bool mLastWasMovedFrom;
+	bool mMoveTimerArmed;
+	std::string mPrevOldFileName;
+
 	Mutex mWatchesLock;
 	Mutex mRealWatchesLock;
 	Mutex mInitLock;
 	std::vector<std::pair<WatcherInotify*, std::string>> mMovedOutsideWatches;
 
+	/// The events for batch listeners, delivered at the end of processEvents() before the next
+	/// read. Their names point into the read buffer, or into mBatchStrings.
+	std::vector<FileEvent> mBatch;
+
+	/// The listener of each event of mBatch
+	std::vector<FileWatchBatchListener*> mBatchListeners;
+
+	/// The names that don't come from the read buffer, a deque doesn't move them when growing
+	std::deque<std::string> mBatchStrings;
+
+	/// The events of one listener, when several of them have events in mBatch
+	std::vector<FileEvent> mBatchEvents;
+
+	/// Removed watches, kept alive until no batched event can point to their directory.
+	/// Protected by mWatchesLock.
+	std::vector<WatcherInotify*> mRetiredWatches;
+
+	/// @param filter Only used by the watches added by the user, the others share the one of
+	/// their parent
 	WatchID addWatch( const std::string& directory, FileWatchListener* watcher, bool recursive,
-					  WatcherInotify* parent = NULL );
+					  WatcherInotify* parent = NULL,
+					  const std::shared_ptr<const FileNameFilter>& filter =
+						  std::shared_ptr<const FileNameFilter>() );
 
 	bool pathInWatches( const std::string& path );
 
+	/// Registers the subdirectories of a recursive watch
+	void addSubdirectories( WatcherInotify* watch );
+
   private:
 	void run();
 
+	/// Waits up to timeoutMs (-1 for no limit) and handles the events that arrived
+	/// @return false if the wait timed out
+	bool processEvents( int timeoutMs );
+
+	/// Interrupts the epoll_wait of the thread
+	void wakeup();
+
+	/// Arms the timer to expire after the move pairing timeout, or disarms it
+	void setMoveTimer( bool armed );
+
 	void removeWatchLocked( WatchID watchid );
 
-	void checkForNewWatcher( Watcher* watch, std::string fpath );
+	/// Removes the watch and its subtree. Must be called with mWatchesLock locked.
+	void removeWatchTreeLocked( WatcherInotify* watch );
+
+	/// Gives the watch and its subtree their new path after the directory was moved to
+	/// directory, below parent. Must be called with mWatchesLock locked.
+	void moveWatchLocked( WatcherInotify* watch, const std::string& directory,
+						  WatcherInotify* parent );
+
+	/// Reports the event to the listener of the watch, or queues it if it handles batches
+	void notify( Watcher* watch, const std::string& filename, Action action,
+				 const std::string& oldFilename = "" );
+
+	/// The names must stay valid until flushBatch()
+	void queueBatchEvent( WatcherInotify* watch, const char* filename, Action action,
+						  const char* oldFilename = "" );
+
+	/// Delivers the queued events, one call per batch listener
+	void flushBatch();
 
-	Watcher* watcherContainsDirectory( std::string dir );
+	/// Tells the listeners of the watches added by the user that events were lost
+	void reportMissedEvents();
+
+	void deleteRetiredWatches();
+
+	/// Must be called with mWatchesLock locked
+	void indexWatch( WatcherInotify* watch );
+
+	/// Must be called with mWatchesLock locked
+	void unindexWatch( WatcherInotify* watch );
+
+	/// Adds the watch to the Children of parent. Must be called with mWatchesLock locked.
+	void linkWatch( WatcherInotify* watch, WatcherInotify* parent );
+
+	/// Removes the watch from the Children of its Parent. Must be called with mWatchesLock
+	/// locked.
+	void unlinkWatch( WatcherInotify* watch );
+
+	void checkForNewWatcher( Watcher* watch, std::string fpath );
 };
 
 } // namespace efsw
@@ -0,0 +1,295 @@
+#include <efsw/InotifyTreeWalker.hpp>
+
+#if EFSW_PLATFORM == EFSW_PLATFORM_INOTIFY
+
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+#ifdef EFSW_INOTIFY_NOSYS
+#include <efsw/inotify-nosys.h>
+#else
+#include <sys/inotify.h>
+#endif
+
+#include <efsw/Debug.hpp>
+#include <efsw/FileSystem.hpp>
+
+/// Threads walking a tree at most, the calling one included
+#define WALK_MAX_THREADS 8
+
+/// The pool is only started once the calling thread found this many directories, most
+/// directories created while watching are registered before that
+#define WALK_DIRECTORIES_BEFORE_THREADS 64
+
+#define DENTS_BUFFER_SIZE ( 32 * 1024 )
+
+namespace efsw {
+
+namespace {
+
+/// Record returned by getdents64, glibc only declares the call since 2.30
+struct LinuxDirent64 {
+	Uint64 d_ino;
+	Int64 d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[1];
+};
+
+bool isDotOrDotDot( const char* name ) {
+	return name[0] == '.' && ( name[1] == '\0' || ( name[1] == '.' && name[2] == '\0' ) );
+}
+
+} // namespace
+
+InotifyTreeWalker::InotifyTreeWalker( int inotifyFD, Uint32 mask,
+									  const std::unordered_set<std::string>& skip,
+									  const FileNameFilter* filter ) :
+	mInotifyFD( inotifyFD ),
+	mMask( mask ),
+	mSkip( skip ),
+	mFilter( filter ),
+	mThreads( 1 ),
+	mIdle( 0 ),
+	mDone( false ),
+	mParallel( false ),
+	mVisited( 0 ) {}
+
+InotifyTreeWalker::~InotifyTreeWalker() {
+	for ( size_t i = 0; i < mPool.size(); ++i ) {
+		efSAFE_DELETE( mPool[i] );
+	}
+}
+
+void InotifyTreeWalker::walk( const std::string& root ) {
+	int fd = open( root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+
+	if ( fd < 0 ) {
+		return;
+	}
+
+	struct stat st;
+
+	if ( fstat( fd, &st ) != 0 ) {
+		close( fd );
+		return;
+	}
+
+	size_t hardwareThreads = std::thread::hardware_concurrency();
+	mThreads = std::max<size_t>( 1, std::min<size_t>( WALK_MAX_THREADS, hardwareThreads ) );
+	mResults.resize( mThreads );
+
+	for ( size_t i = 0; i < mResults.size(); ++i ) {
+		mResults[i].Buffer.resize( DENTS_BUFFER_SIZE );
+	}
+
+	std::string path( root );
+	walkChildren( fd, path, st.st_dev, mResults[0] );
+	close( fd );
+
+	if ( mParallel ) {
+		/// Help with the rest, then wait for the others to finish theirs
+		work( mResults[0] );
+
+		for ( size_t i = 0; i < mPool.size(); ++i ) {
+			efSAFE_DELETE( mPool[i] );
+		}
+
+		mPool.clear();
+	}
+
+	for ( size_t i = 0; i < mResults.size(); ++i ) {
+		Results& results = mResults[i];
+		Directories.insert( Directories.end(), results.Directories.begin(),
+							results.Directories.end() );
+		Links.insert( Links.end(), results.Links.begin(), results.Links.end() );
+	}
+
+	mResults.clear();
+}
+
+void InotifyTreeWalker::startThreads() {
+	mParallel = true;
+
+	for ( size_t i = 1; i < mThreads; ++i ) {
+		Worker worker = { this, i };
+		Thread* thread = new Thread( worker );
+		thread->launch();
+		mPool.push_back( thread );
+	}
+}
+
+void InotifyTreeWalker::work( Results& results ) {
+	for ( ;; ) {
+		Task task;
+
+		{
+			std::unique_lock<std::mutex> lock( mMutex );
+
+			mIdle++;
+
+			while ( mQueue.empty() && !mDone ) {
+				if ( mIdle == mThreads ) {
+					mDone = true;
+					mCondition.notify_all();
+				} else {
+					mCondition.wait( lock );
+				}
+			}
+
+			if ( mQueue.empty() ) {
+				return;
+			}
+
+			task = mQueue.back();
+			mQueue.pop_back();
+			mIdle--;
+		}
+
+		int fd = open( task.Path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC );
+
+		if ( fd >= 0 ) {
+			visit( fd, task.Path, task.Device, results );
+		}
+	}
+}
+
+void InotifyTreeWalker::visit( int fd, std::string& path, dev_t parentDevice, Results& results ) {
+	struct stat st;
+
+	/// Remote file systems are only possible below mount points
+	if ( fstat( fd, &st ) != 0 ||
+		 ( st.st_dev != parentDevice && FileSystem::isRemoteFS( path ) ) ) {
+		close( fd );
+		return;
+	}
+
+	int wd = inotify_add_watch( mInotifyFD, path.c_str(), mMask );
+
+	if ( wd < 0 ) {
+		efDEBUG( "Error adding watch %s: %s\n", path.c_str(), strerror( errno ) );
+		close( fd );
+		return;
+	}
+
+	Directory directory;
+	directory.Path = path;
+	directory.InotifyID = wd;
+	results.Directories.push_back( directory );
+
+	walkChildren( fd, path, st.st_dev, results );
+	close( fd );
+}
+
+void InotifyTreeWalker::walkChildren( int fd, std::string& path, dev_t device,
+									  Results& results ) {
+	std::vector<std::string> children;
+	size_t pathSize = path.size();
+
+	for ( ;; ) {
+		long count = syscall( SYS_getdents64, fd, &results.Buffer[0], results.Buffer.size() );
+
+		if ( count <= 0 ) {
+			break;
+		}
+
+		for ( long offset = 0; offset < count; ) {
+			LinuxDirent64* entry = (LinuxDirent64*)&results.Buffer[offset];
+			offset += entry->d_reclen;
+
+			const char* name = entry->d_name;
+			unsigned char type = entry->d_type;
+			struct stat st;
+
+			if ( isDotOrDotDot( name ) ) {
+				continue;
+			}
+
+			/// Some file systems don't fill the type
+			if ( DT_UNKNOWN == type ) {
+				if ( fstatat( fd, name, &st, AT_SYMLINK_NOFOLLOW ) != 0 ) {
+					continue;
+				}
+
+				type = S_ISDIR( st.st_mode ) ? DT_DIR : ( S_ISLNK( st.st_mode ) ? DT_LNK : DT_REG );
+			}
+
+			/// Never registered, nothing below them is reported
+			if ( ( DT_DIR == type || DT_LNK == type ) && NULL != mFilter &&
+				 mFilter->excludes( name ) ) {
+				continue;
+			}
+
+			if ( DT_DIR == type ) {
+				if ( !mSkip.empty() ) {
+					path.append( name );
+					path.push_back( '/' );
+					bool skip = mSkip.find( path ) != mSkip.end();
+					path.resize( pathSize );
+
+					if ( skip ) {
+						continue;
+					}
+				}
+
+				children.push_back( name );
+			} else if ( DT_LNK == type && 0 == fstatat( fd, name, &st, 0 ) &&
+						S_ISDIR( st.st_mode ) ) {
+				results.Links.push_back( path + name );
+			}
+		}
+	}
+
+	if ( children.empty() ) {
+		return;
+	}
+
+	size_t first = 0;
+
+	if ( !mParallel && mThreads > 1 ) {
+		mVisited += children.size();
+
+		if ( mVisited >= WALK_DIRECTORIES_BEFORE_THREADS ) {
+			startThreads();
+		}
+	}
+
+	if ( mParallel ) {
+		std::lock_guard<std::mutex> lock( mMutex );
+
+		/// Hand a subtree to every idle thread, keeping one for this one
+		for ( ; first + 1 < children.size() && mQueue.size() < mIdle; ++first ) {
+			Task task;
+			task.Path = path + children[first] + "/";
+			task.Device = device;
+			mQueue.push_back( task );
+		}
+
+		if ( first > 0 ) {
+			mCondition.notify_all();
+		}
+	}
+
+	for ( size_t i = first; i < children.size(); ++i ) {
+		int childFD =
+			openat( fd, children[i].c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC );
+
+		if ( childFD >= 0 ) {
+			path.append( children[i] );
+			path.push_back( '/' );
+			visit( childFD, path, device, results );
+			path.resize( pathSize );
+		}
+	}
+}
+
+} // namespace efsw
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef EFSW_INOTIFYTREEWALKER_HPP
+#define EFSW_INOTIFYTREEWALKER_HPP
+
+#include <efsw/FileNameFilter.hpp>
+#include <efsw/Thread.hpp>
+
+#if EFSW_PLATFORM == EFSW_PLATFORM_INOTIFY
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <unordered_set>
+#include <vector>
+
+namespace efsw {
+
+/// Registers every subdirectory of a tree with inotify.
+/// The directories are opened relative to their parent with openat and listed with
+/// getdents64, so only the entries whose type isn't reported are stat'ed. Big trees are
+/// walked by a pool of threads that take subtrees from a shared queue.
+class InotifyTreeWalker {
+  public:
+	struct Directory {
+		/// Path with a slash at the end
+		std::string Path;
+		int InotifyID;
+	};
+
+	/// @param skip Paths not to descend into, with a slash at the end
+	/// @param filter Excludes the subdirectories by name, NULL to walk them all
+	InotifyTreeWalker( int inotifyFD, Uint32 mask, const std::unordered_set<std::string>& skip,
+					   const FileNameFilter* filter );
+
+	~InotifyTreeWalker();
+
+	/// Registers the subdirectories below root, which must already be watched
+	void walk( const std::string& root );
+
+	/// The registered directories, in no particular order
+	std::vector<Directory> Directories;
+
+	/// Symbolic links found in the tree, left to the caller
+	std::vector<std::string> Links;
+
+  protected:
+	struct Task {
+		std::string Path;
+		dev_t Device;
+	};
+
+	/// What a thread found, merged once the walk is done
+	struct Results {
+		std::vector<Directory> Directories;
+		std::vector<std::string> Links;
+		/// getdents64 buffer
+		std::vector<char> Buffer;
+	};
+
+	struct Worker {
+		InotifyTreeWalker* Walker;
+		size_t Index;
+
+		void operator()() { Walker->work( Walker->mResults[Index] ); }
+	};
+
+	int mInotifyFD;
+	Uint32 mMask;
+	const std::unordered_set<std::string>& mSkip;
+	const FileNameFilter* mFilter;
+
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	std::vector<Task> mQueue;
+	/// Threads taking part in the walk once the pool started, the calling one included
+	size_t mThreads;
+	size_t mIdle;
+	bool mDone;
+
+	/// If the pool was started. Only the calling thread starts it, before it shares any task.
+	bool mParallel;
+	std::vector<Thread*> mPool;
+
+	/// Directories visited by the calling thread before the pool started
+	size_t mVisited;
+
+	std::vector<Results> mResults;
+
+	void startThreads();
+
+	/// Takes tasks from the queue until every thread is idle
+	void work( Results& results );
+
+	/// Registers the directory of fd, lists it and walks its subdirectories. Closes fd.
+	void visit( int fd, std::string& path, dev_t parentDevice, Results& results );
+
+	/// Walks the subdirectories of the directory of fd, sharing them while threads are idle
+	void walkChildren( int fd, std::string& path, dev_t device, Results& results );
+};
+
+} // namespace efsw
+
+#endif
+
+#endif
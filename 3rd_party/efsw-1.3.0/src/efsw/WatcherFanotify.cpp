@@ -0,0 +1,48 @@
+#include <efsw/WatcherFanotify.hpp>
+
+namespace efsw {
+
+WatcherFanotify::WatcherFanotify() : Watcher(), BatchListener( NULL ) {}
+
+WatcherFanotify::WatcherFanotify( WatchID id, std::string directory, FileWatchListener* listener,
+								  bool recursive ) :
+	Watcher( id, directory, listener, recursive ),
+	BatchListener( dynamic_cast<FileWatchBatchListener*>( listener ) ) {}
+
+bool WatcherFanotify::inScope( const std::string& directory ) const {
+	if ( !Recursive ) {
+		return directory == Directory;
+	}
+
+	if ( directory.size() < Directory.size() ||
+		 0 != directory.compare( 0, Directory.size(), Directory ) ) {
+		return false;
+	}
+
+	if ( NULL == Filter ) {
+		return true;
+	}
+
+	/// Every directory below the watch, each one ending with a slash
+	std::string name;
+
+	for ( size_t begin = Directory.size(); begin < directory.size(); ) {
+		size_t end = directory.find( '/', begin );
+
+		if ( std::string::npos == end ) {
+			end = directory.size();
+		}
+
+		name.assign( directory, begin, end - begin );
+
+		if ( Filter->excludes( name.c_str() ) ) {
+			return false;
+		}
+
+		begin = end + 1;
+	}
+
+	return true;
+}
+
+} // namespace efsw
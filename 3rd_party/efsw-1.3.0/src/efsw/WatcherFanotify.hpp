@@ -0,0 +1,35 @@
+#ifndef EFSW_WATCHERFANOTIFY_HPP
+#define EFSW_WATCHERFANOTIFY_HPP
+
+#include <efsw/FileNameFilter.hpp>
+#include <efsw/FileWatcherImpl.hpp>
+#include <memory>
+#include <vector>
+
+namespace efsw {
+
+class WatcherFanotify : public Watcher {
+  public:
+	WatcherFanotify();
+
+	WatcherFanotify( WatchID id, std::string directory, FileWatchListener* listener,
+					 bool recursive );
+
+	/// @return If events in the directory belong to this watch, i.e. it is the directory of the
+	/// watch or, for recursive ones, a subdirectory not excluded by the filter
+	bool inScope( const std::string& directory ) const;
+
+	/// The listener if it handles batches of events, else NULL
+	FileWatchBatchListener* BatchListener;
+
+	/// Ids of the marked file systems the watch holds a reference to. The first one is the file
+	/// system of Directory, then those mounted below it for recursive watches.
+	std::vector<Uint64> FileSystems;
+
+	/// NULL if every event is reported
+	std::shared_ptr<const FileNameFilter> Filter;
+};
+
+} // namespace efsw
+
+#endif
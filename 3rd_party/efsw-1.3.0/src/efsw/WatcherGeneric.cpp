@@ -19,7 +19,19 @@ WatcherGeneric::~WatcherGeneric() {
 }
 
 void WatcherGeneric::watch() {
-	DirWatch->watch();
+	scan();
+}
+
+bool WatcherGeneric::scan() {
+	std::vector<DirectorySnapshot*> snapshots;
+	collectSnapshots( snapshots );
+	DirectorySnapshot::prefetch( snapshots );
+
+	return DirWatch->watch();
+}
+
+void WatcherGeneric::collectSnapshots( std::vector<DirectorySnapshot*>& snapshots ) {
+	DirWatch->collectSnapshots( snapshots );
 }
 
 void WatcherGeneric::watchDir( std::string dir ) {
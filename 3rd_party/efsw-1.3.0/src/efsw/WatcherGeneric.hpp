@@ -2,10 +2,12 @@
 #define EFSW_WATCHERGENERIC_HPP
 
 #include <efsw/FileWatcherImpl.hpp>
+#include <vector>
 
 namespace efsw {
 
 class DirWatcherGeneric;
+class DirectorySnapshot;
 
 class WatcherGeneric : public Watcher {
   public:
@@ -19,6 +21,13 @@ class WatcherGeneric : public Watcher {
 
 	void watch();
 
+	/// Scans the directories for changes, stat'ing them in parallel first
+	/// @return If any event was reported
+	bool scan();
+
+	/// Appends the snapshots of every watched directory
+	void collectSnapshots( std::vector<DirectorySnapshot*>& snapshots );
+
 	void watchDir( std::string dir );
 
 	bool pathInWatches( std::string path );
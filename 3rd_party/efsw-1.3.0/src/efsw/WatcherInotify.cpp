@@ -2,11 +2,16 @@
 
 namespace efsw {
 
-WatcherInotify::WatcherInotify() : Watcher(), Parent( NULL ) {}
+WatcherInotify::WatcherInotify() :
+	Watcher(), Parent( NULL ), BatchListener( NULL ), ChildIndex( 0 ) {}
 
 WatcherInotify::WatcherInotify( WatchID id, std::string directory, FileWatchListener* listener,
 								bool recursive, WatcherInotify* parent ) :
-	Watcher( id, directory, listener, recursive ), Parent( parent ), DirInfo( directory ) {}
+	Watcher( id, directory, listener, recursive ),
+	Parent( parent ),
+	BatchListener( dynamic_cast<FileWatchBatchListener*>( listener ) ),
+	ChildIndex( 0 ),
+	DirInfo( directory ) {}
 
 bool WatcherInotify::inParentTree( WatcherInotify* parent ) {
 	WatcherInotify* tNext = Parent;
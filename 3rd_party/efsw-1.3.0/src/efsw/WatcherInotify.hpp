@@ -2,7 +2,10 @@
 #define EFSW_WATCHERINOTIFY_HPP
 
 #include <efsw/FileInfo.hpp>
+#include <efsw/FileNameFilter.hpp>
 #include <efsw/FileWatcherImpl.hpp>
+#include <memory>
+#include <vector>
 
 namespace efsw {
 
@@ -18,6 +21,18 @@ class WatcherInotify : public Watcher {
 	WatcherInotify* Parent;
 	WatchID InotifyID;
 
+	/// The listener if it handles batches of events, else NULL
+	FileWatchBatchListener* BatchListener;
+
+	/// Watches of the subdirectories, kept by FileWatcherInotify
+	std::vector<WatcherInotify*> Children;
+
+	/// Position in the Children of the Parent
+	size_t ChildIndex;
+
+	/// The filter of the watch added by the user, shared by its subdirectories. NULL if none.
+	std::shared_ptr<const FileNameFilter> Filter;
+
 	FileInfo DirInfo;
 };
 
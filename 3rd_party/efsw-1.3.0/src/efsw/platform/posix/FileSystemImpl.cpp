@@ -184,6 +184,26 @@ FileInfoMap FileSystem::filesInfoFromPath( const std::string& path ) {
 	return files;
 }
 
+std::vector<std::string> FileSystem::fileNamesFromPath( const std::string& path ) {
+	std::vector<std::string> names;
+
+	DIR* dp;
+	struct dirent* dirp;
+
+	if ( ( dp = opendir( path.c_str() ) ) == NULL )
+		return names;
+
+	while ( ( dirp = readdir( dp ) ) != NULL ) {
+		if ( strcmp( dirp->d_name, ".." ) != 0 && strcmp( dirp->d_name, "." ) != 0 ) {
+			names.push_back( std::string( dirp->d_name ) );
+		}
+	}
+
+	closedir( dp );
+
+	return names;
+}
+
 char FileSystem::getOSSlash() {
 	return '/';
 }
@@ -3,6 +3,7 @@
 
 #include <efsw/FileInfo.hpp>
 #include <efsw/base.hpp>
+#include <vector>
 
 #if defined( EFSW_PLATFORM_POSIX )
 
@@ -12,6 +13,8 @@ class FileSystem {
   public:
 	static FileInfoMap filesInfoFromPath( const std::string& path );
 
+	static std::vector<std::string> fileNamesFromPath( const std::string& path );
+
 	static char getOSSlash();
 
 	static bool isDirectory( const std::string& path );
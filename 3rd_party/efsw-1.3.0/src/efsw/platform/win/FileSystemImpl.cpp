@@ -84,6 +84,35 @@ FileInfoMap FileSystem::filesInfoFromPath( const std::string& path ) {
 	return files;
 }
 
+std::vector<std::string> FileSystem::fileNamesFromPath( const std::string& path ) {
+	std::vector<std::string> names;
+
+	String tpath( path );
+
+	if ( tpath[tpath.size() - 1] == '/' || tpath[tpath.size() - 1] == '\\' ) {
+		tpath += "*";
+	} else {
+		tpath += "\\*";
+	}
+
+	WIN32_FIND_DATAW findFileData;
+	HANDLE hFind = FindFirstFileW( (LPCWSTR)tpath.toWideString().c_str(), &findFileData );
+
+	if ( hFind != INVALID_HANDLE_VALUE ) {
+		do {
+			std::string name( String( findFileData.cFileName ).toUtf8() );
+
+			if ( name != "." && name != ".." ) {
+				names.push_back( name );
+			}
+		} while ( FindNextFileW( hFind, &findFileData ) );
+
+		FindClose( hFind );
+	}
+
+	return names;
+}
+
 char FileSystem::getOSSlash() {
 	return '\\';
 }
@@ -4,6 +4,7 @@
 #include <efsw/FileInfo.hpp>
 #include <efsw/String.hpp>
 #include <efsw/base.hpp>
+#include <vector>
 
 #if EFSW_PLATFORM == EFSW_PLATFORM_WIN32
 
@@ -13,6 +14,8 @@ class FileSystem {
   public:
 	static FileInfoMap filesInfoFromPath( const std::string& path );
 
+	static std::vector<std::string> fileNamesFromPath( const std::string& path );
+
 	static char getOSSlash();
 
 	static bool isDirectory( const std::string& path );
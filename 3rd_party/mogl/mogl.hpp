@@ -23,6 +23,7 @@
 #include <mogl/object/buffer/arraybuffer.hpp>
 #include <mogl/object/buffer/atomiccounterbuffer.hpp>
 #include <mogl/object/buffer/elementarraybuffer.hpp>
+#include <mogl/object/buffer/pixelpackbuffer.hpp>
 #include <mogl/object/buffer/shaderstoragebuffer.hpp>
 #include <mogl/object/buffer/transformfeedbackbuffer.hpp>
 #include <mogl/object/buffer/uniformbuffer.hpp>
@@ -34,6 +35,7 @@
 #include <mogl/object/shader/programpipeline.hpp>
 #include <mogl/object/shader/shader.hpp>
 #include <mogl/object/shader/shaderprogram.hpp>
+#include <mogl/object/shader/uniformhandle.hpp>
 #include <mogl/object/texture.hpp>
 #include <mogl/object/transformfeedback.hpp>
 #include <mogl/object/vertexarray.hpp>
@@ -0,0 +1,36 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Modern OpenGL Wrapper
+///
+/// Copyright (c) 2015 Thibault Schueller
+/// This file is distributed under the MIT License
+///
+/// @file pixelpackbuffer.hpp
+/// @author Thibault Schueller <ryp.sqrt@gmail.com>
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MOGL_PIXELPACKBUFFER_INCLUDED
+#define MOGL_PIXELPACKBUFFER_INCLUDED
+
+#include <mogl/object/buffer/buffer.hpp>
+
+namespace mogl
+{
+    class PixelPackBuffer : public Buffer
+    {
+    public:
+        PixelPackBuffer() : Buffer(GL_PIXEL_PACK_BUFFER) {}
+        ~PixelPackBuffer() = default;
+
+        PixelPackBuffer(const PixelPackBuffer& other) = delete;
+        PixelPackBuffer& operator=(const PixelPackBuffer& other) = delete;
+
+        PixelPackBuffer(PixelPackBuffer&& other) = default;
+
+    public:
+        using Buffer::bind;
+    };
+
+    using PBO = PixelPackBuffer;
+}
+
+#endif // MOGL_PIXELPACKBUFFER_INCLUDED
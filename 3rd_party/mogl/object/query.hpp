@@ -31,6 +31,7 @@ namespace mogl
     public:
         void    begin();
         void    end();
+        void    queryCounter(); // Records a GL_TIMESTAMP query, no begin() needed
         template <class T> void get(GLenum property, T* value); // Direct call to glGetQuery*v()
         template <class T> T    get(GLenum property);
         GLenum  getType() const;
@@ -33,6 +33,11 @@ namespace mogl
         glEndQuery(_type);
     }
 
+    inline void Query::queryCounter()
+    {
+        glQueryCounter(_handle, GL_TIMESTAMP);
+    }
+
     /*
      * Templated accessors definitions (direct call)
      */
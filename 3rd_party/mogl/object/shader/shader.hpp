@@ -15,6 +15,11 @@
 
 #include <mogl/object/handle.hpp>
 
+// GL_KHR_parallel_shader_compile, not part of the core loader
+#ifndef GL_COMPLETION_STATUS_KHR
+# define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
 namespace mogl
 {
     class Shader : public Handle<GLuint>
@@ -27,6 +32,7 @@ namespace mogl
         Shader& operator=(const Shader& other) = delete;
 
     public:
+        void                beginCompile(const std::string& source); // Does not wait for the driver
         bool                compile(const std::string& source);
         bool                compile(std::istream& sourceFile);
         const std::string   getSource() const;
@@ -35,6 +41,7 @@ namespace mogl
         void                get(GLenum property, GLint* value) const; // Direct call to glGetShaderiv()
         GLint               get(GLenum property) const;
         bool                isCompiled() const;
+        bool                isCompletionReady() const; // Needs GL_KHR_parallel_shader_compile
         bool                isValid() const override final;
 
     private:
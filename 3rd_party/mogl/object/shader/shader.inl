@@ -26,12 +26,17 @@ namespace mogl
             glDeleteShader(_handle);
     }
 
-    inline bool Shader::compile(const std::string& source)
+    inline void Shader::beginCompile(const std::string& source)
     {
         char const* srcPtr = source.c_str();
 
         glShaderSource(_handle, 1, &srcPtr, 0);
         glCompileShader(_handle);
+    }
+
+    inline bool Shader::compile(const std::string& source)
+    {
+        beginCompile(source);
         return isCompiled();
     }
 
@@ -83,6 +88,11 @@ namespace mogl
         return get(GL_COMPILE_STATUS) == static_cast<GLint>(GL_TRUE);
     }
 
+    inline bool Shader::isCompletionReady() const
+    {
+        return get(GL_COMPLETION_STATUS_KHR) == static_cast<GLint>(GL_TRUE);
+    }
+
     inline bool Shader::isValid() const
     {
         return glIsShader(_handle) == GL_TRUE;
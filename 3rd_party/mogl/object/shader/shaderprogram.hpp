@@ -12,6 +12,7 @@
 #define MOGL_SHADERPROGRAM_INCLUDED
 
 #include <map>
+#include <vector>
 
 #include <mogl/object/handle.hpp>
 #include <mogl/object/shader/shader.hpp>
@@ -31,6 +32,8 @@ namespace mogl
         void                attach(const Shader& object);
         void                detach(const Shader& object);
         void                bindAttribLocation(GLuint location, const std::string& attribute);
+        void                beginLink(); // Does not wait for the driver
+        bool                endLink();
         bool                link();
         void                use();
         const std::string&  getLog() const;
@@ -39,6 +42,8 @@ namespace mogl
         void                setTransformFeedbackVaryings(GLsizei count,
                                                          const char** varyings,
                                                          GLenum bufferMode);
+        std::vector<GLubyte> getBinary(GLenum* format);
+        void                setBinary(GLenum format, const void* binary, GLsizei length); // Follow with endLink()
 
     public:
         void    setVertexAttribPointer(GLuint location,
@@ -74,6 +79,8 @@ namespace mogl
         void    get(GLenum property, GLint* value); // Direct call to glGetProgramiv()
         GLint   get(GLenum property);
         void    set(GLenum property, GLint value);
+        bool    isCompletionReady(); // Needs GL_KHR_parallel_shader_compile
+        GLuint  getLinkId() const; // Unique per successful link, 0 if never linked
         bool    isValid() const override final;
 
     private:
@@ -90,6 +97,7 @@ namespace mogl
         using ShaderSubroutineMap = std::map<GLenum, SubroutineMap>;
 
         std::string         _log;
+        GLuint              _linkId = 0;
         HandleMap           _attribs;
         HandleMap           _uniforms;
         ShaderSubroutineMap _subroutines;
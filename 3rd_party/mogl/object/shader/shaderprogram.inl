@@ -13,9 +13,19 @@
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <atomic>
 
 namespace mogl
 {
+    namespace detail
+    {
+        inline GLuint nextLinkId()
+        {
+            static std::atomic<GLuint> linkId(0);
+            return ++linkId;
+        }
+    }
+
     inline ShaderProgram::ShaderProgram()
     :   Handle(GL_PROGRAM)
     {
@@ -43,11 +53,15 @@ namespace mogl
         glBindAttribLocation(_handle, location, attribute.c_str());
     }
 
-    inline bool ShaderProgram::link()
+    inline void ShaderProgram::beginLink()
+    {
+        glLinkProgram(_handle);
+    }
+
+    inline bool ShaderProgram::endLink()
     {
         GLint       logLength = 0;
 
-        glLinkProgram(_handle);
         if (get(GL_LINK_STATUS) == static_cast<GLint>(GL_FALSE))
         {
             logLength = get(GL_INFO_LOG_LENGTH);
@@ -61,6 +75,7 @@ namespace mogl
             return false;
         }
         _log = std::string();
+        _linkId = detail::nextLinkId();
         retrieveLocations();
         // NOTE can be improved
         retrieveSubroutines(GL_VERTEX_SHADER);
@@ -72,6 +87,12 @@ namespace mogl
         return true;
     }
 
+    inline bool ShaderProgram::link()
+    {
+        beginLink();
+        return endLink();
+    }
+
     inline void ShaderProgram::use()
     {
         glUseProgram(_handle);
@@ -107,6 +128,22 @@ namespace mogl
         glTransformFeedbackVaryings(_handle, count, varyings, bufferMode);
     }
 
+    inline std::vector<GLubyte> ShaderProgram::getBinary(GLenum* format)
+    {
+        GLint                   length = get(GL_PROGRAM_BINARY_LENGTH);
+        std::vector<GLubyte>    binary(length);
+
+        if (length > 0)
+            glGetProgramBinary(_handle, length, &length, format, &binary[0]);
+        binary.resize(length);
+        return binary;
+    }
+
+    inline void ShaderProgram::setBinary(GLenum format, const void* binary, GLsizei length)
+    {
+        glProgramBinary(_handle, format, binary, length);
+    }
+
     inline void ShaderProgram::printDebug()
     {
         std::cout << "Attributes:" << std::endl;
@@ -144,6 +181,16 @@ namespace mogl
         glProgramParameteri(_handle, property, value);
     }
 
+    inline bool ShaderProgram::isCompletionReady()
+    {
+        return get(GL_COMPLETION_STATUS_KHR) == static_cast<GLint>(GL_TRUE);
+    }
+
+    inline GLuint ShaderProgram::getLinkId() const
+    {
+        return _linkId;
+    }
+
     inline bool ShaderProgram::isValid() const
     {
         return glIsProgram(_handle) == GL_TRUE;
@@ -0,0 +1,51 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Modern OpenGL Wrapper
+///
+/// Copyright (c) 2015 Thibault Schueller
+/// This file is distributed under the MIT License
+///
+/// @file uniformhandle.hpp
+/// @author Thibault Schueller <ryp.sqrt@gmail.com>
+///
+/// @brief Typed uniform location cache. The name must be a string literal,
+/// it is never copied. The location is resolved on first use and again only
+/// when the program has been relinked, so setting a value does no string
+/// hashing, comparison or allocation.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MOGL_UNIFORMHANDLE_INCLUDED
+#define MOGL_UNIFORMHANDLE_INCLUDED
+
+#include <cstddef>
+
+#include <mogl/object/shader/shaderprogram.hpp>
+
+namespace mogl
+{
+    template <class T>
+    class UniformHandle
+    {
+    public:
+        template <std::size_t N>
+        constexpr UniformHandle(const char (&name)[N]);
+
+    public:
+        void        set(const ShaderProgram& program, T v1);
+        void        set(const ShaderProgram& program, T v1, T v2);
+        void        set(const ShaderProgram& program, T v1, T v2, T v3);
+        void        set(const ShaderProgram& program, T v1, T v2, T v3, T v4);
+        template <std::size_t Size>
+        void        setPtr(const ShaderProgram& program, const T* ptr, GLsizei count = 1);
+        GLint       getLocation(const ShaderProgram& program);
+        const char* getName() const;
+
+    private:
+        const char* _name;
+        GLint       _location;
+        GLuint      _linkId;
+    };
+}
+
+#include "uniformhandle.inl"
+
+#endif // MOGL_UNIFORMHANDLE_INCLUDED
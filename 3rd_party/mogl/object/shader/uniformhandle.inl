@@ -0,0 +1,217 @@
+////////////////////////////////////////////////////////////////////////////////
+/// Modern OpenGL Wrapper
+///
+/// Copyright (c) 2015 Thibault Schueller
+/// This file is distributed under the MIT License
+///
+/// @file uniformhandle.inl
+/// @author Thibault Schueller <ryp.sqrt@gmail.com>
+////////////////////////////////////////////////////////////////////////////////
+
+namespace mogl
+{
+    template <class T>
+    template <std::size_t N>
+    inline constexpr UniformHandle<T>::UniformHandle(const char (&name)[N])
+    :   _name(name),
+        _location(-1),
+        _linkId(0)
+    {}
+
+    template <class T>
+    inline GLint UniformHandle<T>::getLocation(const ShaderProgram& program)
+    {
+        if (_linkId != program.getLinkId())
+        {
+            _location = glGetUniformLocation(program.getHandle(), _name);
+            _linkId = program.getLinkId();
+        }
+        return _location;
+    }
+
+    template <class T>
+    inline const char* UniformHandle<T>::getName() const
+    {
+        return _name;
+    }
+
+    /*
+     * GLfloat uniform specialization
+     */
+
+    template <>
+    inline void UniformHandle<GLfloat>::set(const ShaderProgram& program, GLfloat v1)
+    {
+        glProgramUniform1f(program.getHandle(), getLocation(program), v1);
+    }
+
+    template <>
+    inline void UniformHandle<GLfloat>::set(const ShaderProgram& program, GLfloat v1, GLfloat v2)
+    {
+        glProgramUniform2f(program.getHandle(), getLocation(program), v1, v2);
+    }
+
+    template <>
+    inline void UniformHandle<GLfloat>::set(const ShaderProgram& program, GLfloat v1, GLfloat v2, GLfloat v3)
+    {
+        glProgramUniform3f(program.getHandle(), getLocation(program), v1, v2, v3);
+    }
+
+    template <>
+    inline void UniformHandle<GLfloat>::set(const ShaderProgram& program, GLfloat v1, GLfloat v2, GLfloat v3, GLfloat v4)
+    {
+        glProgramUniform4f(program.getHandle(), getLocation(program), v1, v2, v3, v4);
+    }
+
+    /*
+     * GLint uniform specialization
+     */
+
+    template <>
+    inline void UniformHandle<GLint>::set(const ShaderProgram& program, GLint v1)
+    {
+        glProgramUniform1i(program.getHandle(), getLocation(program), v1);
+    }
+
+    template <>
+    inline void UniformHandle<GLint>::set(const ShaderProgram& program, GLint v1, GLint v2)
+    {
+        glProgramUniform2i(program.getHandle(), getLocation(program), v1, v2);
+    }
+
+    template <>
+    inline void UniformHandle<GLint>::set(const ShaderProgram& program, GLint v1, GLint v2, GLint v3)
+    {
+        glProgramUniform3i(program.getHandle(), getLocation(program), v1, v2, v3);
+    }
+
+    template <>
+    inline void UniformHandle<GLint>::set(const ShaderProgram& program, GLint v1, GLint v2, GLint v3, GLint v4)
+    {
+        glProgramUniform4i(program.getHandle(), getLocation(program), v1, v2, v3, v4);
+    }
+
+    /*
+     * GLuint uniform specialization
+     */
+
+    template <>
+    inline void UniformHandle<GLuint>::set(const ShaderProgram& program, GLuint v1)
+    {
+        glProgramUniform1ui(program.getHandle(), getLocation(program), v1);
+    }
+
+    template <>
+    inline void UniformHandle<GLuint>::set(const ShaderProgram& program, GLuint v1, GLuint v2)
+    {
+        glProgramUniform2ui(program.getHandle(), getLocation(program), v1, v2);
+    }
+
+    template <>
+    inline void UniformHandle<GLuint>::set(const ShaderProgram& program, GLuint v1, GLuint v2, GLuint v3)
+    {
+        glProgramUniform3ui(program.getHandle(), getLocation(program), v1, v2, v3);
+    }
+
+    template <>
+    inline void UniformHandle<GLuint>::set(const ShaderProgram& program, GLuint v1, GLuint v2, GLuint v3, GLuint v4)
+    {
+        glProgramUniform4ui(program.getHandle(), getLocation(program), v1, v2, v3, v4);
+    }
+
+    /*
+     * GLfloat uniform array specialization
+     */
+
+    template <>
+    template <>
+    inline void UniformHandle<GLfloat>::setPtr<1>(const ShaderProgram& program, const GLfloat* ptr, GLsizei count)
+    {
+        glProgramUniform1fv(program.getHandle(), getLocation(program), count, ptr);
+    }
+
+    template <>
+    template <>
+    inline void UniformHandle<GLfloat>::setPtr<2>(const ShaderProgram& program, const GLfloat* ptr, GLsizei count)
+    {
+        glProgramUniform2fv(program.getHandle(), getLocation(program), count, ptr);
+    }
+
+    template <>
+    template <>
+    inline void UniformHandle<GLfloat>::setPtr<3>(const ShaderProgram& program, const GLfloat* ptr, GLsizei count)
+    {
+        glProgramUniform3fv(program.getHandle(), getLocation(program), count, ptr);
+    }
+
+    template <>
+    template <>
+    inline void UniformHandle<GLfloat>::setPtr<4>(const ShaderProgram& program, const GLfloat* ptr, GLsizei count)
+    {
+        glProgramUniform4fv(program.getHandle(), getLocation(program), count, ptr);
+    }
+
+    /*
+     * GLint uniform array specialization
+     */
+
+    template <>
+    template <>
+    inline void UniformHandle<GLint>::setPtr<1>(const ShaderProgram& program, const GLint* ptr, GLsizei count)
+    {
+        glProgramUniform1iv(program.getHandle(), getLocation(program), count, ptr);
+    }
+
+    template <>
+    template <>
+    inline void UniformHandle<GLint>::setPtr<2>(const ShaderProgram& program, const GLint* ptr, GLsizei count)
+    {
+        glProgramUniform2iv(program.getHandle(), getLocation(program), count, ptr);
+    }
+
+    template <>
+    template <>
+    inline void UniformHandle<GLint>::setPtr<3>(const ShaderProgram& program, const GLint* ptr, GLsizei count)
+    {
+        glProgramUniform3iv(program.getHandle(), getLocation(program), count, ptr);
+    }
+
+    template <>
+    template <>
+    inline void UniformHandle<GLint>::setPtr<4>(const ShaderProgram& program, const GLint* ptr, GLsizei count)
+    {
+        glProgramUniform4iv(program.getHandle(), getLocation(program), count, ptr);
+    }
+
+    /*
+     * GLuint uniform array specialization
+     */
+
+    template <>
+    template <>
+    inline void UniformHandle<GLuint>::setPtr<1>(const ShaderProgram& program, const GLuint* ptr, GLsizei count)
+    {
+        glProgramUniform1uiv(program.getHandle(), getLocation(program), count, ptr);
+    }
+
+    template <>
+    template <>
+    inline void UniformHandle<GLuint>::setPtr<2>(const ShaderProgram& program, const GLuint* ptr, GLsizei count)
+    {
+        glProgramUniform2uiv(program.getHandle(), getLocation(program), count, ptr);
+    }
+
+    template <>
+    template <>
+    inline void UniformHandle<GLuint>::setPtr<3>(const ShaderProgram& program, const GLuint* ptr, GLsizei count)
+    {
+        glProgramUniform3uiv(program.getHandle(), getLocation(program), count, ptr);
+    }
+
+    template <>
+    template <>
+    inline void UniformHandle<GLuint>::setPtr<4>(const ShaderProgram& program, const GLuint* ptr, GLsizei count)
+    {
+        glProgramUniform4uiv(program.getHandle(), getLocation(program), count, ptr);
+    }
+}
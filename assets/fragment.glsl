@@ -1,6 +1,17 @@
 #version 460 core
 
-uniform float Time;
+// redraw every frame even when sky_contest runs with --frame-mode on-demand
+#pragma animated
+
+layout (std140, binding = 0) uniform FrameParams {
+	float Time;
+	float TimeDelta;
+	int Frame;
+	vec2 Resolution;
+	vec2 Jitter; // uv offset of the pixel subset in temporal mode, already applied to uv
+	vec4 Mouse; // xy - cursor in pixels, zw - left/right button down
+	vec4 SubViewport; // uv offset and scale of the tile being exported, already applied to uv
+};
 
 layout (location=0) in vec2 uv;
 out vec4 out_color;
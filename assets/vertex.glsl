@@ -3,8 +3,18 @@
 layout (location=0) in vec2 in_pos;
 layout (location=0) out vec2 out_uv;
 
+layout (std140, binding = 0) uniform FrameParams {
+	float Time;
+	float TimeDelta;
+	int Frame;
+	vec2 Resolution;
+	vec2 Jitter;
+	vec4 Mouse;
+	vec4 SubViewport;
+};
+
 void main()
 {
-	out_uv = in_pos / 2 + 0.5;
+	out_uv = (in_pos / 2 + 0.5) * SubViewport.zw + SubViewport.xy + Jitter;
 	gl_Position = vec4(in_pos, 0.0, 1.0);
 }
@@ -0,0 +1,127 @@
+#include "dynamic_resolution.hpp"
+#include "shader_compiler.hpp"
+#include "trace.hpp"
+
+#include <imgui.h>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const float headroom = 0.75f;
+const float scale_step = 0.05f;
+// longer than the GpuProfiler latency, so the measurement belongs to the current scale
+const int settle_frames = 10;
+
+// bilinear upscale followed by an unsharp mask in source texels, clamped to the
+// neighbourhood so sharpening doesn't ring around edges
+const char* const upscale_fragment_source = R"(#version 460 core
+layout (location=0) in vec2 uv;
+out vec4 out_color;
+uniform sampler2D Source;
+uniform float Sharpness;
+void main()
+{
+	vec2 texel = 1.0 / vec2(textureSize(Source, 0));
+	vec3 c = texture(Source, uv).rgb;
+	vec3 n = texture(Source, uv + vec2(0.0, texel.y)).rgb;
+	vec3 s = texture(Source, uv - vec2(0.0, texel.y)).rgb;
+	vec3 e = texture(Source, uv + vec2(texel.x, 0.0)).rgb;
+	vec3 w = texture(Source, uv - vec2(texel.x, 0.0)).rgb;
+	vec3 lo = min(c, min(min(n, s), min(e, w)));
+	vec3 hi = max(c, max(max(n, s), max(e, w)));
+	vec3 sharpened = c + Sharpness * (c - 0.25 * (n + s + e + w));
+	out_color = vec4(clamp(sharpened, lo, hi), 1.0);
+}
+)";
+
+}
+
+DynamicResolution::DynamicResolution()
+	: upscale_program(CompileProgram(fullscreen_vertex_source, upscale_fragment_source))
+{
+	upscale_program.setUniform<GLint>("Source", 0);
+}
+
+float DynamicResolution::getScale() const
+{
+	return enabled ? scale : 1.f;
+}
+
+void DynamicResolution::render(int width, int height, const std::function<void(int width, int height)>& draw_scene)
+{
+	int scaled_width = std::max(1, (int)std::lround(width * getScale()));
+	int scaled_height = std::max(1, (int)std::lround(height * getScale()));
+	if (scaled_width == width && scaled_height == height) {
+		draw_scene(width, height);
+		return;
+	}
+
+	if (scaled_width != target_width || scaled_height != target_height) {
+		TRACE_SCOPE("DynamicResolution::allocate");
+		target_width = scaled_width;
+		target_height = scaled_height;
+		target = std::make_unique<mogl::Texture>(GL_TEXTURE_2D);
+		target->setStorage2D(1, GL_RGBA8, target_width, target_height);
+		target->set<GLint>(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		target->set<GLint>(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		target->set<GLint>(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		target->set<GLint>(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		frame_buffer.setTexture(GL_COLOR_ATTACHMENT0, *target);
+	}
+
+	GLint output_frame_buffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &output_frame_buffer);
+	frame_buffer.bind(GL_DRAW_FRAMEBUFFER);
+	glViewport(0, 0, target_width, target_height);
+	draw_scene(target_width, target_height);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, output_frame_buffer);
+	upscale(width, height);
+}
+
+void DynamicResolution::upscale(int width, int height)
+{
+	TRACE_SCOPE("DynamicResolution::upscale");
+	glViewport(0, 0, width, height);
+	sharpness_uniform.set(upscale_program, sharpness);
+	upscale_program.use();
+	target->bind(0);
+	glDisable(GL_DEPTH_TEST);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void DynamicResolution::update(std::optional<float> scene_ms)
+{
+	if (!enabled || !scene_ms || *scene_ms <= 0) {
+		return;
+	}
+	if (++frames_since_change < settle_frames) {
+		return;
+	}
+	if (*scene_ms <= budget_ms && *scene_ms >= budget_ms * headroom) {
+		return;
+	}
+
+	// aim for the middle of the band
+	float target_ms = budget_ms * (1.f + headroom) * 0.5f;
+	float target_scale = scale * std::sqrt(target_ms / *scene_ms);
+	target_scale = std::round(target_scale / scale_step) * scale_step;
+	target_scale = std::clamp(target_scale, min_scale, 1.f);
+	if (target_scale != scale) {
+		scale = target_scale;
+		frames_since_change = 0;
+	}
+}
+
+void DynamicResolution::drawControls()
+{
+	ImGui::Checkbox("Dynamic resolution", &enabled);
+	if (!enabled) {
+		return;
+	}
+	ImGui::SliderFloat("GPU budget", &budget_ms, 1.f, 50.f, "%.1f ms");
+	ImGui::SliderFloat("Min scale", &min_scale, 0.1f, 1.f, "%.2f");
+	ImGui::SliderFloat("Sharpness", &sharpness, 0.f, 1.f, "%.2f");
+	ImGui::Text("Resolution scale %.2f", scale);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <mogl/mogl.hpp>
+#include <functional>
+#include <memory>
+#include <optional>
+
+// Renders the scene into an offscreen texture at a fraction of the window resolution
+// and upscales it with a sharpening filter. The scale follows the GPU time of the scene
+// towards budget_ms: fill-rate bound shaders cost roughly scale^2, so the controller
+// jumps straight to the scale that should fit, rounded to scale_step. It only reacts
+// when the time leaves the band between headroom * budget_ms and budget_ms and waits
+// until the timer queries of the new scale come back, so the scale doesn't oscillate.
+class DynamicResolution
+{
+public:
+	bool enabled = false;
+	float budget_ms = 8.f;
+	float min_scale = 0.25f;
+	float sharpness = 0.5f;
+
+	DynamicResolution();
+
+	// draw_scene renders at the given size into the bound framebuffer,
+	// the result ends up in the framebuffer that was bound at the call
+	void render(int width, int height, const std::function<void(int width, int height)>& draw_scene);
+
+	// Feeds the latest GPU time of draw_scene in milliseconds
+	void update(std::optional<float> scene_ms);
+
+	float getScale() const;
+
+	// Must be called inside an ImGui window
+	void drawControls();
+
+private:
+	void upscale(int width, int height);
+
+	float scale = 1.f;
+	int frames_since_change = 0;
+	int target_width = 0;
+	int target_height = 0;
+	std::unique_ptr<mogl::Texture> target;
+	mogl::FrameBuffer frame_buffer;
+	mogl::ShaderProgram upscale_program;
+	mogl::UniformHandle<GLfloat> sharpness_uniform {"Sharpness"};
+};
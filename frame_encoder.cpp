@@ -0,0 +1,293 @@
+#include "frame_encoder.hpp"
+#include "trace.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#ifdef SKY_CONTEST_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void AppendBigEndian(std::vector<uint8_t>& out, uint32_t value)
+{
+	for (int shift = 24; shift >= 0; shift -= 8) {
+		out.push_back((uint8_t)(value >> shift));
+	}
+}
+
+void AppendText(std::vector<uint8_t>& out, const std::string& text)
+{
+	out.insert(out.end(), text.begin(), text.end());
+}
+
+std::vector<uint8_t> EncodePPM(const Frame& frame)
+{
+	std::vector<uint8_t> out;
+	AppendText(out, "P6\n" + std::to_string(frame.width) + " " + std::to_string(frame.height) + "\n255\n");
+	const size_t row_size = (size_t)frame.width * 3;
+	for (int y = frame.height - 1; y >= 0; --y) {
+		const uint8_t* row = frame.pixels.data() + y * row_size;
+		out.insert(out.end(), row, row + row_size);
+	}
+	return out;
+}
+
+std::vector<uint8_t> EncodeTGA(const Frame& frame)
+{
+	// uncompressed true colour, bottom-left origin
+	std::vector<uint8_t> out = {0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		(uint8_t)frame.width, (uint8_t)(frame.width >> 8),
+		(uint8_t)frame.height, (uint8_t)(frame.height >> 8),
+		24, 0};
+	size_t header_size = out.size();
+	out.resize(header_size + frame.pixels.size());
+	uint8_t* bgr = out.data() + header_size;
+	for (size_t i = 0; i < frame.pixels.size(); i += 3) {
+		bgr[i] = frame.pixels[i + 2];
+		bgr[i + 1] = frame.pixels[i + 1];
+		bgr[i + 2] = frame.pixels[i];
+	}
+	return out;
+}
+
+std::vector<uint8_t> EncodePFM(const Frame& frame)
+{
+	// bottom-up rows, a negative scale means little endian
+	std::vector<uint8_t> out;
+	AppendText(out, "PF\n" + std::to_string(frame.width) + " " + std::to_string(frame.height) + "\n-1.0\n");
+	out.insert(out.end(), frame.pixels.begin(), frame.pixels.end());
+	return out;
+}
+
+// https://qoiformat.org/qoi-specification.pdf
+std::vector<uint8_t> EncodeQOI(const Frame& frame)
+{
+	const uint8_t op_index = 0x00;
+	const uint8_t op_diff = 0x40;
+	const uint8_t op_luma = 0x80;
+	const uint8_t op_run = 0xc0;
+	const uint8_t op_rgb = 0xfe;
+
+	std::vector<uint8_t> out = {'q', 'o', 'i', 'f'};
+	AppendBigEndian(out, frame.width);
+	AppendBigEndian(out, frame.height);
+	out.push_back(3); // RGB
+	out.push_back(0); // sRGB with linear alpha
+	// worst case is an op_rgb per pixel
+	out.reserve(out.size() + frame.pixels.size() / 3 * 4 + 8);
+
+	uint32_t index[64] = {};
+	uint8_t previous[3] = {0, 0, 0};
+	int run = 0;
+	const size_t row_size = (size_t)frame.width * 3;
+	for (int y = frame.height - 1; y >= 0; --y) {
+		const uint8_t* row = frame.pixels.data() + y * row_size;
+		for (int x = 0; x < frame.width; ++x) {
+			const uint8_t* pixel = row + x * 3;
+			if (pixel[0] == previous[0] && pixel[1] == previous[1] && pixel[2] == previous[2]) {
+				if (++run == 62) {
+					out.push_back(op_run | (run - 1));
+					run = 0;
+				}
+				continue;
+			}
+			if (run > 0) {
+				out.push_back(op_run | (run - 1));
+				run = 0;
+			}
+
+			// alpha is always 255
+			uint32_t packed = pixel[0] | pixel[1] << 8 | pixel[2] << 16 | 0xffu << 24;
+			int hash = (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + 255 * 11) % 64;
+			if (index[hash] == packed) {
+				out.push_back(op_index | hash);
+			} else {
+				index[hash] = packed;
+				int dr = (int8_t)(pixel[0] - previous[0]);
+				int dg = (int8_t)(pixel[1] - previous[1]);
+				int db = (int8_t)(pixel[2] - previous[2]);
+				int dr_dg = dr - dg;
+				int db_dg = db - dg;
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+					out.push_back(op_diff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+				} else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+					out.push_back(op_luma | (dg + 32));
+					out.push_back((dr_dg + 8) << 4 | (db_dg + 8));
+				} else {
+					out.insert(out.end(), {op_rgb, pixel[0], pixel[1], pixel[2]});
+				}
+			}
+			std::memcpy(previous, pixel, 3);
+		}
+	}
+	if (run > 0) {
+		out.push_back(op_run | (run - 1));
+	}
+	out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+	return out;
+}
+
+#ifdef SKY_CONTEST_ZLIB
+void AppendChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size)
+{
+	AppendBigEndian(out, (uint32_t)size);
+	out.insert(out.end(), type, type + 4);
+	uLong crc = crc32(0, (const Bytef*)type, 4);
+	// crc32() with a null buffer returns the initial value instead of crc
+	if (size) {
+		out.insert(out.end(), data, data + size);
+		crc = crc32(crc, data, (uInt)size);
+	}
+	AppendBigEndian(out, (uint32_t)crc);
+}
+
+std::vector<uint8_t> EncodePNG(const Frame& frame, int level)
+{
+	// Sub filter on every row, the best tradeoff for speed on smooth shader output
+	const size_t row_size = (size_t)frame.width * 3;
+	std::vector<uint8_t> filtered(frame.height * (row_size + 1));
+	for (int y = 0; y < frame.height; ++y) {
+		const uint8_t* in = frame.pixels.data() + (frame.height - 1 - y) * row_size;
+		uint8_t* out = filtered.data() + y * (row_size + 1);
+		*out++ = 1;
+		for (size_t i = 0; i < row_size; ++i) {
+			out[i] = i < 3 ? in[i] : (uint8_t)(in[i] - in[i - 3]);
+		}
+	}
+	uLongf compressed_size = compressBound((uLong)filtered.size());
+	std::vector<uint8_t> compressed(compressed_size);
+	if (compress2(compressed.data(), &compressed_size, filtered.data(), (uLong)filtered.size(), level) != Z_OK) {
+		throw std::runtime_error("zlib compression failed");
+	}
+
+	std::vector<uint8_t> out = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	std::vector<uint8_t> header;
+	AppendBigEndian(header, frame.width);
+	AppendBigEndian(header, frame.height);
+	header.insert(header.end(), {8, 2, 0, 0, 0}); // 8 bit RGB, deflate, adaptive filters, no interlace
+	AppendChunk(out, "IHDR", header.data(), header.size());
+	AppendChunk(out, "IDAT", compressed.data(), compressed_size);
+	AppendChunk(out, "IEND", nullptr, 0);
+	return out;
+}
+#endif
+
+}
+
+const char* ToString(FrameFormat format)
+{
+	switch (format) {
+	case FrameFormat::PPM:
+		return "ppm";
+	case FrameFormat::QOI:
+		return "qoi";
+	case FrameFormat::TGA:
+		return "tga";
+	case FrameFormat::PFM:
+		return "pfm";
+	case FrameFormat::PNG:
+		return "png";
+	default:
+		return "unknown";
+	}
+}
+
+std::vector<uint8_t> EncodeFrame(FrameFormat format, int png_level, const Frame& frame)
+{
+	TRACE_SCOPE("EncodeFrame");
+	switch (format) {
+	case FrameFormat::PPM:
+		return EncodePPM(frame);
+	case FrameFormat::QOI:
+		return EncodeQOI(frame);
+	case FrameFormat::TGA:
+		return EncodeTGA(frame);
+	case FrameFormat::PFM:
+		return EncodePFM(frame);
+#ifdef SKY_CONTEST_ZLIB
+	case FrameFormat::PNG:
+		return EncodePNG(frame, png_level);
+#endif
+	default:
+		throw std::runtime_error(std::string("can't encode ") + ToString(format) + " frames in this build");
+	}
+}
+
+FrameEncoder::FrameEncoder(const std::string& output, FrameFormat format, int png_level, size_t thread_count)
+	: to_stdout(output == "-")
+	, format(format)
+	, png_level(png_level)
+{
+#ifndef SKY_CONTEST_ZLIB
+	if (format == FrameFormat::PNG) {
+		throw std::runtime_error("PNG frames need a build with zlib");
+	}
+#endif
+	if (to_stdout) {
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	} else if (!output.empty()) {
+		directory = output;
+		fs::create_directories(directory);
+	}
+
+	thread_count = std::max<size_t>(thread_count, 1);
+	pipeline = std::make_unique<OrderedPipeline<std::vector<uint8_t>>>(
+		[this](std::vector<uint8_t>& data) {
+			if (to_stdout) {
+				std::cout.write((const char*)data.data(), data.size());
+				if (!std::cout) {
+					throw std::runtime_error("failed to write frame");
+				}
+			}
+		},
+		thread_count, thread_count * 2);
+}
+
+GLenum FrameEncoder::getPixelType() const
+{
+	return format == FrameFormat::PFM ? GL_FLOAT : GL_UNSIGNED_BYTE;
+}
+
+void FrameEncoder::submit(Frame frame)
+{
+	pipeline->submit([this, frame = std::move(frame)] {
+		std::vector<uint8_t> data = EncodeFrame(format, png_level, frame);
+		if (directory.empty()) {
+			// stdout is written in order by the consumer, the benchmark drops the data
+			return to_stdout ? data : std::vector<uint8_t>();
+		}
+		// files don't need ordering, so every worker writes its own
+		TRACE_SCOPE("FrameEncoder::write");
+		std::stringstream name;
+		name << "frame_" << std::setw(5) << std::setfill('0') << frame.index << "." << ToString(format);
+		fs::path path = directory / name.str();
+		std::ofstream file(path, std::ios::binary);
+		file.write((const char*)data.data(), data.size());
+		if (!file) {
+			throw std::runtime_error("failed to write " + path.string());
+		}
+		return std::vector<uint8_t>();
+	});
+}
+
+void FrameEncoder::finish()
+{
+	pipeline->finish();
+	if (to_stdout) {
+		std::cout.flush();
+	}
+}
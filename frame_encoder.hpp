@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glad/glad.h>
+#include "ordered_pipeline.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class FrameFormat {
+	// uncompressed 8 bit, the default
+	PPM,
+	// lossless and several times faster to encode than PNG
+	QOI,
+	// uncompressed 8 bit, bottom-up like GL so rows need no flipping
+	TGA,
+	// 32 bit float, bottom-up like GL
+	PFM,
+	// deflate at a configurable level, needs zlib
+	PNG,
+};
+
+// A frame as read back from GL: bottom-up RGB rows of GL_UNSIGNED_BYTE, or GL_FLOAT for PFM
+struct Frame {
+	int index = 0;
+	int width = 0;
+	int height = 0;
+	std::vector<uint8_t> pixels;
+};
+
+// The whole file for one frame, safe to call from any thread
+std::vector<uint8_t> EncodeFrame(FrameFormat format, int png_level, const Frame& frame);
+
+// Encodes frames of an image sequence on a pool of worker threads. With a directory
+// every worker writes its own frame_NNNNN files, with "-" the frames are streamed to
+// stdout in order and with an empty output they are encoded and dropped (for
+// benchmarks). submit() blocks while twice as many frames as threads are queued or
+// being encoded, so memory stays bounded when encoding is slower than rendering.
+class FrameEncoder
+{
+public:
+	FrameEncoder(const std::string& output, FrameFormat format, int png_level, size_t thread_count);
+
+	// GL type to read pixels back with
+	GLenum getPixelType() const;
+
+	void submit(Frame frame);
+
+	// Waits until every submitted frame is written
+	void finish();
+
+private:
+	std::filesystem::path directory;
+	bool to_stdout;
+	FrameFormat format;
+	int png_level;
+	std::unique_ptr<OrderedPipeline<std::vector<uint8_t>>> pipeline;
+};
+
+const char* ToString(FrameFormat format);
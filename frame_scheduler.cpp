@@ -0,0 +1,215 @@
+#include "frame_scheduler.hpp"
+#include "trace.hpp"
+
+#include <glfwpp/glfwpp.h>
+#include <imgui.h>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const int settle_frame_count = 3;
+// upper bound for a blocking wait, so the caller gets to check shouldClose regularly
+const double max_wait_seconds = 1.0;
+
+}
+
+const char* ToString(FrameScheduler::Mode mode)
+{
+	switch (mode) {
+	case FrameScheduler::Mode::Continuous:
+		return "continuous";
+	case FrameScheduler::Mode::Capped:
+		return "capped";
+	case FrameScheduler::Mode::OnDemand:
+		return "on-demand";
+	default:
+		return "unknown";
+	}
+}
+
+bool IsAnimatedShader(const std::string& source)
+{
+	std::istringstream stream(source);
+	std::string line;
+	while (std::getline(stream, line)) {
+		std::istringstream words(line);
+		std::string directive, name;
+		if (words >> directive >> name && directive == "#pragma" && name == "animated") {
+			return true;
+		}
+	}
+	return false;
+}
+
+FrameScheduler::FrameScheduler()
+	: start(Clock::now())
+	, deadline(start)
+{
+}
+
+FrameScheduler::~FrameScheduler()
+{
+#ifdef __linux__
+	if (wakeup_thread.joinable()) {
+		uint64_t value = 1;
+		(void)write(wakeup_stop, &value, sizeof(value));
+		wakeup_thread.join();
+	}
+	if (wakeup_epoll != -1) {
+		close(wakeup_epoll);
+	}
+	if (wakeup_stop != -1) {
+		close(wakeup_stop);
+	}
+#endif
+}
+
+void FrameScheduler::setWakeupDescriptor(int fd)
+{
+#ifdef __linux__
+	if (fd == -1 || wakeup_thread.joinable()) {
+		return;
+	}
+	wakeup_epoll = epoll_create1(EPOLL_CLOEXEC);
+	wakeup_stop = eventfd(0, EFD_CLOEXEC);
+	if (wakeup_epoll == -1 || wakeup_stop == -1) {
+		throw std::runtime_error("failed to create the wakeup descriptors");
+	}
+	// edge triggered, since fd stays readable until the render thread handled it
+	epoll_event event = {};
+	event.events = EPOLLIN | EPOLLET;
+	event.data.fd = fd;
+	epoll_event stop = {};
+	stop.events = EPOLLIN;
+	stop.data.fd = wakeup_stop;
+	if (epoll_ctl(wakeup_epoll, EPOLL_CTL_ADD, fd, &event) != 0 || epoll_ctl(wakeup_epoll, EPOLL_CTL_ADD, wakeup_stop, &stop) != 0) {
+		throw std::runtime_error("failed to watch the wakeup descriptor");
+	}
+	wakeup_thread = std::thread([this] {
+		for (;;) {
+			epoll_event event;
+			int count = epoll_wait(wakeup_epoll, &event, 1, -1);
+			if (count == 1 && event.data.fd == wakeup_stop) {
+				return;
+			}
+			if (count == 1) {
+				glfw::postEmptyEvent();
+			}
+		}
+	});
+#else
+	(void)fd;
+#endif
+}
+
+void FrameScheduler::requestRedraw()
+{
+	if (!redraw_requested.exchange(true)) {
+		glfw::postEmptyEvent();
+	}
+}
+
+void FrameScheduler::requestRedrawAt(Clock::time_point time)
+{
+	redraw_deadline = std::min(redraw_deadline, time);
+}
+
+void FrameScheduler::setAnimated(bool animated_)
+{
+	animated = animated_;
+}
+
+void FrameScheduler::waitEvents(double timeout)
+{
+	TRACE_SCOPE("FrameScheduler::waitEvents");
+	if (timeout <= 0) {
+		glfw::pollEvents();
+		return;
+	}
+	auto wait_start = Clock::now();
+	glfw::waitEvents(std::min(timeout, max_wait_seconds));
+	idle_seconds += std::chrono::duration<double>(Clock::now() - wait_start).count();
+}
+
+void FrameScheduler::waitUntilDeadline()
+{
+	auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / std::max(max_fps, 1.f)));
+	glfw::pollEvents();
+	for (auto now = Clock::now(); now < deadline; now = Clock::now()) {
+		waitEvents(std::chrono::duration<double>(deadline - now).count());
+	}
+	// don't try to catch up on frames missed while rendering took too long
+	deadline = std::max(deadline + period, Clock::now());
+}
+
+bool FrameScheduler::waitForFrame()
+{
+	switch (mode) {
+	case Mode::Continuous:
+		waitEvents(0);
+		return true;
+	case Mode::Capped:
+		waitUntilDeadline();
+		return true;
+	case Mode::OnDemand:
+		if (animated) {
+			waitUntilDeadline();
+			return true;
+		}
+		if (redraw_requested || settle_frames > 0) {
+			waitEvents(0);
+		} else if (redraw_deadline != Clock::time_point::max()) {
+			waitEvents(std::max(std::chrono::duration<double>(redraw_deadline - Clock::now()).count(), 0.0));
+		} else {
+			waitEvents(max_wait_seconds);
+		}
+		if (redraw_requested.exchange(false)) {
+			settle_frames = settle_frame_count;
+		}
+		if (Clock::now() >= redraw_deadline) {
+			redraw_deadline = Clock::time_point::max();
+			settle_frames = std::max(settle_frames, 1);
+		}
+		if (settle_frames > 0) {
+			--settle_frames;
+			return true;
+		}
+		return false;
+	}
+	return true;
+}
+
+void FrameScheduler::frameRendered()
+{
+	++frames_rendered;
+}
+
+void FrameScheduler::drawControls()
+{
+	int current = (int)mode;
+	const char* modes[] = {ToString(Mode::Continuous), ToString(Mode::Capped), ToString(Mode::OnDemand)};
+	if (ImGui::Combo("Frame pacing", &current, modes, IM_ARRAYSIZE(modes))) {
+		mode = (Mode)current;
+		deadline = Clock::now();
+	}
+	if (mode != Mode::Continuous) {
+		ImGui::SliderFloat("Max FPS", &max_fps, 1.f, 240.f, "%.0f");
+	}
+
+	double total_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	double busy_seconds = std::max(total_seconds - idle_seconds, 1e-6);
+	// frames continuous mode would have drawn in the time we spent sleeping instead
+	double skipped = frames_rendered ? idle_seconds / (busy_seconds / frames_rendered) : 0;
+	ImGui::Text("Rendered %llu frames, skipped ~%.0f", (unsigned long long)frames_rendered, skipped);
+	ImGui::Text("Render thread idle %.1f%% of the time", 100.0 * idle_seconds / std::max(total_seconds, 1e-6));
+	if (mode == Mode::OnDemand) {
+		ImGui::Text(animated ? "Shader is animated, redrawing at Max FPS" : "Shader is static, redrawing on changes only");
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// Decides when the render loop draws and blocks in glfwWaitEventsTimeout in between,
+// so a static shader doesn't keep a core and the GPU busy.
+//  - Continuous: poll events and draw as fast as possible
+//  - Capped: draw at most max_fps frames per second, sleeping until the next deadline
+//  - OnDemand: draw only after input, a redraw request (file watcher, shader reload)
+//    or while the shader declares itself animated, which then behaves like Capped
+class FrameScheduler
+{
+public:
+	enum class Mode {
+		Continuous,
+		Capped,
+		OnDemand,
+	};
+
+	using Clock = std::chrono::steady_clock;
+
+	Mode mode = Mode::Continuous;
+	float max_fps = 60.f;
+
+	FrameScheduler();
+	~FrameScheduler();
+
+	// Interrupts the event wait whenever fd (e.g. the file watcher's) becomes readable,
+	// so the render loop can handle it right away. Only the wait is interrupted, handling
+	// the descriptor and requesting a redraw if needed is up to the caller. Linux only,
+	// ignored elsewhere and for -1.
+	void setWakeupDescriptor(int fd);
+
+	// Thread safe, wakes the render thread if it is blocked waiting for events
+	void requestRedraw();
+
+	// Render thread only. Draws a frame once time is reached, for state that has to be
+	// polled (a compile finishing, the reload debounce running out) without redrawing as
+	// fast as possible until then. The earliest of several requests wins.
+	void requestRedrawAt(Clock::time_point time);
+
+	void setAnimated(bool animated);
+
+	// Processes pending window events, blocking for as long as the mode allows.
+	// Returns false if nothing needs to be drawn yet, the caller should just loop.
+	bool waitForFrame();
+
+	// Call once the frame has been presented
+	void frameRendered();
+
+	// Mode controls and idle statistics, must be called inside an ImGui window
+	void drawControls();
+
+private:
+	void waitEvents(double timeout);
+	void waitUntilDeadline();
+
+	std::atomic<bool> redraw_requested {true};
+	bool animated = true;
+	// ImGui needs a few frames after input to finish hover and click transitions
+	int settle_frames = 0;
+	Clock::time_point start;
+	Clock::time_point deadline;
+	Clock::time_point redraw_deadline = Clock::time_point::max();
+	double idle_seconds = 0;
+	uint64_t frames_rendered = 0;
+
+	// blocks on the wakeup descriptor and posts empty GLFW events
+	std::thread wakeup_thread;
+	int wakeup_epoll = -1;
+	int wakeup_stop = -1;
+};
+
+const char* ToString(FrameScheduler::Mode mode);
+
+// Shaders opt into continuous redraws in on-demand mode with a "#pragma animated" line
+bool IsAnimatedShader(const std::string& source);
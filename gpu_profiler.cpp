@@ -0,0 +1,193 @@
+#include "gpu_profiler.hpp"
+#include "trace.hpp"
+
+#include <imgui.h>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+namespace {
+
+const char* const frame_pass_name = "Frame";
+
+}
+
+GpuProfiler::GpuProfiler(size_t latency, size_t history)
+	: latency(latency)
+	, history(history)
+{
+}
+
+void GpuProfiler::beginFrame()
+{
+#ifdef SKY_CONTEST_TRACE
+	// the clocks drift apart slowly, re-anchor every few hundred frames
+	if (frame == 0 || frame - calibrated_frame >= 300) {
+		GLint64 gpu_now = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+		gpu_to_cpu_offset = (int64_t)trace::Now() - gpu_now;
+		calibrated_frame = frame;
+	}
+#endif
+	++frame;
+
+	for (auto& pass: passes) {
+		collect(*pass);
+	}
+	begin(frame_pass_name);
+}
+
+void GpuProfiler::endFrame()
+{
+	end();
+}
+
+GpuProfiler::Pass& GpuProfiler::getPass(const char* name)
+{
+	for (auto& pass: passes) {
+		if (pass->name == name || std::strcmp(pass->name, name) == 0) {
+			return *pass;
+		}
+	}
+	auto pass = std::make_unique<Pass>();
+	pass->name = name;
+	pass->slots.reserve(latency);
+	for (size_t i = 0; i < latency; ++i) {
+		pass->slots.emplace_back();
+	}
+	pass->history.reserve(history);
+	passes.push_back(std::move(pass));
+	return *passes.back();
+}
+
+const GpuProfiler::Pass* GpuProfiler::findPass(const char* name) const
+{
+	for (auto& pass: passes) {
+		if (pass->name == name || std::strcmp(pass->name, name) == 0) {
+			return pass.get();
+		}
+	}
+	return nullptr;
+}
+
+void GpuProfiler::begin(const char* name)
+{
+	Pass& pass = getPass(name);
+	Slot& slot = pass.slots[pass.write];
+	if (slot.pending) {
+		++pass.dropped;
+		stack.push_back({&pass, false});
+		return;
+	}
+	slot.begin.queryCounter();
+	stack.push_back({&pass, true});
+}
+
+void GpuProfiler::end()
+{
+	Open open = stack.back();
+	stack.pop_back();
+	if (!open.recording) {
+		return;
+	}
+	Pass& pass = *open.pass;
+	Slot& slot = pass.slots[pass.write];
+	slot.end.queryCounter();
+	slot.pending = true;
+	pass.write = (pass.write + 1) % pass.slots.size();
+}
+
+void GpuProfiler::collect(Pass& pass)
+{
+	while (pass.slots[pass.read].pending) {
+		Slot& slot = pass.slots[pass.read];
+		// the end timestamp completes last, once it is there both are
+		if (!slot.end.get<GLint>(GL_QUERY_RESULT_AVAILABLE)) {
+			break;
+		}
+		GLuint64 begin = slot.begin.get<GLuint64>(GL_QUERY_RESULT);
+		GLuint64 end = slot.end.get<GLuint64>(GL_QUERY_RESULT);
+		float ms = (end - begin) / 1e6f;
+#ifdef SKY_CONTEST_TRACE
+		trace::RecordGpu(pass.name, begin + gpu_to_cpu_offset, end + gpu_to_cpu_offset);
+#endif
+
+		if (pass.history.size() < history) {
+			pass.history.push_back(ms);
+		} else {
+			pass.history[pass.history_pos] = ms;
+			pass.history_pos = (pass.history_pos + 1) % history;
+		}
+
+		slot.pending = false;
+		pass.read = (pass.read + 1) % pass.slots.size();
+	}
+}
+
+GpuProfiler::Stats GpuProfiler::computeStats(const Pass& pass) const
+{
+	Stats stats;
+	if (pass.history.empty()) {
+		return stats;
+	}
+	size_t newest = pass.history.size() < history ? pass.history.size() - 1 :
+		(pass.history_pos + history - 1) % history;
+	stats.last = pass.history[newest];
+
+	std::vector<float> sorted = pass.history;
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&](float p) {
+		return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+	};
+	stats.min = sorted.front();
+	float sum = 0;
+	for (float ms: sorted) {
+		sum += ms;
+	}
+	stats.avg = sum / sorted.size();
+	stats.p95 = percentile(0.95f);
+	stats.p99 = percentile(0.99f);
+	return stats;
+}
+
+std::optional<GpuProfiler::Stats> GpuProfiler::getStats(const char* name) const
+{
+	const Pass* pass = findPass(name);
+	if (!pass || pass->history.empty()) {
+		return std::nullopt;
+	}
+	return computeStats(*pass);
+}
+
+void GpuProfiler::drawPanel() const
+{
+	ImGui::Begin("GPU Profiler");
+
+	if (ImGui::BeginTable("passes", 7, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+		for (const char* column: {"Pass", "last", "min", "avg", "p95", "p99", "dropped"}) {
+			ImGui::TableSetupColumn(column);
+		}
+		ImGui::TableHeadersRow();
+		for (auto& pass: passes) {
+			Stats stats = computeStats(*pass);
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(pass->name);
+			for (float ms: {stats.last, stats.min, stats.avg, stats.p95, stats.p99}) {
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", ms);
+			}
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", (unsigned long long)pass->dropped);
+		}
+		ImGui::EndTable();
+	}
+
+	if (const Pass* frame = findPass(frame_pass_name)) {
+		size_t offset = frame->history.size() < history ? 0 : frame->history_pos;
+		ImGui::PlotLines("GPU frame, ms", frame->history.data(), (int)frame->history.size(), (int)offset,
+			nullptr, 0.f, FLT_MAX, ImVec2(0, 80));
+	}
+
+	ImGui::End();
+}
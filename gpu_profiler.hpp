@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <mogl/mogl.hpp>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Measures GPU time per named pass with GL_TIMESTAMP query pairs. Every pass owns a
+// ring of query slots, results are collected a few frames later and only once
+// GL_QUERY_RESULT_AVAILABLE says so, so the profiler never stalls the pipeline. When
+// the ring is still full of pending queries the new measurement is dropped instead.
+class GpuProfiler
+{
+public:
+	struct Stats {
+		float last = 0;
+		float min = 0;
+		float avg = 0;
+		float p95 = 0;
+		float p99 = 0;
+	};
+
+	class Scope
+	{
+	public:
+		Scope(GpuProfiler& profiler, const char* name) : profiler(profiler) { profiler.begin(name); }
+		~Scope() { profiler.end(); }
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		GpuProfiler& profiler;
+	};
+
+	// latency - frames a query may take to complete, history - samples kept per pass
+	explicit GpuProfiler(size_t latency = 5, size_t history = 256);
+
+	// Collects finished queries and starts the "Frame" pass
+	void beginFrame();
+	void endFrame();
+
+	// Passes may nest, name must outlive the profiler (a string literal)
+	void begin(const char* name);
+	void end();
+
+	// Milliseconds over the history window, nullopt until the pass has a sample
+	std::optional<Stats> getStats(const char* name) const;
+
+	void drawPanel() const;
+
+private:
+	struct Slot {
+		mogl::Query begin {GL_TIMESTAMP};
+		mogl::Query end {GL_TIMESTAMP};
+		bool pending = false;
+	};
+
+	struct Pass {
+		const char* name;
+		std::vector<Slot> slots;
+		size_t write = 0;
+		size_t read = 0;
+		// rolling window of durations in ms, oldest at history_pos once full
+		std::vector<float> history;
+		size_t history_pos = 0;
+		uint64_t dropped = 0;
+	};
+
+	struct Open {
+		Pass* pass;
+		bool recording;
+	};
+
+	Pass& getPass(const char* name);
+	const Pass* findPass(const char* name) const;
+	void collect(Pass& pass);
+	Stats computeStats(const Pass& pass) const;
+
+	size_t latency;
+	size_t history;
+	// trace::Now() minus the GPU timestamp, to merge GPU passes into the CPU trace
+	int64_t gpu_to_cpu_offset = 0;
+	uint64_t calibrated_frame = 0;
+	uint64_t frame = 0;
+	std::vector<std::unique_ptr<Pass>> passes;
+	std::vector<Open> stack;
+};
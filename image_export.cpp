@@ -0,0 +1,145 @@
+#include "image_export.hpp"
+#include "image_writer.hpp"
+#include "ordered_pipeline.hpp"
+#include "trace.hpp"
+
+#include <glad/glad.h>
+#include <mogl/mogl.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+const int max_tile_width = 2048;
+const int min_strip_rows = 16;
+const int max_strip_rows = 512;
+const size_t readback_slots = 3;
+
+struct Readback {
+	mogl::PixelPackBuffer buffer;
+	std::unique_ptr<mogl::Fence> fence;
+	int y = 0;
+	int rows = 0;
+};
+
+}
+
+void ExportImage(const std::filesystem::path& path, int width, int height, size_t memory_budget,
+	const std::function<void(const ExportTile& tile)>& draw_tile)
+{
+	TRACE_SCOPE("ExportImage");
+	if (width <= 0 || height <= 0) {
+		throw std::runtime_error("invalid export size");
+	}
+	std::unique_ptr<ImageWriter> writer = CreateImageWriter(path, width, height);
+	const size_t pixel_size = writer->getPixelSize();
+	const size_t row_size = (size_t)width * pixel_size;
+
+	size_t thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+	size_t max_in_flight = thread_count * 2;
+
+	// the readback ring plus every strip in the pipeline, raw and encoded at worst
+	size_t strips_in_memory = readback_slots + max_in_flight * 2;
+	int alignment = writer->getRowAlignment();
+	int strip_rows = (int)std::min<size_t>(memory_budget / (strips_in_memory * row_size), max_strip_rows);
+	strip_rows = std::max(strip_rows / alignment * alignment, std::max(min_strip_rows, alignment));
+	strip_rows = std::min(strip_rows, (height + alignment - 1) / alignment * alignment);
+	int tile_width = std::min(width, max_tile_width);
+
+	mogl::Texture tile_texture(GL_TEXTURE_2D);
+	tile_texture.setStorage2D(1, GL_RGBA16F, tile_width, strip_rows);
+	mogl::FrameBuffer tile_frame_buffer;
+	tile_frame_buffer.setTexture(GL_COLOR_ATTACHMENT0, tile_texture);
+	if (!tile_frame_buffer.isComplete(GL_FRAMEBUFFER)) {
+		throw std::runtime_error("export tile framebuffer is incomplete");
+	}
+
+	std::array<Readback, readback_slots> readbacks;
+	for (Readback& readback: readbacks) {
+		readback.buffer.setStorage(row_size * strip_rows, nullptr, GL_MAP_READ_BIT);
+	}
+
+	OrderedPipeline<ImageWriter::EncodedStrip> pipeline(
+		[&writer](ImageWriter::EncodedStrip& strip) { writer->write(strip); },
+		thread_count, max_in_flight);
+
+	const int strip_count = (height + strip_rows - 1) / strip_rows;
+	int strips_done = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	// hands a finished readback to the encoders, GL rows start at the bottom
+	auto drain = [&](Readback& readback) {
+		TRACE_SCOPE("ExportImage::drain");
+		while (readback.fence->waitClientSync(GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+		}
+		readback.fence.reset();
+
+		ImageWriter::Strip strip;
+		strip.y = readback.y;
+		strip.rows = readback.rows;
+		strip.pixels.resize(row_size * readback.rows);
+		const uint8_t* mapped = (const uint8_t*)readback.buffer.mapRange(0, row_size * readback.rows, GL_MAP_READ_BIT);
+		if (!mapped) {
+			throw std::runtime_error("failed to map the export readback buffer");
+		}
+		for (int row = 0; row < readback.rows; ++row) {
+			std::memcpy(&strip.pixels[row * row_size], mapped + (readback.rows - 1 - row) * row_size, row_size);
+		}
+		readback.buffer.unmap();
+
+		pipeline.submit([&writer, strip = std::move(strip)] { return writer->encode(strip); });
+		++strips_done;
+		std::cerr << "\rExporting " << path.string() << ": " << strips_done * 100 / strip_count << "%" << std::flush;
+	};
+
+	tile_frame_buffer.bind(GL_FRAMEBUFFER);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glPixelStorei(GL_PACK_ROW_LENGTH, width);
+
+	for (int strip = 0; strip < strip_count; ++strip) {
+		Readback& readback = readbacks[strip % readback_slots];
+		if (readback.fence) {
+			drain(readback);
+		}
+		readback.y = strip * strip_rows;
+		readback.rows = std::min(strip_rows, height - readback.y);
+
+		readback.buffer.bind();
+		for (int x = 0; x < width; x += tile_width) {
+			ExportTile tile {tile_width, strip_rows, {
+				(float)x / width,
+				1.f - (float)(readback.y + strip_rows) / height,
+				(float)tile_width / width,
+				(float)strip_rows / height,
+			}};
+			glViewport(0, 0, tile_width, strip_rows);
+			draw_tile(tile);
+
+			// the strip's rows are the top of the tile when it hangs over the bottom edge
+			int columns = std::min(tile_width, width - x);
+			glReadPixels(0, strip_rows - readback.rows, columns, readback.rows, GL_RGB, writer->getPixelType(),
+				(void*)(x * pixel_size));
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		readback.fence = std::make_unique<mogl::Fence>(GL_SYNC_GPU_COMMANDS_COMPLETE);
+	}
+	for (int strip = std::max(strip_count - (int)readback_slots, 0); strip < strip_count; ++strip) {
+		drain(readbacks[strip % readback_slots]);
+	}
+
+	glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	pipeline.finish();
+	writer->finish();
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cerr << "\rExported " << path.string() << " at " << width << "x" << height << " in " << elapsed.count()
+		<< " s (" << strip_count << " strips of " << strip_rows << " rows, " << thread_count << " encoder threads)" << std::endl;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+
+// One tile of an exported image. The tile is always rendered at the same size into
+// the bound framebuffer, tiles at the right and bottom edges are cropped afterwards.
+struct ExportTile {
+	int width;
+	int height;
+	// uv offset and scale of the tile inside the whole image, see SubViewport in vertex.glsl
+	float sub_viewport[4];
+};
+
+// Renders an image of any size tile by tile and streams it to path (.png, .tif or .exr)
+// strip by strip. Tiles are read back through a ring of pixel pack buffers, so the GPU
+// renders the next strip while the previous one is copied out, and strips are compressed
+// on all cores while the file is written in order. Roughly memory_budget bytes of strips
+// are kept in memory at any time, no matter how large the image is.
+//
+// Every tile runs all passes again with its own uv range, so passes must not depend on
+// pixels outside the tile and feedback buffers don't carry over between tiles.
+void ExportImage(const std::filesystem::path& path, int width, int height, size_t memory_budget,
+	const std::function<void(const ExportTile& tile)>& draw_tile);
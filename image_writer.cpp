@@ -0,0 +1,563 @@
+#include "image_writer.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#ifdef SKY_CONTEST_ZLIB
+#include <zlib.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// all multi byte values are written from a little endian host
+template <class T>
+void Append(std::vector<uint8_t>& out, T value)
+{
+	const uint8_t* bytes = (const uint8_t*)&value;
+	out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void AppendBigEndian(std::vector<uint8_t>& out, uint32_t value)
+{
+	for (int shift = 24; shift >= 0; shift -= 8) {
+		out.push_back((uint8_t)(value >> shift));
+	}
+}
+
+void AppendString(std::vector<uint8_t>& out, const char* str)
+{
+	out.insert(out.end(), str, str + std::strlen(str) + 1);
+}
+
+class File
+{
+public:
+	explicit File(const fs::path& path)
+		: path(path)
+		, stream(path, std::ios::binary | std::ios::trunc)
+	{
+		if (!stream) {
+			throw std::runtime_error("failed to open " + path.string() + " for writing");
+		}
+	}
+
+	void write(const void* data, size_t size)
+	{
+		stream.write((const char*)data, size);
+		if (!stream) {
+			throw std::runtime_error("failed to write " + path.string());
+		}
+	}
+
+	void write(const std::vector<uint8_t>& data)
+	{
+		write(data.data(), data.size());
+	}
+
+	uint64_t tell()
+	{
+		return (uint64_t)stream.tellp();
+	}
+
+	void seek(uint64_t position)
+	{
+		stream.seekp(position);
+	}
+
+	void close()
+	{
+		stream.close();
+		if (!stream) {
+			throw std::runtime_error("failed to write " + path.string());
+		}
+	}
+
+private:
+	fs::path path;
+	std::ofstream stream;
+};
+
+#ifdef SKY_CONTEST_ZLIB
+// zlib stream, as TIFF and EXR expect it
+std::vector<uint8_t> Compress(const uint8_t* data, size_t size)
+{
+	uLongf compressed_size = compressBound((uLong)size);
+	std::vector<uint8_t> compressed(compressed_size);
+	if (compress2(compressed.data(), &compressed_size, data, (uLong)size, Z_DEFAULT_COMPRESSION) != Z_OK) {
+		throw std::runtime_error("zlib compression failed");
+	}
+	compressed.resize(compressed_size);
+	return compressed;
+}
+
+// PNG needs a single zlib stream over the whole image. Every strip is compressed on its
+// own as raw deflate ending in a full flush, which byte aligns it and resets the
+// dictionary, so the strips can simply be concatenated (the same trick pigz uses).
+class PngWriter : public ImageWriter
+{
+public:
+	PngWriter(const fs::path& path, int width, int height)
+		: file(path)
+		, width(width)
+		, height(height)
+	{
+	}
+
+	GLenum getPixelType() const override
+	{
+		return GL_UNSIGNED_BYTE;
+	}
+
+	EncodedStrip encode(const Strip& strip) const override
+	{
+		TRACE_SCOPE("PngWriter::encode");
+		// Sub filter, it needs no other row so strips stay independent
+		const size_t row_size = (size_t)width * 3;
+		std::vector<uint8_t> filtered(strip.rows * (row_size + 1));
+		for (int row = 0; row < strip.rows; ++row) {
+			const uint8_t* in = strip.pixels.data() + row * row_size;
+			uint8_t* out = filtered.data() + row * (row_size + 1);
+			*out++ = 1;
+			for (size_t i = 0; i < row_size; ++i) {
+				out[i] = i < 3 ? in[i] : (uint8_t)(in[i] - in[i - 3]);
+			}
+		}
+
+		EncodedStrip encoded;
+		encoded.y = strip.y;
+		encoded.rows = strip.rows;
+		encoded.raw_size = filtered.size();
+		encoded.checksum = adler32(adler32(0, Z_NULL, 0), filtered.data(), (uInt)filtered.size());
+
+		z_stream stream = {};
+		if (deflateInit2(&stream, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			throw std::runtime_error("zlib initialization failed");
+		}
+		encoded.data.resize(deflateBound(&stream, (uLong)filtered.size()) + 16);
+		stream.next_in = filtered.data();
+		stream.avail_in = (uInt)filtered.size();
+		stream.next_out = encoded.data.data();
+		stream.avail_out = (uInt)encoded.data.size();
+		int result = deflate(&stream, Z_FULL_FLUSH);
+		encoded.data.resize(stream.total_out);
+		deflateEnd(&stream);
+		if (result != Z_OK || stream.avail_in != 0) {
+			throw std::runtime_error("zlib compression failed");
+		}
+		return encoded;
+	}
+
+	void write(const EncodedStrip& strip) override
+	{
+		if (!started) {
+			const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+			file.write(signature, sizeof(signature));
+			std::vector<uint8_t> header;
+			AppendBigEndian(header, width);
+			AppendBigEndian(header, height);
+			header.insert(header.end(), {8, 2, 0, 0, 0}); // 8 bit RGB, deflate, adaptive filters, no interlace
+			writeChunk("IHDR", header.data(), header.size());
+			const uint8_t zlib_header[] = {0x78, 0x9c};
+			writeChunk("IDAT", zlib_header, sizeof(zlib_header));
+			adler = adler32(0, Z_NULL, 0);
+			started = true;
+		}
+		// chunk lengths are limited to 2^31 - 1
+		const size_t max_chunk = 1 << 30;
+		for (size_t offset = 0; offset < strip.data.size(); offset += max_chunk) {
+			writeChunk("IDAT", strip.data.data() + offset, std::min(max_chunk, strip.data.size() - offset));
+		}
+		adler = adler32_combine(adler, strip.checksum, (z_off_t)strip.raw_size);
+	}
+
+	void finish() override
+	{
+		// empty final block, then the checksum of all rows
+		std::vector<uint8_t> end = {0x03, 0x00};
+		AppendBigEndian(end, adler);
+		writeChunk("IDAT", end.data(), end.size());
+		writeChunk("IEND", nullptr, 0);
+		file.close();
+	}
+
+private:
+	void writeChunk(const char* type, const uint8_t* data, size_t size)
+	{
+		std::vector<uint8_t> header;
+		AppendBigEndian(header, (uint32_t)size);
+		header.insert(header.end(), type, type + 4);
+		file.write(header);
+		uLong crc = crc32(0, (const Bytef*)type, 4);
+		// crc32() with a null buffer returns the initial value instead of crc
+		if (size) {
+			file.write(data, size);
+			crc = crc32(crc, data, (uInt)size);
+		}
+		std::vector<uint8_t> footer;
+		AppendBigEndian(footer, (uint32_t)crc);
+		file.write(footer);
+	}
+
+	File file;
+	int width;
+	int height;
+	bool started = false;
+	uLong adler = 0;
+};
+#endif
+
+// One strip per TIFF strip. Offsets aren't known before the strips are compressed, so
+// the IFD goes after the pixel data and the header is patched at the end. Files that
+// may exceed 4 GB are written as BigTIFF.
+class TiffWriter : public ImageWriter
+{
+public:
+	TiffWriter(const fs::path& path, int width, int height)
+		: file(path)
+		, width(width)
+		, height(height)
+	{
+		uint64_t raw_size = (uint64_t)width * height * 3;
+		big = raw_size + raw_size / 64 + (1 << 20) > 0xffffffffull;
+		std::vector<uint8_t> header = {'I', 'I'};
+		if (big) {
+			Append<uint16_t>(header, 43);
+			Append<uint16_t>(header, 8);
+			Append<uint16_t>(header, 0);
+			Append<uint64_t>(header, 0);
+		} else {
+			Append<uint16_t>(header, 42);
+			Append<uint32_t>(header, 0);
+		}
+		file.write(header);
+	}
+
+	GLenum getPixelType() const override
+	{
+		return GL_UNSIGNED_BYTE;
+	}
+
+	EncodedStrip encode(const Strip& strip) const override
+	{
+		TRACE_SCOPE("TiffWriter::encode");
+		EncodedStrip encoded;
+		encoded.y = strip.y;
+		encoded.rows = strip.rows;
+#ifdef SKY_CONTEST_ZLIB
+		encoded.data = Compress(strip.pixels.data(), strip.pixels.size());
+#else
+		encoded.data = strip.pixels;
+#endif
+		return encoded;
+	}
+
+	void write(const EncodedStrip& strip) override
+	{
+		if (rows_per_strip == 0) {
+			rows_per_strip = strip.rows;
+		}
+		offsets.push_back(file.tell());
+		byte_counts.push_back(strip.data.size());
+		file.write(strip.data);
+	}
+
+	void finish() override
+	{
+		const uint16_t type_short = 3;
+		const uint16_t type_long = 4;
+		const uint16_t type_long8 = 16;
+		const uint16_t offset_type = big ? type_long8 : type_long;
+		const size_t offset_size = big ? 8 : 4;
+
+		// arrays that don't fit into an entry go before the IFD, on word boundaries
+		auto align = [&] {
+			if (file.tell() % 2) {
+				file.write("", 1);
+			}
+		};
+		auto write_array = [&](const std::vector<uint64_t>& values, size_t value_size) -> uint64_t {
+			if (values.size() * value_size <= offset_size) {
+				return 0;
+			}
+			align();
+			uint64_t position = file.tell();
+			std::vector<uint8_t> data;
+			for (uint64_t value: values) {
+				data.insert(data.end(), (const uint8_t*)&value, (const uint8_t*)&value + value_size);
+			}
+			file.write(data);
+			return position;
+		};
+		std::vector<uint64_t> bits_per_sample = {8, 8, 8};
+		uint64_t bits_position = write_array(bits_per_sample, 2);
+		uint64_t offsets_position = write_array(offsets, offset_size);
+		uint64_t byte_counts_position = write_array(byte_counts, offset_size);
+		align();
+		uint64_t ifd_position = file.tell();
+
+		std::vector<uint8_t> ifd;
+		auto entry = [&](uint16_t tag, uint16_t type, const std::vector<uint64_t>& values, size_t value_size, uint64_t position) {
+			Append<uint16_t>(ifd, tag);
+			Append<uint16_t>(ifd, type);
+			std::vector<uint8_t> value;
+			if (position) {
+				value.insert(value.end(), (const uint8_t*)&position, (const uint8_t*)&position + offset_size);
+			} else {
+				for (uint64_t v: values) {
+					value.insert(value.end(), (const uint8_t*)&v, (const uint8_t*)&v + value_size);
+				}
+				value.resize(offset_size, 0);
+			}
+			if (big) {
+				Append<uint64_t>(ifd, values.size());
+			} else {
+				Append<uint32_t>(ifd, (uint32_t)values.size());
+			}
+			ifd.insert(ifd.end(), value.begin(), value.end());
+		};
+		auto entry_short = [&](uint16_t tag, uint16_t value) {
+			entry(tag, type_short, {value}, 2, 0);
+		};
+		auto entry_long = [&](uint16_t tag, uint32_t value) {
+			entry(tag, type_long, {value}, 4, 0);
+		};
+
+		const uint16_t entry_count = 10;
+		if (big) {
+			Append<uint64_t>(ifd, entry_count);
+		} else {
+			Append<uint16_t>(ifd, entry_count);
+		}
+		entry_long(256, width); // ImageWidth
+		entry_long(257, height); // ImageLength
+		entry(258, type_short, bits_per_sample, 2, bits_position); // BitsPerSample
+#ifdef SKY_CONTEST_ZLIB
+		entry_short(259, 8); // Compression, Adobe deflate
+#else
+		entry_short(259, 1); // Compression, none
+#endif
+		entry_short(262, 2); // PhotometricInterpretation, RGB
+		entry(273, offset_type, offsets, offset_size, offsets_position); // StripOffsets
+		entry_short(277, 3); // SamplesPerPixel
+		entry_long(278, rows_per_strip); // RowsPerStrip
+		entry(279, offset_type, byte_counts, offset_size, byte_counts_position); // StripByteCounts
+		entry_short(284, 1); // PlanarConfiguration, interleaved
+		if (big) {
+			Append<uint64_t>(ifd, 0);
+		} else {
+			Append<uint32_t>(ifd, 0);
+		}
+		file.write(ifd);
+
+		file.seek(big ? 8 : 4);
+		if (big) {
+			file.write(&ifd_position, 8);
+		} else {
+			uint32_t position = (uint32_t)ifd_position;
+			file.write(&position, 4);
+		}
+		file.close();
+	}
+
+private:
+	File file;
+	int width;
+	int height;
+	bool big = false;
+	int rows_per_strip = 0;
+	std::vector<uint64_t> offsets;
+	std::vector<uint64_t> byte_counts;
+};
+
+// Scanline OpenEXR with half float B, G, R channels. With zlib every 16 lines form a
+// ZIP compressed chunk, without it every line is an uncompressed chunk. The offset
+// table after the header is filled in at the end.
+class ExrWriter : public ImageWriter
+{
+public:
+	ExrWriter(const fs::path& path, int width, int height)
+		: file(path)
+		, width(width)
+		, height(height)
+	{
+		std::vector<uint8_t> header = {0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0};
+		auto attribute = [&](const char* name, const char* type, const std::vector<uint8_t>& value) {
+			AppendString(header, name);
+			AppendString(header, type);
+			Append<int32_t>(header, (int32_t)value.size());
+			header.insert(header.end(), value.begin(), value.end());
+		};
+
+		std::vector<uint8_t> channels;
+		for (const char* name: {"B", "G", "R"}) {
+			AppendString(channels, name);
+			Append<int32_t>(channels, 1); // HALF
+			Append<int32_t>(channels, 0); // pLinear and reserved
+			Append<int32_t>(channels, 1); // xSampling
+			Append<int32_t>(channels, 1); // ySampling
+		}
+		channels.push_back(0);
+		attribute("channels", "chlist", channels);
+#ifdef SKY_CONTEST_ZLIB
+		attribute("compression", "compression", {3}); // ZIP
+#else
+		attribute("compression", "compression", {0}); // NONE
+#endif
+		std::vector<uint8_t> window;
+		for (int32_t value: {0, 0, width - 1, height - 1}) {
+			Append<int32_t>(window, value);
+		}
+		attribute("dataWindow", "box2i", window);
+		attribute("displayWindow", "box2i", window);
+		attribute("lineOrder", "lineOrder", {0}); // INCREASING_Y
+		std::vector<uint8_t> one;
+		Append<float>(one, 1.f);
+		attribute("pixelAspectRatio", "float", one);
+		attribute("screenWindowCenter", "v2f", std::vector<uint8_t>(8, 0));
+		attribute("screenWindowWidth", "float", one);
+		header.push_back(0);
+		file.write(header);
+
+		table_position = file.tell();
+		chunk_offsets.resize((height + lines_per_chunk - 1) / lines_per_chunk);
+		std::vector<uint8_t> table(chunk_offsets.size() * sizeof(uint64_t), 0);
+		file.write(table);
+	}
+
+	GLenum getPixelType() const override
+	{
+		return GL_HALF_FLOAT;
+	}
+
+	int getRowAlignment() const override
+	{
+		return lines_per_chunk;
+	}
+
+	EncodedStrip encode(const Strip& strip) const override
+	{
+		TRACE_SCOPE("ExrWriter::encode");
+		EncodedStrip encoded;
+		encoded.y = strip.y;
+		encoded.rows = strip.rows;
+
+		const uint16_t* pixels = (const uint16_t*)strip.pixels.data();
+		std::vector<uint8_t> raw;
+		for (int first = 0; first < strip.rows; first += lines_per_chunk) {
+			int lines = std::min(lines_per_chunk, strip.rows - first);
+			// channels are stored planar per line, in alphabetical order
+			raw.resize((size_t)lines * width * 3 * sizeof(uint16_t));
+			uint16_t* out = (uint16_t*)raw.data();
+			for (int line = first; line < first + lines; ++line) {
+				for (int channel: {2, 1, 0}) {
+					for (int x = 0; x < width; ++x) {
+						*out++ = pixels[((size_t)line * width + x) * 3 + channel];
+					}
+				}
+			}
+			std::vector<uint8_t> chunk = compress(raw);
+			Append<int32_t>(encoded.data, strip.y + first);
+			Append<int32_t>(encoded.data, (int32_t)chunk.size());
+			encoded.data.insert(encoded.data.end(), chunk.begin(), chunk.end());
+		}
+		return encoded;
+	}
+
+	void write(const EncodedStrip& strip) override
+	{
+		// record where every chunk of the strip starts
+		uint64_t position = file.tell();
+		for (size_t offset = 0; offset < strip.data.size();) {
+			int32_t y = 0;
+			int32_t size = 0;
+			std::memcpy(&y, strip.data.data() + offset, 4);
+			std::memcpy(&size, strip.data.data() + offset + 4, 4);
+			chunk_offsets[y / lines_per_chunk] = position + offset;
+			offset += 8 + size;
+		}
+		file.write(strip.data);
+	}
+
+	void finish() override
+	{
+		file.seek(table_position);
+		file.write(chunk_offsets.data(), chunk_offsets.size() * sizeof(uint64_t));
+		file.close();
+	}
+
+private:
+	std::vector<uint8_t> compress(const std::vector<uint8_t>& raw) const
+	{
+#ifdef SKY_CONTEST_ZLIB
+		// OpenEXR's ZIP predictor: split even and odd bytes, then delta encode
+		std::vector<uint8_t> reordered(raw.size());
+		size_t half = (raw.size() + 1) / 2;
+		for (size_t i = 0; i < raw.size(); ++i) {
+			reordered[(i % 2 ? half : 0) + i / 2] = raw[i];
+		}
+		int previous = reordered[0];
+		for (size_t i = 1; i < reordered.size(); ++i) {
+			int delta = int(reordered[i]) - previous + (128 + 256);
+			previous = reordered[i];
+			reordered[i] = (uint8_t)delta;
+		}
+		std::vector<uint8_t> compressed = Compress(reordered.data(), reordered.size());
+		// incompressible chunks are stored as is
+		if (compressed.size() < raw.size()) {
+			return compressed;
+		}
+#endif
+		return raw;
+	}
+
+#ifdef SKY_CONTEST_ZLIB
+	static constexpr int lines_per_chunk = 16;
+#else
+	// the format requires single line chunks without compression
+	static constexpr int lines_per_chunk = 1;
+#endif
+
+	File file;
+	int width;
+	int height;
+	uint64_t table_position = 0;
+	std::vector<uint64_t> chunk_offsets;
+};
+
+}
+
+size_t ImageWriter::getPixelSize() const
+{
+	return getPixelType() == GL_HALF_FLOAT ? 6 : 3;
+}
+
+int ImageWriter::getRowAlignment() const
+{
+	return 1;
+}
+
+std::unique_ptr<ImageWriter> CreateImageWriter(const fs::path& path, int width, int height)
+{
+	std::string extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	if (extension == ".png") {
+#ifdef SKY_CONTEST_ZLIB
+		return std::make_unique<PngWriter>(path, width, height);
+#else
+		throw std::runtime_error("PNG export needs zlib, use .tif or .exr");
+#endif
+	}
+	if (extension == ".tif" || extension == ".tiff") {
+		return std::make_unique<TiffWriter>(path, width, height);
+	}
+	if (extension == ".exr") {
+		return std::make_unique<ExrWriter>(path, width, height);
+	}
+	throw std::runtime_error("unsupported image format " + extension + ", expected .png, .tif or .exr");
+}
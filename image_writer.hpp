@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+// Streams an image to disk one strip of rows at a time, top to bottom, so the image
+// never has to be in memory as a whole. encode() compresses a strip and may run on
+// several threads at once, write() appends encoded strips strictly in image order.
+class ImageWriter
+{
+public:
+	struct Strip {
+		int y = 0;
+		int rows = 0;
+		// top row first, tightly packed RGB pixels of getPixelType()
+		std::vector<uint8_t> pixels;
+	};
+
+	struct EncodedStrip {
+		int y = 0;
+		int rows = 0;
+		std::vector<uint8_t> data;
+		// adler32 and length of the uncompressed PNG rows, unused by other formats
+		uint32_t checksum = 0;
+		size_t raw_size = 0;
+	};
+
+	virtual ~ImageWriter() = default;
+
+	// GL_UNSIGNED_BYTE or GL_HALF_FLOAT
+	virtual GLenum getPixelType() const = 0;
+	size_t getPixelSize() const;
+
+	// All strips but the last must have the same height, a multiple of this
+	virtual int getRowAlignment() const;
+
+	virtual EncodedStrip encode(const Strip& strip) const = 0;
+	virtual void write(const EncodedStrip& strip) = 0;
+
+	// Writes whatever has to follow the pixel data, the file is incomplete until then
+	virtual void finish() = 0;
+};
+
+// Picks the format from the extension: .png, .tif/.tiff (8 bit RGB) or .exr (half float RGB).
+// PNG needs zlib, TIFF and EXR are written uncompressed without it.
+std::unique_ptr<ImageWriter> CreateImageWriter(const std::filesystem::path& path, int width, int height);
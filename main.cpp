@@ -1,9 +1,16 @@
 
 #ifdef _WIN32
 #include <Windows.h>
+#include <io.h>
+#include <fcntl.h>
 #endif
 
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <thread>
 #include <glad/glad.h>
 #include <mogl/mogl.hpp>
 #include <glfwpp/glfwpp.h>
@@ -15,6 +22,20 @@
 #include <efsw/FileSystem.hpp>
 #include <efsw/System.hpp>
 #include <efsw/efsw.hpp>
+#include "dynamic_resolution.hpp"
+#include "frame_encoder.hpp"
+#include "frame_scheduler.hpp"
+#include "gpu_profiler.hpp"
+#include "image_export.hpp"
+#include "progressive_renderer.hpp"
+#include "reload_coordinator.hpp"
+#include "render_graph.hpp"
+#include "shader_compiler.hpp"
+#include "shader_preprocessor.hpp"
+#include "temporal_renderer.hpp"
+#include "trace.hpp"
+#include "uniform_ring.hpp"
+#include "video_capture.hpp"
 
 namespace fs = std::filesystem;
 
@@ -55,113 +76,724 @@ float GetTime() {
 	return time.count();
 }
 
-std::string LoadTextFile(const fs::path& path) {
-	if (!fs::exists(path)) {
-		throw std::runtime_error("file " + path.string() + " does not exist");
-	}
-
-	auto file_size = fs::file_size(path);
-	std::ifstream f(path, std::ios::binary);
-	if (!f) {
-		throw std::runtime_error("failed to open file " + path.string());
+// Sources of the render graph passes in mask, the others are marked unchanged. Buffers
+// without a file get an empty fragment source.
+std::vector<ProgramSources> LoadPassSources(ShaderPreprocessor& shader_preprocessor, uint32_t mask = ~0u)
+{
+	fs::path assets = GetExecDir() / "assets";
+	std::vector<ProgramSources> sources(RenderGraph::pass_count);
+	for (int pass = 0; pass < RenderGraph::pass_count; ++pass) {
+		ProgramSources& pass_sources = sources[pass];
+		pass_sources.name = RenderGraph::GetPassName(pass);
+		if (!(mask & 1u << pass)) {
+			pass_sources.unchanged = true;
+			continue;
+		}
+		const char* file = RenderGraph::GetPassFile(pass);
+		if (pass != RenderGraph::image_pass && !fs::exists(assets / file)) {
+			continue;
+		}
+		try {
+			pass_sources.vertex = shader_preprocessor.process("vertex.glsl", pass_sources.files);
+			pass_sources.fragment = shader_preprocessor.process(file, pass_sources.files);
+		} catch (const std::exception& error) {
+			throw std::runtime_error(pass_sources.name + ": " + error.what());
+		}
 	}
-	std::string str;
-	str.resize(file_size);
-	f.read(&str[0], file_size);
-	return str;
+	return sources;
 }
 
-fs::path GetShaderPath(GLenum type)
+std::vector<RenderGraph::PassProgram> MakePasses(std::vector<std::optional<mogl::ShaderProgram>> programs, const std::vector<ProgramSources>& sources)
 {
-	switch (type) {
-	case GL_VERTEX_SHADER:
-		return GetExecDir() / "assets" / "vertex.glsl";
-	case GL_FRAGMENT_SHADER:
-		return GetExecDir() / "assets" / "fragment.glsl";
-	default:
-		throw std::runtime_error("unsupported shader type");
+	std::vector<RenderGraph::PassProgram> passes(programs.size());
+	for (size_t pass = 0; pass < programs.size(); ++pass) {
+		passes[pass].program = std::move(programs[pass]);
+		passes[pass].animated = IsAnimatedShader(sources[pass].vertex) || IsAnimatedShader(sources[pass].fragment);
 	}
+	return passes;
 }
 
-mogl::ShaderProgram LoadShaders(const fs::path& vertex, const fs::path& fragment)
+struct Options {
+	bool headless = false;
+	int width = 1200;
+	int height = 800;
+	// headless only, 0 means render forever
+	int frames = 0;
+	// headless mode advances Time by 1/fps per frame instead of using the wall clock
+	float fps = 60.f;
+	FrameScheduler::Mode frame_mode = FrameScheduler::Mode::Continuous;
+	// frame rate limit for the capped and on-demand frame modes
+	float max_fps = 60.f;
+	// enables dynamic resolution with this GPU budget for the shader passes
+	float gpu_budget_ms = 0;
+	bool progressive = false;
+	TemporalRenderer::Mode temporal = TemporalRenderer::Mode::Off;
+	// directory to dump frames into, "-" for stdout, empty to discard frames
+	std::string output;
+	FrameFormat frame_format = FrameFormat::PPM;
+	// zlib level for --format png, 0-9
+	int png_level = 6;
+	size_t encode_threads = std::max(std::thread::hardware_concurrency(), 1u);
+	bool bench_uniforms = false;
+	bool bench_encode = false;
+	// Chrome trace written on exit, the UI can save one at any time
+	std::string trace;
+	// files in assets that trigger a reload, anything else (editor swap files...) is ignored
+	std::vector<std::string> watch_patterns;
+	// files and directories in assets the watcher ignores entirely
+	std::vector<std::string> watch_excludes;
+	int reload_debounce_ms = 100;
+	// renders a single image of export_width x export_height at export_time into this file and exits
+	std::string export_path;
+	int export_width = 0;
+	int export_height = 0;
+	float export_time = 0;
+	size_t export_memory_mb = 512;
+	// Y4M video of the window's scene, "-" for stdout
+	std::string capture;
+	float capture_fps = 60.f;
+	// Time advances by 1/capture_fps per frame and no frame is dropped
+	bool capture_fixed = false;
+};
+
+Options ParseOptions(int argc, char** argv)
 {
-	mogl::ShaderProgram shader_program;
-	mogl::Shader vertex_shader(GL_VERTEX_SHADER);
-	mogl::Shader fragment_shader(GL_FRAGMENT_SHADER);
-	for (auto shader: {&vertex_shader, &fragment_shader}) {
-		shader->compile(LoadTextFile(GetShaderPath(shader->getType())));
-		if (!shader->isCompiled())
-		{
-			throw std::runtime_error(shader->getLog());
+	Options options;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		auto next = [&]() -> std::string {
+			if (i + 1 >= argc) {
+				throw std::runtime_error("missing value for " + arg);
+			}
+			return argv[++i];
+		};
+		if (arg == "--headless") {
+			options.headless = true;
+		} else if (arg == "--size") {
+			std::string value = next();
+			if (std::sscanf(value.c_str(), "%dx%d", &options.width, &options.height) != 2 ||
+				options.width <= 0 || options.height <= 0)
+			{
+				throw std::runtime_error("invalid --size " + value + ", expected WIDTHxHEIGHT");
+			}
+		} else if (arg == "--frames") {
+			options.frames = std::stoi(next());
+		} else if (arg == "--fps") {
+			options.fps = std::stof(next());
+			if (options.fps <= 0) {
+				throw std::runtime_error("--fps must be positive");
+			}
+		} else if (arg == "--frame-mode") {
+			std::string value = next();
+			if (value == ToString(FrameScheduler::Mode::Continuous)) {
+				options.frame_mode = FrameScheduler::Mode::Continuous;
+			} else if (value == ToString(FrameScheduler::Mode::Capped)) {
+				options.frame_mode = FrameScheduler::Mode::Capped;
+			} else if (value == ToString(FrameScheduler::Mode::OnDemand)) {
+				options.frame_mode = FrameScheduler::Mode::OnDemand;
+			} else {
+				throw std::runtime_error("invalid --frame-mode " + value + ", expected continuous, capped or on-demand");
+			}
+		} else if (arg == "--max-fps") {
+			options.max_fps = std::stof(next());
+			if (options.max_fps <= 0) {
+				throw std::runtime_error("--max-fps must be positive");
+			}
+		} else if (arg == "--gpu-budget") {
+			options.gpu_budget_ms = std::stof(next());
+			if (options.gpu_budget_ms <= 0) {
+				throw std::runtime_error("--gpu-budget must be positive");
+			}
+		} else if (arg == "--progressive") {
+			options.progressive = true;
+		} else if (arg == "--temporal") {
+			std::string value = next();
+			if (value == ToString(TemporalRenderer::Mode::Half)) {
+				options.temporal = TemporalRenderer::Mode::Half;
+			} else if (value == ToString(TemporalRenderer::Mode::Quarter)) {
+				options.temporal = TemporalRenderer::Mode::Quarter;
+			} else {
+				throw std::runtime_error("invalid --temporal " + value + ", expected half or quarter");
+			}
+		} else if (arg == "--output") {
+			options.output = next();
+		} else if (arg == "--format") {
+			std::string value = next();
+			auto formats = {FrameFormat::PPM, FrameFormat::QOI, FrameFormat::TGA, FrameFormat::PFM, FrameFormat::PNG};
+			auto format = std::find_if(formats.begin(), formats.end(), [&](FrameFormat format) { return value == ToString(format); });
+			if (format == formats.end()) {
+				throw std::runtime_error("invalid --format " + value + ", expected ppm, qoi, tga, pfm or png");
+			}
+			options.frame_format = *format;
+		} else if (arg == "--png-level") {
+			options.png_level = std::stoi(next());
+			if (options.png_level < 0 || options.png_level > 9) {
+				throw std::runtime_error("--png-level must be between 0 and 9");
+			}
+		} else if (arg == "--encode-threads") {
+			int value = std::stoi(next());
+			if (value <= 0) {
+				throw std::runtime_error("--encode-threads must be positive");
+			}
+			options.encode_threads = value;
+		} else if (arg == "--export") {
+			options.export_path = next();
+		} else if (arg == "--export-size") {
+			std::string value = next();
+			if (std::sscanf(value.c_str(), "%dx%d", &options.export_width, &options.export_height) != 2 ||
+				options.export_width <= 0 || options.export_height <= 0)
+			{
+				throw std::runtime_error("invalid --export-size " + value + ", expected WIDTHxHEIGHT");
+			}
+		} else if (arg == "--export-time") {
+			options.export_time = std::stof(next());
+		} else if (arg == "--export-memory") {
+			int value = std::stoi(next());
+			if (value <= 0) {
+				throw std::runtime_error("--export-memory must be positive");
+			}
+			options.export_memory_mb = value;
+		} else if (arg == "--capture") {
+			options.capture = next();
+		} else if (arg == "--capture-fps") {
+			options.capture_fps = std::stof(next());
+			if (options.capture_fps <= 0) {
+				throw std::runtime_error("--capture-fps must be positive");
+			}
+		} else if (arg == "--capture-fixed") {
+			options.capture_fixed = true;
+		} else if (arg == "--watch-pattern") {
+			options.watch_patterns.push_back(next());
+		} else if (arg == "--watch-exclude") {
+			options.watch_excludes.push_back(next());
+		} else if (arg == "--reload-debounce") {
+			options.reload_debounce_ms = std::stoi(next());
+			if (options.reload_debounce_ms < 0) {
+				throw std::runtime_error("--reload-debounce must not be negative");
+			}
+		} else if (arg == "--trace") {
+			options.trace = next();
+		} else if (arg == "--bench-uniforms") {
+			options.bench_uniforms = true;
+		} else if (arg == "--bench-encode") {
+			options.bench_encode = true;
+		} else {
+			throw std::runtime_error("unknown argument " + arg);
 		}
-		shader_program.attach(*shader);
 	}
-	if (!shader_program.link()) {
-		throw std::runtime_error(shader_program.getLog());
+	if (options.watch_patterns.empty()) {
+		options.watch_patterns = {"*.glsl"};
 	}
-	return shader_program;
+	if (!options.export_path.empty() && options.export_width == 0) {
+		options.export_width = options.width;
+		options.export_height = options.height;
+	}
+	return options;
 }
 
-std::atomic_flag shader_program_is_initialized;
+// Mirrors the std140 FrameParams uniform block, see assets/fragment.glsl
+struct FrameParams {
+	float time = 0;
+	float time_delta = 0;
+	int32_t frame = 0;
+	float padding0 = 0;
+	float resolution[2] = {};
+	float jitter[2] = {};
+	float mouse[4] = {};
+	// uv offset and scale of the rendered part of the image, all of it outside of exports
+	float sub_viewport[4] = {0, 0, 1, 1};
+};
+static_assert(sizeof(FrameParams) == 64, "FrameParams must match the std140 layout");
+
+const GLuint frame_params_binding = 0;
+using FrameParamsRing = UniformRing<FrameParams>;
 
-class UpdateListener : public efsw::FileWatchListener
+void DrawShader(mogl::ShaderProgram& shader_program, mogl::UniformHandle<GLfloat>& time_uniform, float time)
 {
-public:
-	void handleFileAction( efsw::WatchID watchid, const std::string& dir, const std::string& filename, efsw::Action action, std::string oldFilename ) override
-	{
-		shader_program_is_initialized.clear();
-	}
+	// shaders that predate the FrameParams block still get Time as a plain uniform
+	time_uniform.set(shader_program, time);
+	shader_program.use();
+
+	glDisable(GL_DEPTH_TEST);
+	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, 0);
+}
+
+// Draws all render graph passes with the params uploaded last, the buffers at buffer_width x buffer_height
+void DrawGraph(RenderGraph& render_graph, int width, int height, int buffer_width, int buffer_height, const FrameParams& params, GpuProfiler* gpu_profiler)
+{
+	render_graph.execute(width, height, buffer_width, buffer_height,
+		[&](mogl::ShaderProgram& program, mogl::UniformHandle<GLfloat>& time_uniform, const char* pass_name) {
+			std::optional<GpuProfiler::Scope> scope;
+			if (gpu_profiler) {
+				scope.emplace(*gpu_profiler, pass_name);
+			}
+			DrawShader(program, time_uniform, params.time);
+		});
+}
+
+// Uploads params once and draws all render graph passes with them, the buffers at buffer_width x buffer_height
+void DrawPasses(RenderGraph& render_graph, int width, int height, int buffer_width, int buffer_height, FrameParamsRing& frame_params_ring, const FrameParams& params, GpuProfiler* gpu_profiler)
+{
+	frame_params_ring.upload(params);
+	DrawGraph(render_graph, width, height, buffer_width, buffer_height, params, gpu_profiler);
+	frame_params_ring.advance();
+}
+
+// Uploads params once and draws all render graph passes with them at the given size
+void DrawPasses(RenderGraph& render_graph, int width, int height, FrameParamsRing& frame_params_ring, const FrameParams& params, GpuProfiler* gpu_profiler)
+{
+	DrawPasses(render_graph, width, height, width, height, frame_params_ring, params, gpu_profiler);
+}
+
+// how often a static shader's frame is redrawn to pick up a finished compile
+const auto compile_poll_interval = std::chrono::milliseconds(10);
+
+// Everything RenderFrame needs that outlives a frame
+struct RenderContext {
+	const Options& options;
+	ShaderCompiler& shader_compiler;
+	FrameParamsRing& frame_params_ring;
+	GpuProfiler& gpu_profiler;
+	FrameScheduler& frame_scheduler;
+	RenderGraph& render_graph;
+	DynamicResolution& dynamic_resolution;
+	ProgressiveRenderer& progressive_renderer;
+	TemporalRenderer& temporal_renderer;
+	ShaderPreprocessor& shader_preprocessor;
+	ReloadCoordinator& reload_coordinator;
+	// null unless capturing
+	VideoCapture* video_capture;
 };
 
-void RenderFrame()
+void RenderFrame(RenderContext& context)
 {
-	ImGui_ImplOpenGL3_NewFrame();
-	ImGui_ImplGlfw_NewFrame();
-	ImGui::NewFrame();
+	TRACE_SCOPE("RenderFrame");
+
+	ShaderCompiler& shader_compiler = context.shader_compiler;
+	GpuProfiler& gpu_profiler = context.gpu_profiler;
+
+	{
+		TRACE_SCOPE("ImGui::NewFrame");
+		ImGui_ImplOpenGL3_NewFrame();
+		ImGui_ImplGlfw_NewFrame();
+		ImGui::NewFrame();
+	}
+
+	gpu_profiler.beginFrame();
 
 	glClear(GL_COLOR_BUFFER_BIT);
 
-	static mogl::ShaderProgram shader_program;
+	RenderGraph& render_graph = context.render_graph;
 	static std::string last_error_message;
-
-	if (!shader_program_is_initialized.test_and_set()) {
+	// passes whose program is older than their sources, until a compile of them succeeds
+	static uint32_t stale_passes = (1u << RenderGraph::pass_count) - 1;
+	static bool first_frame = true;
+
+	// only passes that include a changed file, directly or not, are rebuilt
+	bool request = std::exchange(first_frame, false);
+	std::vector<fs::path> changed = context.reload_coordinator.takeChanged();
+	if (!changed.empty()) {
+		std::set<std::string> affected = context.shader_preprocessor.update(changed);
+		for (int pass = 0; pass < RenderGraph::pass_count; ++pass) {
+			if (affected.count("vertex.glsl") || affected.count(RenderGraph::GetPassFile(pass))) {
+				stale_passes |= 1u << pass;
+				request = true;
+			}
+		}
+	}
+	if (request) {
 		try {
-			shader_program = LoadShaders(
-				GetExecDir() / "assets" / "vertex.glsl",
-				GetExecDir() / "assets" / "fragment.glsl"
-			);
-			last_error_message = {};
+			// a new request supersedes the pending one, so it includes all stale passes
+			shader_compiler.request(LoadPassSources(context.shader_preprocessor, stale_passes));
 		} catch (const std::exception& error) {
 			last_error_message = error.what();
 		}
 	}
 
-	shader_program.setUniform("Time", GetTime());
-	shader_program.use();
+	// the previous programs keep rendering until all new ones are linked
+	if (auto result = shader_compiler.poll()) {
+		if (result->error.empty()) {
+			std::vector<RenderGraph::PassProgram> passes = render_graph.releasePasses();
+			std::vector<RenderGraph::PassProgram> compiled = MakePasses(std::move(result->programs), result->sources);
+			for (int pass = 0; pass < RenderGraph::pass_count; ++pass) {
+				if (!result->sources[pass].unchanged) {
+					passes[pass] = std::move(compiled[pass]);
+					stale_passes &= ~(1u << pass);
+				}
+			}
+			render_graph.setPasses(std::move(passes));
+			context.progressive_renderer.reset();
+			context.temporal_renderer.reset();
+			context.frame_scheduler.setAnimated(render_graph.isAnimated());
+		}
+		last_error_message = result->error;
+	}
+	// the result only shows up through poll(), check again shortly until it does
+	if (shader_compiler.isBusy()) {
+		context.frame_scheduler.requestRedrawAt(FrameScheduler::Clock::now() + compile_poll_interval);
+	}
 
-	glDisable(GL_DEPTH_TEST);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, 0);
+	ImGuiIO& io = ImGui::GetIO();
+	static FrameParams params;
+	float time = context.options.capture_fixed ? params.frame / context.options.capture_fps : GetTime();
+	params.time_delta = time - params.time;
+	params.time = time;
+	params.resolution[0] = io.DisplaySize.x * io.DisplayFramebufferScale.x;
+	params.resolution[1] = io.DisplaySize.y * io.DisplayFramebufferScale.y;
+	params.mouse[0] = io.MousePos.x * io.DisplayFramebufferScale.x;
+	params.mouse[1] = params.resolution[1] - io.MousePos.y * io.DisplayFramebufferScale.y;
+	params.mouse[2] = io.MouseDown[0];
+	params.mouse[3] = io.MouseDown[1];
+
+	// Time and Frame changes are covered by animated passes, the graph can't see the others
+	static float last_mouse[4] = {};
+	if (!std::equal(std::begin(params.mouse), std::end(params.mouse), last_mouse)) {
+		std::copy(std::begin(params.mouse), std::end(params.mouse), last_mouse);
+		render_graph.invalidate();
+		context.progressive_renderer.reset();
+		context.temporal_renderer.reset();
+	}
+
+	// a hitch or a jump in Time can't be reconstructed from history
+	if (params.time_delta > 0.25f || params.time_delta < 0) {
+		context.temporal_renderer.reset();
+	}
+
+	{
+		TRACE_SCOPE("DrawPasses");
+		int width = (int)params.resolution[0];
+		int height = (int)params.resolution[1];
+		if (context.progressive_renderer.enabled) {
+			GpuProfiler::Scope scope(gpu_profiler, "Tiles");
+			// Frame counts samples so accumulating shaders can seed their noise with it
+			FrameParams tile_params = params;
+			tile_params.frame = context.progressive_renderer.getSample();
+			context.frame_params_ring.upload(tile_params);
+			context.progressive_renderer.render(width, height, [&](int tile) {
+				// every tile has to run all passes again, just for its own pixels
+				render_graph.invalidate();
+				// feedback buffers advance once per sample, the other tiles read the same previous sample
+				render_graph.holdFeedback(tile != 0);
+				DrawGraph(render_graph, width, height, width, height, tile_params, nullptr);
+			});
+			render_graph.holdFeedback(false);
+			context.frame_params_ring.advance();
+			// keep converging in on-demand mode
+			context.frame_scheduler.requestRedraw();
+		} else if (context.temporal_renderer.mode != TemporalRenderer::Mode::Off) {
+			context.temporal_renderer.render(width, height, [&](const TemporalRenderer::View& view) {
+				GpuProfiler::Scope scope(gpu_profiler, "Scene");
+				FrameParams view_params = params;
+				std::copy(std::begin(view.resolution), std::end(view.resolution), view_params.resolution);
+				std::copy(std::begin(view.jitter), std::end(view.jitter), view_params.jitter);
+				// buffers that don't read Time or Frame would keep the image of the previous jitter
+				static float last_jitter[2] = {};
+				if (!std::equal(std::begin(view.jitter), std::end(view.jitter), last_jitter)) {
+					std::copy(std::begin(view.jitter), std::end(view.jitter), last_jitter);
+					render_graph.invalidate();
+				}
+				DrawPasses(render_graph, view.width, view.height, view.buffer_width, view.buffer_height, context.frame_params_ring, view_params, &gpu_profiler);
+			});
+			if (!context.temporal_renderer.isConverged()) {
+				context.frame_scheduler.requestRedraw();
+			}
+		} else {
+			context.dynamic_resolution.render(width, height, [&](int scaled_width, int scaled_height) {
+				GpuProfiler::Scope scope(gpu_profiler, "Scene");
+				FrameParams scaled_params = params;
+				scaled_params.resolution[0] = (float)scaled_width;
+				scaled_params.resolution[1] = (float)scaled_height;
+				scaled_params.mouse[0] *= (float)scaled_width / width;
+				scaled_params.mouse[1] *= (float)scaled_height / height;
+				DrawPasses(render_graph, scaled_width, scaled_height, context.frame_params_ring, scaled_params, &gpu_profiler);
+			});
+			if (auto stats = gpu_profiler.getStats("Scene")) {
+				context.dynamic_resolution.update(stats->last);
+			}
+		}
+	}
+	// the scene only, the UI is drawn on top afterwards
+	if (context.video_capture) {
+		context.video_capture->capture(params.time, (int)params.resolution[0], (int)params.resolution[1]);
+		context.frame_scheduler.requestRedraw();
+	}
+	++params.frame;
 
 	ImGui::Begin("SkyContest");
 	ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+	ImGui::Text("Frames waiting on the GPU: %llu", (unsigned long long)context.frame_params_ring.getStallCount());
+	if (shader_compiler.isBusy()) {
+		ImGui::Text("Compiling shaders...");
+	}
+	render_graph.drawStats();
+	context.dynamic_resolution.drawControls();
+	context.progressive_renderer.drawControls();
+	context.temporal_renderer.drawControls();
+	context.frame_scheduler.drawControls();
+	context.reload_coordinator.drawControls();
+	if (context.video_capture) {
+		context.video_capture->drawControls();
+	}
+#ifdef SKY_CONTEST_TRACE
+	if (ImGui::Button("Save trace")) {
+		fs::path path = context.options.trace.empty() ? "sky_contest_trace.json" : context.options.trace;
+		try {
+			trace::WriteChromeTrace(path);
+			last_error_message = {};
+		} catch (const std::exception& error) {
+			last_error_message = error.what();
+		}
+	}
+#endif
 	ImGui::TextColored(ImVec4(1.0f, 0.0f, 1.0f, 1.0f), last_error_message.c_str());
 	ImGui::End();
 
-	ImGui::Render();
-	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+	gpu_profiler.drawPanel();
+
+	{
+		TRACE_SCOPE("ImGui::Render");
+		ImGui::Render();
+		GpuProfiler::Scope scope(gpu_profiler, "ImGui");
+		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+	}
+
+	gpu_profiler.endFrame();
+}
+
+// Compiles all passes on the current context, for the modes without hot reloading
+std::vector<RenderGraph::PassProgram> CompilePasses(const ProgramCache& program_cache)
+{
+	ShaderPreprocessor shader_preprocessor(GetExecDir() / "assets");
+	std::vector<ProgramSources> sources = LoadPassSources(shader_preprocessor);
+	std::vector<std::optional<mogl::ShaderProgram>> programs;
+	for (const ProgramSources& pass_sources: sources) {
+		if (pass_sources.fragment.empty()) {
+			programs.emplace_back();
+			continue;
+		}
+		try {
+			programs.emplace_back(CompileProgram(pass_sources.vertex, pass_sources.fragment, &program_cache));
+		} catch (const std::exception& error) {
+			throw std::runtime_error(pass_sources.name + ": " + MapSourceNames(error.what(), pass_sources.files));
+		}
+	}
+	return MakePasses(std::move(programs), sources);
+}
+
+void RunHeadless(const Options& options, const ProgramCache& program_cache)
+{
+	RenderGraph render_graph;
+	render_graph.setPasses(CompilePasses(program_cache));
+
+	std::optional<FrameEncoder> frame_encoder;
+	if (!options.output.empty()) {
+		frame_encoder.emplace(options.output, options.frame_format, options.png_level, options.encode_threads);
+	}
+	bool float_pixels = options.frame_format == FrameFormat::PFM;
+
+	mogl::Texture color_texture(GL_TEXTURE_2D);
+	color_texture.setStorage2D(1, float_pixels ? GL_RGBA32F : GL_RGBA8, options.width, options.height);
+
+	mogl::FrameBuffer frame_buffer;
+	frame_buffer.setTexture(GL_COLOR_ATTACHMENT0, color_texture);
+	if (!frame_buffer.isComplete(GL_FRAMEBUFFER)) {
+		throw std::runtime_error("offscreen framebuffer is incomplete");
+	}
+	frame_buffer.bind(GL_FRAMEBUFFER);
+	glViewport(0, 0, options.width, options.height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	FrameParamsRing frame_params_ring(frame_params_binding);
+	FrameParams params;
+	params.time_delta = 1.f / options.fps;
+	params.resolution[0] = (float)options.width;
+	params.resolution[1] = (float)options.height;
+
+	const size_t frame_size = (size_t)options.width * options.height * 3 * (float_pixels ? sizeof(float) : 1);
+	auto start = std::chrono::steady_clock::now();
+	int frame = 0;
+
+	for (; options.frames == 0 || frame < options.frames; ++frame) {
+		glClear(GL_COLOR_BUFFER_BIT);
+		params.time = frame / options.fps;
+		params.frame = frame;
+		DrawPasses(render_graph, options.width, options.height, frame_params_ring, params, nullptr);
+
+		if (!frame_encoder) {
+			glFinish();
+			continue;
+		}
+
+		// encoding runs on the workers while the next frame renders
+		Frame pixels {frame, options.width, options.height, std::vector<uint8_t>(frame_size)};
+		color_texture.getImage(0, GL_RGB, frame_encoder->getPixelType(), (GLsizei)frame_size, pixels.pixels.data());
+		frame_encoder->submit(std::move(pixels));
+	}
+	if (frame_encoder) {
+		frame_encoder->finish();
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cerr << "Rendered " << frame << " frames at " << options.width << "x" << options.height
+		<< " in " << elapsed.count() << " s (" << frame / elapsed.count() << " FPS)" << std::endl;
+}
+
+void RunExport(const Options& options, const ProgramCache& program_cache)
+{
+	RenderGraph render_graph;
+	render_graph.setPasses(CompilePasses(program_cache));
+
+	FrameParamsRing frame_params_ring(frame_params_binding);
+	FrameParams params;
+	params.time = options.export_time;
+	params.resolution[0] = (float)options.export_width;
+	params.resolution[1] = (float)options.export_height;
+
+	ExportImage(options.export_path, options.export_width, options.export_height, options.export_memory_mb << 20,
+		[&](const ExportTile& tile) {
+			std::copy(std::begin(tile.sub_viewport), std::end(tile.sub_viewport), params.sub_viewport);
+			// the graph can't see SubViewport changes
+			render_graph.invalidate();
+			DrawPasses(render_graph, tile.width, tile.height, frame_params_ring, params, nullptr);
+		});
+}
+
+// Encodes a few rendered frames over and over in every format, with 1, 2, 4... threads
+void RunEncodeBenchmark(const Options& options, const ProgramCache& program_cache)
+{
+	RenderGraph render_graph;
+	render_graph.setPasses(CompilePasses(program_cache));
+
+	mogl::Texture color_texture(GL_TEXTURE_2D);
+	color_texture.setStorage2D(1, GL_RGBA32F, options.width, options.height);
+	mogl::FrameBuffer frame_buffer;
+	frame_buffer.setTexture(GL_COLOR_ATTACHMENT0, color_texture);
+	if (!frame_buffer.isComplete(GL_FRAMEBUFFER)) {
+		throw std::runtime_error("offscreen framebuffer is incomplete");
+	}
+	frame_buffer.bind(GL_FRAMEBUFFER);
+	glViewport(0, 0, options.width, options.height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	FrameParamsRing frame_params_ring(frame_params_binding);
+	FrameParams params;
+	params.time_delta = 1.f / options.fps;
+	params.resolution[0] = (float)options.width;
+	params.resolution[1] = (float)options.height;
+
+	// distinct frames so the compressors don't see the same input every time
+	const int source_count = 8;
+	std::vector<Frame> byte_frames;
+	std::vector<Frame> float_frames;
+	const size_t pixel_count = (size_t)options.width * options.height * 3;
+	for (int frame = 0; frame < source_count; ++frame) {
+		params.time = frame / options.fps;
+		params.frame = frame;
+		DrawPasses(render_graph, options.width, options.height, frame_params_ring, params, nullptr);
+		byte_frames.push_back({frame, options.width, options.height, std::vector<uint8_t>(pixel_count)});
+		color_texture.getImage(0, GL_RGB, GL_UNSIGNED_BYTE, (GLsizei)pixel_count, byte_frames.back().pixels.data());
+		float_frames.push_back({frame, options.width, options.height, std::vector<uint8_t>(pixel_count * sizeof(float))});
+		color_texture.getImage(0, GL_RGB, GL_FLOAT, (GLsizei)(pixel_count * sizeof(float)), float_frames.back().pixels.data());
+	}
+
+	const int frame_count = options.frames > 0 ? options.frames : 64;
+	std::vector<size_t> thread_counts;
+	for (size_t threads = 1; threads < options.encode_threads; threads *= 2) {
+		thread_counts.push_back(threads);
+	}
+	thread_counts.push_back(options.encode_threads);
+
+	std::cout << std::fixed << std::setprecision(1)
+		<< "Encoding " << frame_count << " frames of " << options.width << "x" << options.height << " per run\n";
+	for (FrameFormat format: {FrameFormat::PPM, FrameFormat::QOI, FrameFormat::TGA, FrameFormat::PFM, FrameFormat::PNG}) {
+		const std::vector<Frame>& frames = format == FrameFormat::PFM ? float_frames : byte_frames;
+		double single_thread_fps = 0;
+		std::cout << ToString(format) << ":";
+		try {
+			size_t encoded_size = EncodeFrame(format, options.png_level, frames[0]).size();
+			for (size_t threads: thread_counts) {
+				FrameEncoder frame_encoder(std::string(), format, options.png_level, threads);
+				auto start = std::chrono::steady_clock::now();
+				for (int frame = 0; frame < frame_count; ++frame) {
+					frame_encoder.submit(frames[frame % source_count]);
+				}
+				frame_encoder.finish();
+				std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+				double fps = frame_count / elapsed.count();
+				single_thread_fps = threads == 1 ? fps : single_thread_fps;
+				std::cout << " " << threads << (threads == 1 ? " thread " : " threads ") << fps << " frames/s"
+					<< " (x" << fps / single_thread_fps << ")" << (threads == thread_counts.back() ? "" : ",");
+			}
+			std::cout << ", " << encoded_size / 1024 << " KiB/frame\n";
+		} catch (const std::exception& error) {
+			std::cout << " " << error.what() << "\n";
+		}
+	}
+	std::cout << std::flush;
+}
+
+template <class F>
+double MeasureNanosecondsPerCall(int count, F&& f)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; ++i) {
+		f(i);
+	}
+	glFinish();
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() / count;
+}
+
+// Compares the string keyed setUniform path with UniformHandle, with and without the GL call
+void RunUniformBenchmark(const ProgramCache& program_cache)
+{
+	ShaderPreprocessor shader_preprocessor(GetExecDir() / "assets");
+	std::vector<std::string> files;
+	std::string vertex_source = shader_preprocessor.process("vertex.glsl", files);
+	mogl::ShaderProgram shader_program = CompileProgram(vertex_source, shader_preprocessor.process("fragment.glsl", files), &program_cache);
+	mogl::UniformHandle<GLfloat> time_uniform("Time");
+	const int count = 1000000;
+	GLint sink = 0;
+
+	double lookup_by_name = MeasureNanosecondsPerCall(count, [&](int) {
+		sink += shader_program.getUniformLocation("Time");
+	});
+	double lookup_by_handle = MeasureNanosecondsPerCall(count, [&](int) {
+		sink += time_uniform.getLocation(shader_program);
+	});
+	double set_by_name = MeasureNanosecondsPerCall(count, [&](int i) {
+		shader_program.setUniform("Time", (GLfloat)i);
+	});
+	double set_by_handle = MeasureNanosecondsPerCall(count, [&](int i) {
+		time_uniform.set(shader_program, (GLfloat)i);
+	});
+
+	std::cout << std::fixed << std::setprecision(2)
+		<< "location lookup: by name " << lookup_by_name << " ns/call, by handle " << lookup_by_handle << " ns/call\n"
+		<< "setUniform:      by name " << set_by_name << " ns/call, by handle " << set_by_handle << " ns/call\n"
+		<< "(" << count << " calls each, checksum " << sink << ")" << std::endl;
 }
 
 int main(int argc, char** argv) {
 	try {
+		Options options = ParseOptions(argc, argv);
+		TRACE_THREAD_NAME("Render");
+
 		auto GLFW = glfw::init();
 
 		glfw::WindowHints window_hints;
 		window_hints.contextVersionMajor = 4;
 		window_hints.contextVersionMinor = 6;
 		window_hints.openglProfile = glfw::OpenGlProfile::Core;
+		if (options.headless || !options.export_path.empty()) {
+			window_hints.visible = false;
+		}
+		if (options.headless) {
+			window_hints.contextCreationApi = glfw::ContextCreationApi::OsMesa;
+		}
 		window_hints.apply();
 
-		glfw::Window window {1200, 800, "SkyContest"};
+		glfw::Window window {options.width, options.height, "SkyContest"};
 		glfw::makeContextCurrent(window);
 
 		glfw::swapInterval(0);
@@ -171,15 +803,6 @@ int main(int argc, char** argv) {
 			throw std::runtime_error("Failed to initialize GLAD");
 		}
 
-		efsw::FileWatcher file_watcher;
-		UpdateListener listener;
-		file_watcher.addWatch( (GetExecDir() / "assets").string(), &listener, true );
-		file_watcher.watch();
-
-		ImGui::CreateContext();
-		ImGui_ImplGlfw_InitForOpenGL(window, true);
-		ImGui_ImplOpenGL3_Init("#version 460 core");
-
 		mogl::ArrayBuffer vertex_buffer;
 		mogl::ElementArrayBuffer index_buffer;
 		mogl::VertexArray vertex_array;
@@ -200,18 +823,128 @@ int main(int argc, char** argv) {
 
 		vertex_array.bind();
 
+		ProgramCache program_cache(GetExecDir() / "shader_cache");
+
+		if (options.bench_uniforms) {
+			RunUniformBenchmark(program_cache);
+			return 0;
+		}
+
+		if (options.bench_encode) {
+			RunEncodeBenchmark(options, program_cache);
+			return 0;
+		}
+
+		if (!options.export_path.empty()) {
+			RunExport(options, program_cache);
+			return 0;
+		}
+
+		if (options.headless) {
+			RunHeadless(options, program_cache);
+			return 0;
+		}
+
+		ShaderCompiler shader_compiler(window, window_hints, &program_cache);
+		FrameParamsRing frame_params_ring(frame_params_binding);
+		GpuProfiler gpu_profiler;
+		FrameScheduler frame_scheduler;
+		RenderGraph render_graph;
+		DynamicResolution dynamic_resolution;
+		ProgressiveRenderer progressive_renderer;
+		progressive_renderer.enabled = options.progressive;
+		TemporalRenderer temporal_renderer;
+		temporal_renderer.mode = options.temporal;
+		dynamic_resolution.enabled = options.gpu_budget_ms > 0;
+		if (dynamic_resolution.enabled) {
+			dynamic_resolution.budget_ms = options.gpu_budget_ms;
+		}
+		frame_scheduler.mode = options.frame_mode;
+		frame_scheduler.max_fps = options.max_fps;
+
+		// any input may change the UI or the Mouse uniform, ImGui chains to these callbacks
+		auto request_redraw = [&frame_scheduler](auto&&...) { frame_scheduler.requestRedraw(); };
+		window.keyEvent.setCallback(request_redraw);
+		window.charEvent.setCallback(request_redraw);
+		window.mouseButtonEvent.setCallback(request_redraw);
+		window.cursorPosEvent.setCallback(request_redraw);
+		window.cursorEnterEvent.setCallback(request_redraw);
+		window.scrollEvent.setCallback(request_redraw);
+		window.focusEvent.setCallback(request_redraw);
+		window.framebufferSizeEvent.setCallback(request_redraw);
+		window.refreshEvent.setCallback(request_redraw);
+
+#ifdef SKY_CONTEST_TRACE
+		efsw::setTraceCallbacks(trace::BeginZone, trace::EndZone);
+#endif
+		efsw::FileWatcher file_watcher;
+		ReloadCoordinator reload_coordinator(frame_scheduler, options.watch_patterns);
+		reload_coordinator.debounce = std::chrono::milliseconds(options.reload_debounce_ms);
+		reload_coordinator.prime(GetExecDir() / "assets");
+		ShaderPreprocessor shader_preprocessor(GetExecDir() / "assets");
+		// the watcher drops the other names before building events, and never watches the
+		// excluded directories
+		efsw::WatchFilter watch_filter;
+		watch_filter.Include = options.watch_patterns;
+		watch_filter.Exclude = options.watch_excludes;
+		file_watcher.addWatch( (GetExecDir() / "assets").string(), &reload_coordinator, true, watch_filter );
+		// events are dispatched on this thread, the scheduler only wakes it up for them.
+		// Without a descriptor (generic polling backend) dispatch() would rescan the whole
+		// tree every frame, so the watcher runs its own thread and the listener, which is
+		// thread safe, requests the redraws.
+		const int watcher_fd = file_watcher.getFileDescriptor();
+		if (watcher_fd != -1) {
+			frame_scheduler.setWakeupDescriptor(watcher_fd);
+		} else {
+			file_watcher.watch();
+		}
+
+		ImGui::CreateContext();
+		ImGui_ImplGlfw_InitForOpenGL(window, true);
+		ImGui_ImplOpenGL3_Init("#version 460 core");
+
+		std::unique_ptr<VideoCapture> video_capture;
+		if (!options.capture.empty()) {
+			auto [width, height] = window.getFramebufferSize();
+			video_capture = std::make_unique<VideoCapture>(options.capture, width, height, options.capture_fps, options.capture_fixed);
+		}
+
+		RenderContext render_context {options, shader_compiler, frame_params_ring, gpu_profiler, frame_scheduler, render_graph, dynamic_resolution, progressive_renderer, temporal_renderer, shader_preprocessor, reload_coordinator, video_capture.get()};
+
 		while (!window.shouldClose())
 		{
 			if (window.getKey(glfw::KeyCode::Escape)) {
 				window.setShouldClose(true);
 			}
 
-			RenderFrame();
+			// doesn't block, the listener requests a redraw for relevant changes
+			if (watcher_fd != -1) {
+				file_watcher.dispatch();
+			}
+
+			if (!frame_scheduler.waitForFrame()) {
+				continue;
+			}
+
+			RenderFrame(render_context);
+
+			{
+				TRACE_SCOPE("swapBuffers");
+				window.swapBuffers();
+			}
+			frame_scheduler.frameRendered();
+		}
 
-			window.swapBuffers();
-			glfw::pollEvents();
+		if (video_capture) {
+			video_capture->finish();
 		}
 
+#ifdef SKY_CONTEST_TRACE
+		if (!options.trace.empty()) {
+			trace::WriteChromeTrace(options.trace);
+		}
+#endif
+
 		ImGui_ImplOpenGL3_Shutdown();
 		ImGui_ImplGlfw_Shutdown();
 		ImGui::DestroyContext();
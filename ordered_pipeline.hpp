@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs jobs on worker threads and passes their results to a consumer in submission
+// order, one result at a time, on whichever worker completes the next one in line.
+// submit() blocks while max_in_flight jobs are queued, running or waiting for their
+// turn, so memory stays bounded when the producer is faster than the workers. The
+// first exception from a job or the consumer is rethrown by submit() or finish().
+template <class Result>
+class OrderedPipeline
+{
+public:
+	using Job = std::function<Result()>;
+	using Consumer = std::function<void(Result&)>;
+
+	OrderedPipeline(Consumer consumer, size_t thread_count, size_t max_in_flight)
+		: consumer(std::move(consumer))
+		, max_in_flight(std::max<size_t>(max_in_flight, 1))
+	{
+		thread_count = std::max<size_t>(thread_count, 1);
+		for (size_t i = 0; i < thread_count; ++i) {
+			threads.emplace_back(&OrderedPipeline::run, this);
+		}
+	}
+
+	~OrderedPipeline()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		condition.notify_all();
+		for (auto& thread: threads) {
+			thread.join();
+		}
+	}
+
+	OrderedPipeline(const OrderedPipeline&) = delete;
+	OrderedPipeline& operator=(const OrderedPipeline&) = delete;
+
+	void submit(Job job)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		space.wait(lock, [&] { return error || submitted - consumed < max_in_flight; });
+		rethrow();
+		jobs.push_back({submitted++, std::move(job)});
+		condition.notify_one();
+	}
+
+	// Waits until every submitted result went through the consumer
+	void finish()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		space.wait(lock, [&] { return error || consumed == submitted; });
+		rethrow();
+	}
+
+	// Jobs submitted but not consumed yet
+	size_t getInFlight()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return submitted - consumed;
+	}
+
+private:
+	struct Queued {
+		uint64_t sequence;
+		Job job;
+	};
+
+	void rethrow()
+	{
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			condition.wait(lock, [&] { return stop || !jobs.empty(); });
+			if (stop) {
+				break;
+			}
+			Queued queued = std::move(jobs.front());
+			jobs.pop_front();
+			lock.unlock();
+
+			Result result;
+			std::exception_ptr job_error;
+			try {
+				result = queued.job();
+			} catch (...) {
+				job_error = std::current_exception();
+			}
+
+			lock.lock();
+			if (job_error) {
+				error = error ? error : job_error;
+				space.notify_all();
+				continue;
+			}
+			finished.emplace(queued.sequence, std::move(result));
+			if (consuming) {
+				continue;
+			}
+			// drain everything that is next in line, other workers keep encoding meanwhile
+			consuming = true;
+			for (auto it = finished.find(consumed); it != finished.end() && !error; it = finished.find(consumed)) {
+				Result next = std::move(it->second);
+				finished.erase(it);
+				lock.unlock();
+				try {
+					consumer(next);
+				} catch (...) {
+					job_error = std::current_exception();
+				}
+				lock.lock();
+				if (job_error) {
+					error = error ? error : job_error;
+				}
+				++consumed;
+				space.notify_all();
+			}
+			consuming = false;
+		}
+	}
+
+	Consumer consumer;
+	size_t max_in_flight;
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::condition_variable space;
+	std::deque<Queued> jobs;
+	std::map<uint64_t, Result> finished;
+	uint64_t submitted = 0;
+	uint64_t consumed = 0;
+	bool consuming = false;
+	bool stop = false;
+	std::exception_ptr error;
+};
@@ -0,0 +1,120 @@
+#include "program_cache.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// FNV-1a, fast and good enough to tell shader sources apart
+uint64_t Hash(uint64_t hash, std::string_view data)
+{
+	for (unsigned char c: data) {
+		hash ^= c;
+		hash *= 0x100000001b3ull;
+	}
+	// separator, so ("ab", "c") and ("a", "bc") hash differently
+	hash ^= 0xff;
+	hash *= 0x100000001b3ull;
+	return hash;
+}
+
+std::string_view GetDriverString(GLenum name)
+{
+	auto str = (const char*)glGetString(name);
+	return str ? str : "";
+}
+
+bool HasBinaryFormats()
+{
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+}
+
+ProgramCache::ProgramCache(fs::path directory_)
+	: directory(std::move(directory_))
+{
+}
+
+std::string ProgramCache::key(std::initializer_list<std::string_view> sources) const
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (GLenum name: {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+		hash = Hash(hash, GetDriverString(name));
+	}
+	for (auto source: sources) {
+		hash = Hash(hash, source);
+	}
+	std::stringstream stream;
+	stream << std::hex << std::setw(16) << std::setfill('0') << hash;
+	return stream.str();
+}
+
+bool ProgramCache::load(const std::string& key, mogl::ShaderProgram& shader_program) const
+{
+	fs::path path = directory / (key + ".bin");
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	GLenum format = 0;
+	file.read((char*)&format, sizeof(format));
+	std::string binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	bool read_ok = !file.bad() && !binary.empty();
+	file.close();
+
+	mogl::ShaderProgram program;
+	if (read_ok) {
+		program.setBinary(format, binary.data(), (GLsizei)binary.size());
+	}
+	if (!read_ok || !program.endLink()) {
+		// driver update or corrupted file, fall back to a full compile
+		std::error_code ec;
+		fs::remove(path, ec);
+		return false;
+	}
+	shader_program = std::move(program);
+	return true;
+}
+
+void ProgramCache::store(const std::string& key, mogl::ShaderProgram& shader_program) const
+{
+	if (!HasBinaryFormats()) {
+		return;
+	}
+
+	GLenum format = 0;
+	std::vector<GLubyte> binary = shader_program.getBinary(&format);
+	if (binary.empty()) {
+		return;
+	}
+
+	std::error_code ec;
+	fs::create_directories(directory, ec);
+
+	// write to a temporary file first so a crash never leaves a truncated entry behind
+	fs::path path = directory / (key + ".bin");
+	fs::path temp_path = directory / (key + ".tmp");
+	{
+		std::ofstream file(temp_path, std::ios::binary);
+		file.write((const char*)&format, sizeof(format));
+		file.write((const char*)binary.data(), binary.size());
+		if (!file) {
+			std::cerr << "failed to write program cache entry " << temp_path.string() << std::endl;
+			return;
+		}
+	}
+	fs::rename(temp_path, path, ec);
+	if (ec) {
+		fs::remove(temp_path, ec);
+	}
+}
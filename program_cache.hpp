@@ -0,0 +1,30 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <mogl/mogl.hpp>
+#include <filesystem>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+// Persists linked program binaries on disk so unchanged shaders skip the driver compiler.
+// Entries are keyed by the shader sources (including any defines prepended to them)
+// and the driver vendor, renderer and version, so a driver update invalidates them.
+class ProgramCache
+{
+public:
+	explicit ProgramCache(std::filesystem::path directory);
+
+	// Needs a current context, the driver strings are part of the key
+	std::string key(std::initializer_list<std::string_view> sources) const;
+
+	// Loads and links a cached binary into a fresh program, false if it is missing or the
+	// driver rejects it (rejected entries are deleted)
+	bool load(const std::string& key, mogl::ShaderProgram& shader_program) const;
+
+	// The program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+	void store(const std::string& key, mogl::ShaderProgram& shader_program) const;
+
+private:
+	std::filesystem::path directory;
+};
@@ -0,0 +1,234 @@
+#include "progressive_renderer.hpp"
+#include "shader_compiler.hpp"
+#include "trace.hpp"
+
+#include <imgui.h>
+#include <algorithm>
+
+namespace {
+
+const char* const composite_fragment_source = R"(#version 460 core
+layout (location=0) in vec2 uv;
+out vec4 out_color;
+uniform sampler2D Scene;
+void main()
+{
+	out_color = vec4(texelFetch(Scene, ivec2(gl_FragCoord.xy), 0).rgb, 1.0);
+}
+)";
+
+// d-th cell of a Hilbert curve over an n x n grid, n a power of two
+void HilbertToXY(int n, int d, int& x, int& y)
+{
+	x = 0;
+	y = 0;
+	for (int s = 1, t = d; s < n; s *= 2, t /= 4) {
+		int rx = 1 & (t / 2);
+		int ry = 1 & (t ^ rx);
+		if (ry == 0) {
+			if (rx == 1) {
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			std::swap(x, y);
+		}
+		x += s * rx;
+		y += s * ry;
+	}
+}
+
+}
+
+ProgressiveRenderer::ProgressiveRenderer()
+	: composite_program(CompileProgram(fullscreen_vertex_source, composite_fragment_source))
+{
+	composite_program.setUniform<GLint>("Scene", 0);
+}
+
+void ProgressiveRenderer::reset()
+{
+	sample = 0;
+	next_tile = 0;
+	if (accumulation) {
+		glClearTexImage(accumulation->getHandle(), 0, GL_RGBA, GL_FLOAT, nullptr);
+	}
+}
+
+int ProgressiveRenderer::getSample() const
+{
+	return sample;
+}
+
+void ProgressiveRenderer::allocate(int width_, int height_)
+{
+	TRACE_SCOPE("ProgressiveRenderer::allocate");
+	width = width_;
+	height = height_;
+	scene = std::make_unique<mogl::Texture>(GL_TEXTURE_2D);
+	scene->setStorage2D(1, GL_RGBA16F, width, height);
+	scene_frame_buffer.setTexture(GL_COLOR_ATTACHMENT0, *scene);
+	accumulation = std::make_unique<mogl::Texture>(GL_TEXTURE_2D);
+	accumulation->setStorage2D(1, GL_RGBA32F, width, height);
+	accumulation_frame_buffer.setTexture(GL_COLOR_ATTACHMENT0, *accumulation);
+	buildTiles();
+}
+
+void ProgressiveRenderer::buildTiles()
+{
+	tile_size = std::max(tile_size, 16);
+	built_tile_size = tile_size;
+	built_tile_order = tile_order;
+
+	int columns = (width + tile_size - 1) / tile_size;
+	int rows = (height + tile_size - 1) / tile_size;
+	auto make_tile = [&](int column, int row) {
+		int x = column * tile_size;
+		int y = row * tile_size;
+		return Tile {x, y, std::min(tile_size, width - x), std::min(tile_size, height - y)};
+	};
+
+	tiles.clear();
+	switch (tile_order) {
+	case TileOrder::Scanline:
+		// top row first, GL rows start at the bottom
+		for (int row = rows - 1; row >= 0; --row) {
+			for (int column = 0; column < columns; ++column) {
+				tiles.push_back(make_tile(column, row));
+			}
+		}
+		break;
+	case TileOrder::Hilbert: {
+		int n = 1;
+		while (n < columns || n < rows) {
+			n *= 2;
+		}
+		for (int d = 0; d < n * n; ++d) {
+			int column, row;
+			HilbertToXY(n, d, column, row);
+			if (column < columns && row < rows) {
+				tiles.push_back(make_tile(column, row));
+			}
+		}
+		break;
+	}
+	case TileOrder::CentreOut:
+		for (int row = 0; row < rows; ++row) {
+			for (int column = 0; column < columns; ++column) {
+				tiles.push_back(make_tile(column, row));
+			}
+		}
+		std::stable_sort(tiles.begin(), tiles.end(), [&](const Tile& a, const Tile& b) {
+			auto distance = [&](const Tile& tile) {
+				float dx = tile.x + tile.width * 0.5f - width * 0.5f;
+				float dy = tile.y + tile.height * 0.5f - height * 0.5f;
+				return dx * dx + dy * dy;
+			};
+			return distance(a) < distance(b);
+		});
+		break;
+	}
+	reset();
+}
+
+void ProgressiveRenderer::collect()
+{
+	while (slots[slot_read].pending) {
+		Slot& slot = slots[slot_read];
+		if (!slot.end.get<GLint>(GL_QUERY_RESULT_AVAILABLE)) {
+			break;
+		}
+		GLuint64 begin = slot.begin.get<GLuint64>(GL_QUERY_RESULT);
+		GLuint64 end = slot.end.get<GLuint64>(GL_QUERY_RESULT);
+		float ms = (end - begin) / 1e6f / slot.tiles;
+		tile_ms = tile_ms > 0 ? tile_ms * 0.8f + ms * 0.2f : ms;
+		slot.pending = false;
+		slot_read = (slot_read + 1) % slots.size();
+	}
+}
+
+void ProgressiveRenderer::render(int width_, int height_, const std::function<void(int tile)>& draw_scene)
+{
+	TRACE_SCOPE("ProgressiveRenderer::render");
+	if (width_ <= 0 || height_ <= 0) {
+		return;
+	}
+	if (width_ != width || height_ != height) {
+		allocate(width_, height_);
+	} else if (tile_size != built_tile_size || tile_order != built_tile_order) {
+		buildTiles();
+	}
+	collect();
+
+	// a sample never spans frames, so all tiles of a frame share the Frame uniform
+	int tile_count = tile_ms > 0 ? std::max(1, (int)(budget_ms / tile_ms)) : 1;
+	tile_count = std::min(tile_count, (int)(tiles.size() - next_tile));
+	tiles_last_frame = tile_count;
+
+	// the ring is full of pending queries, render without measuring
+	Slot& slot = slots[slot_write];
+	bool measure = !slot.pending;
+	if (measure) {
+		slot.begin.queryCounter();
+	}
+
+	GLint output_frame_buffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &output_frame_buffer);
+	glViewport(0, 0, width, height);
+	glEnable(GL_SCISSOR_TEST);
+	glBlendColor(0, 0, 0, accumulate ? 1.f / (sample + 1) : 1.f);
+	glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+	for (int i = 0; i < tile_count; ++i) {
+		int tile_index = (int)next_tile++;
+		const Tile& tile = tiles[tile_index];
+		glScissor(tile.x, tile.y, tile.width, tile.height);
+
+		scene_frame_buffer.bind(GL_DRAW_FRAMEBUFFER);
+		draw_scene(tile_index);
+
+		accumulation_frame_buffer.bind(GL_DRAW_FRAMEBUFFER);
+		glViewport(0, 0, width, height);
+		glEnable(GL_BLEND);
+		composite_program.use();
+		scene->bind(0);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glDisable(GL_BLEND);
+	}
+	glDisable(GL_SCISSOR_TEST);
+	if (next_tile == tiles.size()) {
+		next_tile = 0;
+		++sample;
+	}
+
+	if (measure) {
+		slot.end.queryCounter();
+		slot.tiles = tile_count;
+		slot.pending = true;
+		slot_write = (slot_write + 1) % slots.size();
+	}
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, output_frame_buffer);
+	glBlitNamedFramebuffer(accumulation_frame_buffer.getHandle(), output_frame_buffer,
+		0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+}
+
+void ProgressiveRenderer::drawControls()
+{
+	if (ImGui::Checkbox("Progressive", &enabled)) {
+		reset();
+	}
+	if (!enabled) {
+		return;
+	}
+	ImGui::SliderFloat("Tile budget", &budget_ms, 1.f, 50.f, "%.1f ms");
+	ImGui::SliderInt("Tile size", &tile_size, 16, 512);
+	int order = (int)tile_order;
+	const char* orders[] = {"scanline", "hilbert", "centre-out"};
+	if (ImGui::Combo("Tile order", &order, orders, IM_ARRAYSIZE(orders))) {
+		tile_order = (TileOrder)order;
+	}
+	if (ImGui::Checkbox("Accumulate samples", &accumulate)) {
+		reset();
+	}
+	ImGui::Text("Sample %d, %d/%d tiles, %d this frame at %.2f ms each",
+		sample, (int)next_tile, (int)tiles.size(), tiles_last_frame, tile_ms);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <mogl/mogl.hpp>
+#include <array>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Renders the scene a few scissored tiles per frame, as many as fit budget_ms of GPU
+// time, so shaders that take seconds per frame neither block the UI nor trip the driver
+// watchdog. The cost of a tile comes from GL_TIMESTAMP queries read back without
+// stalling. Each finished sweep over all tiles is one sample, with accumulate on the
+// samples are averaged in a float target until reset() is called.
+//
+// The scissor applies to every pass of the scene, so passes must only depend on their
+// own pixel of other buffers. Feedback buffers have to advance once per sample rather
+// than per tile, draw_scene gets the tile index to tell the first tile of a sample.
+class ProgressiveRenderer
+{
+public:
+	enum class TileOrder {
+		Scanline,
+		Hilbert,
+		CentreOut,
+	};
+
+	bool enabled = false;
+	bool accumulate = true;
+	float budget_ms = 10.f;
+	int tile_size = 128;
+	TileOrder tile_order = TileOrder::Hilbert;
+
+	ProgressiveRenderer();
+
+	// Restarts from the first sample, e.g. after the shader or its inputs changed
+	void reset();
+
+	// The sample index the tiles of the next render() belong to, for the Frame uniform
+	int getSample() const;
+
+	// draw_scene draws the whole scene into the bound framebuffer and is called once per
+	// tile with the scissor set and the index of the tile in the sample, 0 for the first.
+	// The accumulated image is blitted into the framebuffer that was bound at the call.
+	void render(int width, int height, const std::function<void(int tile)>& draw_scene);
+
+	// Must be called inside an ImGui window
+	void drawControls();
+
+private:
+	struct Tile {
+		int x;
+		int y;
+		int width;
+		int height;
+	};
+
+	struct Slot {
+		mogl::Query begin {GL_TIMESTAMP};
+		mogl::Query end {GL_TIMESTAMP};
+		int tiles = 0;
+		bool pending = false;
+	};
+
+	void allocate(int width, int height);
+	void buildTiles();
+	void collect();
+
+	int width = 0;
+	int height = 0;
+	int built_tile_size = 0;
+	TileOrder built_tile_order = TileOrder::Hilbert;
+	std::vector<Tile> tiles;
+	size_t next_tile = 0;
+	int sample = 0;
+	// running estimate of the GPU time of one tile, 0 until measured
+	float tile_ms = 0;
+	int tiles_last_frame = 0;
+	std::array<Slot, 6> slots;
+	size_t slot_write = 0;
+	size_t slot_read = 0;
+	std::unique_ptr<mogl::Texture> scene;
+	std::unique_ptr<mogl::Texture> accumulation;
+	mogl::FrameBuffer scene_frame_buffer;
+	mogl::FrameBuffer accumulation_frame_buffer;
+	mogl::ShaderProgram composite_program;
+};
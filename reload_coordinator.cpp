@@ -0,0 +1,311 @@
+#include "reload_coordinator.hpp"
+#include "frame_scheduler.hpp"
+#include "trace.hpp"
+
+#include <imgui.h>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+uint64_t MurmurHash64A(const void* key, size_t size, uint64_t seed)
+{
+	const uint64_t m = 0xc6a4a7935bd1e995ull;
+	const int r = 47;
+	uint64_t h = seed ^ (size * m);
+
+	const uint8_t* data = (const uint8_t*)key;
+	const uint8_t* end = data + size / 8 * 8;
+	for (; data != end; data += 8) {
+		uint64_t k;
+		std::memcpy(&k, data, 8);
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+		h ^= k;
+		h *= m;
+	}
+
+	switch (size & 7) {
+	case 7: h ^= uint64_t(data[6]) << 48; [[fallthrough]];
+	case 6: h ^= uint64_t(data[5]) << 40; [[fallthrough]];
+	case 5: h ^= uint64_t(data[4]) << 32; [[fallthrough]];
+	case 4: h ^= uint64_t(data[3]) << 24; [[fallthrough]];
+	case 3: h ^= uint64_t(data[2]) << 16; [[fallthrough]];
+	case 2: h ^= uint64_t(data[1]) << 8; [[fallthrough]];
+	case 1: h ^= uint64_t(data[0]);
+		h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+	return h;
+}
+
+const uint64_t hash_seed = 0x5eed;
+
+// efsw may report the watched directory through a symlink or resolved
+fs::path NormalizePath(const fs::path& path)
+{
+	std::error_code error;
+	fs::path normal = fs::weakly_canonical(path, error);
+	return error ? path.lexically_normal() : normal;
+}
+
+}
+
+bool MatchGlob(const char* pattern, const char* name)
+{
+	// backtracks to the last *, enough for patterns without character classes
+	const char* star = nullptr;
+	const char* resume = nullptr;
+	while (*name) {
+		if (*pattern == '*') {
+			star = pattern++;
+			resume = name;
+		} else if (*pattern == '?' || *pattern == *name) {
+			++pattern;
+			++name;
+		} else if (star) {
+			pattern = star + 1;
+			name = ++resume;
+		} else {
+			return false;
+		}
+	}
+	while (*pattern == '*') {
+		++pattern;
+	}
+	return !*pattern;
+}
+
+std::optional<uint64_t> HashFile(const fs::path& path)
+{
+	TRACE_SCOPE("HashFile");
+#ifdef _WIN32
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return std::nullopt;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		return std::nullopt;
+	}
+	if (size.QuadPart == 0) {
+		CloseHandle(file);
+		return MurmurHash64A(nullptr, 0, hash_seed);
+	}
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping) {
+		return std::nullopt;
+	}
+	const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!data) {
+		return std::nullopt;
+	}
+	uint64_t hash = MurmurHash64A(data, (size_t)size.QuadPart, hash_seed);
+	UnmapViewOfFile(data);
+	return hash;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return std::nullopt;
+	}
+	struct stat status;
+	if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode)) {
+		close(fd);
+		return std::nullopt;
+	}
+	// a mapping raises SIGBUS when an editor truncates the file while it's hashed, so the
+	// shader sized files are read into a buffer reused between calls. Reading up to end of
+	// file copes with the size changing after fstat, the spare byte takes the final empty read.
+	static thread_local std::vector<char> buffer;
+	if (buffer.size() < (size_t)status.st_size + 1) {
+		buffer.resize((size_t)status.st_size + 1);
+	}
+	size_t size = 0;
+	while (true) {
+		if (size == buffer.size()) {
+			buffer.resize(buffer.size() * 2);
+		}
+		ssize_t count = pread(fd, buffer.data() + size, buffer.size() - size, (off_t)size);
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		if (count < 0) {
+			close(fd);
+			return std::nullopt;
+		}
+		if (count == 0) {
+			break;
+		}
+		size += (size_t)count;
+	}
+	close(fd);
+	return MurmurHash64A(buffer.data(), size, hash_seed);
+#endif
+}
+
+ReloadCoordinator::ReloadCoordinator(FrameScheduler& frame_scheduler, std::vector<std::string> patterns)
+	: frame_scheduler(frame_scheduler)
+	, patterns(std::move(patterns))
+{
+}
+
+bool ReloadCoordinator::matches(const char* filename) const
+{
+	for (const std::string& pattern: patterns) {
+		if (MatchGlob(pattern.c_str(), filename)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void ReloadCoordinator::prime(const fs::path& directory)
+{
+	std::error_code error;
+	for (fs::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+		if (it->is_regular_file() && matches(it->path().filename().string().c_str())) {
+			fs::path path = NormalizePath(it->path());
+			if (auto hash = HashFile(path)) {
+				hashes[path] = *hash;
+			}
+		}
+	}
+}
+
+bool ReloadCoordinator::addEvent(const std::string& dir, const char* filename)
+{
+	++events;
+	// checked on the bare name, ignored files never build a path
+	if (!matches(filename)) {
+		++ignored_events;
+		return false;
+	}
+	if (!pending.insert(NormalizePath(fs::path(dir) / filename)).second) {
+		++coalesced_events;
+	}
+	return true;
+}
+
+void ReloadCoordinator::handleFileActions(const efsw::FileEvent* batch, size_t count)
+{
+	TRACE_SCOPE("ReloadCoordinator::handleFileActions");
+	bool any = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t i = 0; i < count; ++i) {
+			const efsw::FileEvent& event = batch[i];
+			any |= addEvent(*event.Directory, event.Filename);
+			if (event.Type == efsw::Actions::Moved) {
+				any |= addEvent(*event.Directory, event.OldFilename);
+			}
+		}
+		if (any) {
+			last_event = Clock::now();
+		}
+	}
+	if (any) {
+		frame_scheduler.requestRedraw();
+	}
+}
+
+void ReloadCoordinator::handleMissedFileActions(efsw::WatchID, const std::string& dir)
+{
+	fs::path directory = NormalizePath(dir);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		rescans.insert(directory.has_filename() ? directory : directory.parent_path());
+		last_event = Clock::now();
+	}
+	frame_scheduler.requestRedraw();
+}
+
+std::vector<fs::path> ReloadCoordinator::takeChanged()
+{
+	std::set<fs::path> settled;
+	std::set<fs::path> rescanned;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (pending.empty() && rescans.empty()) {
+			return {};
+		}
+		if (Clock::now() - last_event < debounce) {
+			// nothing else wakes the render thread once the events stop
+			frame_scheduler.requestRedrawAt(last_event + debounce);
+			return {};
+		}
+		settled = std::move(pending);
+		pending.clear();
+		rescanned = std::move(rescans);
+		rescans.clear();
+	}
+
+	TRACE_SCOPE("ReloadCoordinator::takeChanged");
+	for (const fs::path& directory: rescanned) {
+		// deleted files are only known by their hashes
+		for (const auto& known: hashes) {
+			fs::path relative = known.first.lexically_relative(directory);
+			if (!relative.empty() && *relative.begin() != "..") {
+				settled.insert(known.first);
+			}
+		}
+		std::error_code error;
+		for (fs::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+			if (it->is_regular_file() && matches(it->path().filename().string().c_str())) {
+				settled.insert(NormalizePath(it->path()));
+			}
+		}
+	}
+	std::vector<fs::path> changed;
+	for (const fs::path& path: settled) {
+		std::optional<uint64_t> hash = HashFile(path);
+		auto it = hashes.find(path);
+		if (!hash) {
+			// deleted, unless it never existed as far as we know (a temporary file)
+			if (it != hashes.end()) {
+				hashes.erase(it);
+				changed.push_back(path);
+			}
+			continue;
+		}
+		if (it != hashes.end() && it->second == *hash) {
+			++unchanged_files;
+			continue;
+		}
+		hashes[path] = *hash;
+		changed.push_back(path);
+	}
+	if (!changed.empty()) {
+		++reloads;
+	}
+	return changed;
+}
+
+void ReloadCoordinator::drawControls()
+{
+	int debounce_ms = (int)debounce.count();
+	ImGui::SliderInt("Reload debounce (ms)", &debounce_ms, 0, 1000);
+	debounce = std::chrono::milliseconds(debounce_ms);
+	std::lock_guard<std::mutex> lock(mutex);
+	ImGui::Text("File events: %llu, %llu ignored, %llu coalesced", (unsigned long long)events,
+		(unsigned long long)ignored_events, (unsigned long long)coalesced_events);
+	ImGui::Text("Reloads: %llu, %llu saves without changes skipped", (unsigned long long)reloads, (unsigned long long)unchanged_files);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <efsw/efsw.hpp>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+class FrameScheduler;
+
+// Turns the raw event stream of the file watcher into reloads. Events for files that
+// match none of the glob patterns (editor swap and backup files...) are dropped, the
+// rest are collected until no event arrived for the debounce window, so the several
+// events of one save and half-written files never trigger a compile. A settled file
+// only counts as changed when the hash of its bytes differs from the last one seen.
+// The events arrive in batches, a burst like a checkout takes the lock once per read.
+class ReloadCoordinator : public efsw::FileWatchBatchListener
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	std::chrono::milliseconds debounce {100};
+
+	ReloadCoordinator(FrameScheduler& frame_scheduler, std::vector<std::string> patterns);
+
+	// Remembers the hashes of all matching files below directory, so the first save of
+	// an unchanged file is recognised too
+	void prime(const std::filesystem::path& directory);
+
+	void handleFileActions(const efsw::FileEvent* batch, size_t count) override;
+
+	// The watcher lost events below dir, takeChanged() rehashes all of it
+	void handleMissedFileActions(efsw::WatchID watchid, const std::string& dir) override;
+
+	// Files whose content changed since the last call, once the events settled.
+	// Deleted files are included. Must be called from the render thread.
+	std::vector<std::filesystem::path> takeChanged();
+
+	// Must be called inside an ImGui window
+	void drawControls();
+
+private:
+	bool matches(const char* filename) const;
+
+	// Must be called with the mutex locked. Returns false if the file is ignored.
+	bool addEvent(const std::string& dir, const char* filename);
+
+	FrameScheduler& frame_scheduler;
+	std::vector<std::string> patterns;
+
+	std::mutex mutex;
+	std::set<std::filesystem::path> pending;
+	// directories whose events were lost, all their matching files count as pending
+	std::set<std::filesystem::path> rescans;
+	Clock::time_point last_event;
+	uint64_t events = 0;
+	uint64_t ignored_events = 0;
+	uint64_t coalesced_events = 0;
+
+	// render thread only, except for prime()
+	std::map<std::filesystem::path, uint64_t> hashes;
+	uint64_t reloads = 0;
+	uint64_t unchanged_files = 0;
+};
+
+// * matches any run of characters, ? any single one
+bool MatchGlob(const char* pattern, const char* name);
+
+// 64-bit MurmurHash2 of the file contents, read into a reused buffer (a memory mapping on
+// Windows, where files can't be truncated while mapped). Returns nullopt if the file can't be read.
+std::optional<uint64_t> HashFile(const std::filesystem::path& path);
@@ -0,0 +1,286 @@
+#include "render_graph.hpp"
+#include "trace.hpp"
+
+#include <imgui.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+const char* const pass_names[RenderGraph::pass_count] = {"BufferA", "BufferB", "BufferC", "BufferD", "Image"};
+const char* const pass_files[RenderGraph::pass_count] = {"buffer_a.glsl", "buffer_b.glsl", "buffer_c.glsl", "buffer_d.glsl", "fragment.glsl"};
+
+const GLenum buffer_format = GL_RGBA16F;
+const int buffer_pixel_size = 8;
+
+bool Reads(uint32_t inputs, int buffer)
+{
+	return (inputs >> buffer) & 1;
+}
+
+}
+
+const char* RenderGraph::GetPassName(int pass)
+{
+	return pass_names[pass];
+}
+
+const char* RenderGraph::GetPassFile(int pass)
+{
+	return pass_files[pass];
+}
+
+void RenderGraph::setPasses(std::vector<PassProgram> pass_programs)
+{
+	if (pass_programs.size() != pass_count || !pass_programs[image_pass].program) {
+		throw std::runtime_error("render graph needs an Image pass");
+	}
+
+	for (int pass = 0; pass < pass_count; ++pass) {
+		passes[pass] = Pass {};
+		passes[pass].program = std::move(pass_programs[pass].program);
+		passes[pass].animated = pass_programs[pass].animated;
+	}
+
+	// inputs are the buffer samplers the linker kept, each buffer is sampled from the unit of the same index
+	for (Pass& pass: passes) {
+		if (!pass.program) {
+			continue;
+		}
+		for (int buffer = 0; buffer < buffer_count; ++buffer) {
+			GLint location = glGetUniformLocation(pass.program->getHandle(), pass_names[buffer]);
+			if (location >= 0) {
+				glProgramUniform1i(pass.program->getHandle(), location, buffer);
+				if (passes[buffer].program) {
+					pass.inputs |= 1u << buffer;
+				}
+			}
+		}
+	}
+
+	// only buffers the Image pass depends on are run
+	uint32_t used = 0;
+	std::vector<int> stack = {image_pass};
+	while (!stack.empty()) {
+		int pass = stack.back();
+		stack.pop_back();
+		for (int buffer = 0; buffer < buffer_count; ++buffer) {
+			if (Reads(passes[pass].inputs, buffer) && !Reads(used, buffer)) {
+				used |= 1u << buffer;
+				stack.push_back(buffer);
+			}
+		}
+	}
+
+	// Kahn's algorithm ignoring self reads, buffers left in a cycle run in index order
+	order.clear();
+	uint32_t scheduled = 0;
+	while (true) {
+		int next = -1;
+		for (int buffer = 0; buffer < buffer_count && next < 0; ++buffer) {
+			uint32_t other_inputs = passes[buffer].inputs & ~(1u << buffer) & used;
+			if (Reads(used, buffer) && !Reads(scheduled, buffer) && (other_inputs & ~scheduled) == 0) {
+				next = buffer;
+			}
+		}
+		if (next < 0) {
+			break;
+		}
+		order.push_back(next);
+		scheduled |= 1u << next;
+	}
+	for (int buffer = 0; buffer < buffer_count; ++buffer) {
+		if (Reads(used, buffer) && !Reads(scheduled, buffer)) {
+			order.push_back(buffer);
+		}
+	}
+
+	int position[pass_count];
+	for (size_t i = 0; i < order.size(); ++i) {
+		position[order[i]] = (int)i;
+	}
+	position[image_pass] = (int)order.size();
+
+	// a buffer read by itself or by a pass that runs before it needs last frame's result
+	int last_reader[buffer_count] = {};
+	for (int reader: order) {
+		for (int buffer = 0; buffer < buffer_count; ++buffer) {
+			if (Reads(passes[reader].inputs, buffer)) {
+				passes[buffer].feedback |= position[reader] <= position[buffer];
+				last_reader[buffer] = std::max(last_reader[buffer], position[reader]);
+			}
+		}
+	}
+	for (int buffer = 0; buffer < buffer_count; ++buffer) {
+		if (Reads(passes[image_pass].inputs, buffer)) {
+			last_reader[buffer] = position[image_pass];
+		}
+	}
+
+	// assign texture slots, transient buffers reuse the slots of buffers whose readers already ran
+	int texture_count = 0;
+	unaliased_texture_count = 0;
+	std::vector<int> free_slots;
+	std::vector<int> live;
+	for (int buffer: order) {
+		Pass& pass = passes[buffer];
+		bool changes = pass.animated || pass.feedback;
+		for (int input = 0; input < buffer_count; ++input) {
+			changes |= Reads(pass.inputs, input) && (passes[input].feedback || passes[input].transient);
+		}
+		pass.transient = changes && !pass.feedback;
+
+		if (!pass.transient) {
+			pass.texture = texture_count++;
+			if (pass.feedback) {
+				pass.history = texture_count++;
+			}
+			unaliased_texture_count += pass.feedback ? 2 : 1;
+			continue;
+		}
+
+		for (auto it = live.begin(); it != live.end();) {
+			if (last_reader[*it] < position[buffer]) {
+				free_slots.push_back(passes[*it].texture);
+				it = live.erase(it);
+			} else {
+				++it;
+			}
+		}
+		if (free_slots.empty()) {
+			pass.texture = texture_count++;
+		} else {
+			pass.texture = free_slots.back();
+			free_slots.pop_back();
+		}
+		live.push_back(buffer);
+		++unaliased_texture_count;
+	}
+
+	textures.clear();
+	textures.resize(texture_count);
+	width = 0;
+	height = 0;
+}
+
+std::vector<RenderGraph::PassProgram> RenderGraph::releasePasses()
+{
+	std::vector<PassProgram> pass_programs(pass_count);
+	for (int pass = 0; pass < pass_count; ++pass) {
+		pass_programs[pass].program = std::move(passes[pass].program);
+		pass_programs[pass].animated = passes[pass].animated;
+		passes[pass] = Pass {};
+	}
+	order.clear();
+	return pass_programs;
+}
+
+bool RenderGraph::isAnimated() const
+{
+	if (passes[image_pass].animated) {
+		return true;
+	}
+	for (int buffer: order) {
+		if (passes[buffer].transient || passes[buffer].feedback) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void RenderGraph::invalidate()
+{
+	for (Pass& pass: passes) {
+		pass.dirty = true;
+	}
+}
+
+void RenderGraph::holdFeedback(bool hold)
+{
+	feedback_held = hold;
+}
+
+void RenderGraph::allocateTextures(int width_, int height_)
+{
+	TRACE_SCOPE("RenderGraph::allocateTextures");
+	width = width_;
+	height = height_;
+	for (auto& texture: textures) {
+		texture = std::make_unique<mogl::Texture>(GL_TEXTURE_2D);
+		texture->setStorage2D(1, buffer_format, width, height);
+		texture->set<GLint>(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		texture->set<GLint>(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		texture->set<GLint>(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		texture->set<GLint>(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		// feedback buffers start from black rather than undefined memory
+		glClearTexImage(texture->getHandle(), 0, GL_RGBA, GL_FLOAT, nullptr);
+	}
+	invalidate();
+}
+
+void RenderGraph::bindInputs(int pass)
+{
+	for (int buffer = 0; buffer < buffer_count; ++buffer) {
+		if (!Reads(passes[pass].inputs, buffer)) {
+			continue;
+		}
+		int slot = buffer == pass ? passes[buffer].history : passes[buffer].texture;
+		textures[slot]->bind(buffer);
+	}
+}
+
+void RenderGraph::execute(int width_, int height_, const DrawFunction& draw)
+{
+	execute(width_, height_, width_, height_, draw);
+}
+
+void RenderGraph::execute(int image_width, int image_height, int buffer_width, int buffer_height, const DrawFunction& draw)
+{
+	TRACE_SCOPE("RenderGraph::execute");
+	if (!passes[image_pass].program || image_width <= 0 || image_height <= 0 || buffer_width <= 0 || buffer_height <= 0) {
+		return;
+	}
+	if (buffer_width != width || buffer_height != height) {
+		allocateTextures(buffer_width, buffer_height);
+	}
+
+	GLint target_frame_buffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target_frame_buffer);
+	glViewport(0, 0, width, height);
+
+	executed_count = 0;
+	skipped_count = 0;
+	uint32_t executed = 0;
+	for (int buffer: order) {
+		Pass& pass = passes[buffer];
+		if (!pass.transient && !pass.feedback && !pass.dirty && (pass.inputs & executed) == 0) {
+			++skipped_count;
+			continue;
+		}
+		if (pass.feedback && !feedback_held) {
+			std::swap(pass.texture, pass.history);
+		}
+		bindInputs(buffer);
+		frame_buffer.setTexture(GL_COLOR_ATTACHMENT0, *textures[pass.texture]);
+		frame_buffer.bind(GL_DRAW_FRAMEBUFFER);
+		draw(*pass.program, pass.time_uniform, pass_names[buffer]);
+		pass.dirty = false;
+		executed |= 1u << buffer;
+		++executed_count;
+	}
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target_frame_buffer);
+	glViewport(0, 0, image_width, image_height);
+	bindInputs(image_pass);
+	draw(*passes[image_pass].program, passes[image_pass].time_uniform, pass_names[image_pass]);
+	++executed_count;
+}
+
+void RenderGraph::drawStats() const
+{
+	ImGui::Text("Passes: %d run, %d skipped", executed_count, skipped_count);
+	size_t texture_size = (size_t)width * height * buffer_pixel_size;
+	ImGui::Text("Buffer textures: %d (%.1f MB, %.1f MB saved by aliasing)", (int)textures.size(),
+		textures.size() * texture_size / (1024.0 * 1024.0),
+		(unaliased_texture_count - (int)textures.size()) * texture_size / (1024.0 * 1024.0));
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <mogl/mogl.hpp>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Shadertoy style passes: Buffer A-D render into offscreen RGBA16F textures, the Image
+// pass renders into the framebuffer bound when execute() is called. A pass reads a
+// buffer through a sampler2D uniform named after it (BufferA to BufferD). Sampling its
+// own buffer returns the previous frame, so do buffers that run later in the frame.
+//
+// Passes run in dependency order and buffers the Image pass doesn't depend on are
+// not run at all. Buffers that are re-run every frame anyway (animated, fed back or
+// reading such a buffer) share textures once their last reader ran, the others keep
+// their texture and are skipped until an input, the size or invalidate() changes them.
+class RenderGraph
+{
+public:
+	static const int buffer_count = 4;
+	static const int pass_count = buffer_count + 1;
+	static const int image_pass = buffer_count;
+
+	struct PassProgram {
+		// nullopt for a buffer that doesn't exist, the Image pass is required
+		std::optional<mogl::ShaderProgram> program;
+		// the shader changes with Time or Frame, see IsAnimatedShader
+		bool animated = false;
+	};
+
+	// time_uniform belongs to the pass, so its cached location stays valid from frame to frame
+	using DrawFunction = std::function<void(mogl::ShaderProgram& program, mogl::UniformHandle<GLfloat>& time_uniform, const char* pass_name)>;
+
+	// Takes over the programs of all passes, indexed like GetPassName, and rebuilds the schedule
+	void setPasses(std::vector<PassProgram> pass_programs);
+
+	// Hands the programs of all passes back, e.g. to replace some of them, and leaves the graph empty
+	std::vector<PassProgram> releasePasses();
+
+	// Whether execute() produces a different image every frame
+	bool isAnimated() const;
+
+	// Re-runs every buffer on the next execute(), for uniforms the graph doesn't track
+	void invalidate();
+
+	// While held, execute() draws feedback buffers into the same texture and keeps their
+	// previous frame, for frames drawn in several execute() calls such as tiles
+	void holdFeedback(bool hold);
+
+	// Draws the passes that need it, draw binds the remaining uniforms and draws a full screen quad
+	void execute(int width, int height, const DrawFunction& draw);
+
+	// Like execute(), with the buffers rendered at buffer_width x buffer_height and only the
+	// Image pass at width x height
+	void execute(int width, int height, int buffer_width, int buffer_height, const DrawFunction& draw);
+
+	// Pass and texture statistics, must be called inside an ImGui window
+	void drawStats() const;
+
+	// "BufferA" to "BufferD" and "Image", also the sampler names
+	static const char* GetPassName(int pass);
+	// "buffer_a.glsl" to "buffer_d.glsl" and "fragment.glsl", relative to assets
+	static const char* GetPassFile(int pass);
+
+private:
+	struct Pass {
+		std::optional<mogl::ShaderProgram> program;
+		mogl::UniformHandle<GLfloat> time_uniform {"Time"};
+		bool animated = false;
+		// bit per buffer the pass samples
+		uint32_t inputs = 0;
+		// some reader needs the previous frame, keeps a second texture
+		bool feedback = false;
+		// re-run every frame, shares its texture with other transient passes
+		bool transient = false;
+		bool dirty = true;
+		int texture = -1;
+		int history = -1;
+	};
+
+	void allocateTextures(int width, int height);
+	void bindInputs(int pass);
+
+	std::array<Pass, pass_count> passes;
+	// buffers to run in dependency order, the Image pass runs after them
+	std::vector<int> order;
+	std::vector<std::unique_ptr<mogl::Texture>> textures;
+	// textures needed without aliasing, for the statistics
+	int unaliased_texture_count = 0;
+	int width = 0;
+	int height = 0;
+	mogl::FrameBuffer frame_buffer;
+	int executed_count = 0;
+	int skipped_count = 0;
+	bool feedback_held = false;
+};
@@ -0,0 +1,198 @@
+#include "shader_compiler.hpp"
+#include "shader_preprocessor.hpp"
+#include "trace.hpp"
+
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+
+namespace {
+
+using PFNGLMAXSHADERCOMPILERTHREADSKHRPROC = void (APIENTRYP)(GLuint count);
+
+void WaitForCompletion(const std::function<bool()>& is_ready)
+{
+	while (!is_ready()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+glfw::Window CreateHiddenContext(const glfw::Window& share, glfw::WindowHints hints)
+{
+	hints.visible = false;
+	hints.apply();
+	return glfw::Window {1, 1, "ShaderCompiler", nullptr, &share};
+}
+
+bool HasParallelShaderCompile()
+{
+	return glfw::extensionSupported("GL_KHR_parallel_shader_compile") ||
+		glfw::extensionSupported("GL_ARB_parallel_shader_compile");
+}
+
+}
+
+const char* const fullscreen_vertex_source = R"(#version 460 core
+layout (location=0) out vec2 uv;
+void main()
+{
+	uv = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+mogl::ShaderProgram CompileProgram(const std::string& vertex_source, const std::string& fragment_source,
+	const ProgramCache* cache, bool poll_completion)
+{
+	TRACE_SCOPE("CompileProgram");
+
+	mogl::ShaderProgram shader_program;
+	std::string cache_key;
+	if (cache) {
+		cache_key = cache->key({vertex_source, fragment_source});
+		if (cache->load(cache_key, shader_program)) {
+			return shader_program;
+		}
+		shader_program.set(GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	mogl::Shader vertex_shader(GL_VERTEX_SHADER);
+	mogl::Shader fragment_shader(GL_FRAGMENT_SHADER);
+
+	vertex_shader.beginCompile(vertex_source);
+	fragment_shader.beginCompile(fragment_source);
+
+	for (auto shader: {&vertex_shader, &fragment_shader}) {
+		if (poll_completion) {
+			WaitForCompletion([&] { return shader->isCompletionReady(); });
+		}
+		if (!shader->isCompiled())
+		{
+			throw std::runtime_error(shader->getLog());
+		}
+		shader_program.attach(*shader);
+	}
+
+	shader_program.beginLink();
+	if (poll_completion) {
+		WaitForCompletion([&] { return shader_program.isCompletionReady(); });
+	}
+	if (!shader_program.endLink()) {
+		throw std::runtime_error(shader_program.getLog());
+	}
+	if (cache) {
+		cache->store(cache_key, shader_program);
+	}
+	return shader_program;
+}
+
+ShaderCompiler::ShaderCompiler(const glfw::Window& share, glfw::WindowHints hints, const ProgramCache* cache)
+	: context(CreateHiddenContext(share, hints))
+	, cache(cache)
+{
+	thread = std::thread(&ShaderCompiler::run, this);
+}
+
+ShaderCompiler::~ShaderCompiler()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	condition.notify_one();
+	thread.join();
+}
+
+void ShaderCompiler::request(std::vector<ProgramSources> sources)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending = std::move(sources);
+	}
+	condition.notify_one();
+}
+
+std::optional<ShaderCompiler::Result> ShaderCompiler::poll()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!finished) {
+		return std::nullopt;
+	}
+	if (finished->fence) {
+		GLenum status = finished->fence->waitClientSync(0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			return std::nullopt;
+		}
+	}
+	Result result = std::move(finished->result);
+	finished.reset();
+	return result;
+}
+
+bool ShaderCompiler::isBusy()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return compiling || pending || finished;
+}
+
+void ShaderCompiler::run()
+{
+	TRACE_THREAD_NAME("ShaderCompiler");
+	glfw::makeContextCurrent(context);
+
+	bool poll_completion = HasParallelShaderCompile();
+	if (poll_completion) {
+		auto glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(
+			glfwGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+		if (!glMaxShaderCompilerThreadsKHR) {
+			glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(
+				glfwGetProcAddress("glMaxShaderCompilerThreadsARB"));
+		}
+		if (glMaxShaderCompilerThreadsKHR) {
+			// let the driver use as many threads as it wants
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		condition.wait(lock, [&] { return stop || pending; });
+		if (stop) {
+			break;
+		}
+
+		std::vector<ProgramSources> request = std::move(*pending);
+		pending.reset();
+		compiling = true;
+		lock.unlock();
+
+		Finished result;
+		for (const ProgramSources& sources: request) {
+			if (sources.unchanged || sources.fragment.empty()) {
+				result.result.programs.emplace_back();
+				continue;
+			}
+			try {
+				result.result.programs.emplace_back(CompileProgram(sources.vertex, sources.fragment, cache, poll_completion));
+			} catch (const std::exception& error) {
+				result.result.error = sources.name + ": " + MapSourceNames(error.what(), sources.files);
+				result.result.programs.clear();
+				break;
+			}
+		}
+		result.result.sources = std::move(request);
+		if (result.result.error.empty()) {
+			result.fence = std::make_unique<mogl::Fence>(GL_SYNC_GPU_COMMANDS_COMPLETE);
+		}
+		glFlush();
+
+		lock.lock();
+		compiling = false;
+		// a newer request supersedes this result, don't hand over a stale program
+		if (!pending) {
+			finished = std::move(result);
+		}
+	}
+
+	glfwMakeContextCurrent(nullptr);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <mogl/mogl.hpp>
+#include <glfwpp/glfwpp.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "program_cache.hpp"
+
+// Compiles and links a program, throws std::runtime_error with the driver log on failure.
+// With poll_completion the driver is polled through GL_KHR_parallel_shader_compile
+// instead of blocking in the status queries. With a cache, a stored binary is used
+// when the driver accepts it and freshly linked programs are stored.
+mogl::ShaderProgram CompileProgram(const std::string& vertex_source, const std::string& fragment_source,
+	const ProgramCache* cache = nullptr, bool poll_completion = false);
+
+// Vertex shader for a full screen triangle drawn with glDrawArrays(GL_TRIANGLES, 0, 3),
+// writes uv at location 0
+extern const char* const fullscreen_vertex_source;
+
+struct ProgramSources {
+	// shown in front of compile errors
+	std::string name;
+	std::string vertex;
+	// empty for a program that is not used, it is skipped
+	std::string fragment;
+	// names of the source string numbers in both sources, see ShaderPreprocessor
+	std::vector<std::string> files;
+	// the caller keeps its current program, skipped like an empty fragment
+	bool unchanged = false;
+};
+
+// Compiles shader programs on a worker thread that owns a hidden context sharing
+// objects with the render context, so hot reload never stalls the render thread.
+class ShaderCompiler
+{
+public:
+	struct Result {
+		// same order as the request, nullopt for skipped programs
+		std::vector<std::optional<mogl::ShaderProgram>> programs;
+		// the request the programs were compiled from
+		std::vector<ProgramSources> sources;
+		std::string error;
+	};
+
+	// Must be called on the main thread, GLFW only creates windows there
+	ShaderCompiler(const glfw::Window& share, glfw::WindowHints hints, const ProgramCache* cache = nullptr);
+	~ShaderCompiler();
+
+	// Schedules a compilation, superseding any request the worker has not finished yet.
+	// Programs are handed over together and only if all of them linked.
+	void request(std::vector<ProgramSources> sources);
+
+	// Returns the latest finished programs once the GPU has seen all of its commands, never blocks
+	std::optional<Result> poll();
+
+	bool isBusy();
+
+private:
+	struct Finished {
+		Result result;
+		std::unique_ptr<mogl::Fence> fence;
+	};
+
+	void run();
+
+	glfw::Window context;
+	const ProgramCache* cache;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::optional<std::vector<ProgramSources>> pending;
+	std::optional<Finished> finished;
+	bool compiling = false;
+	bool stop = false;
+};
@@ -0,0 +1,236 @@
+#include "shader_preprocessor.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+uint64_t HashText(const std::string& text)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (char c: text) {
+		hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string ReadFile(const fs::path& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("failed to open file " + path.string());
+	}
+	std::stringstream text;
+	text << file.rdbuf();
+	return text.str();
+}
+
+// The directive of a preprocessor line ("include", "pragma"...) and the rest of the line
+std::pair<std::string, std::string> SplitDirective(const std::string& line)
+{
+	size_t hash = line.find_first_not_of(" \t");
+	if (hash == std::string::npos || line[hash] != '#') {
+		return {};
+	}
+	size_t begin = line.find_first_not_of(" \t", hash + 1);
+	if (begin == std::string::npos) {
+		return {};
+	}
+	size_t end = std::min(line.find_first_of(" \t\"<", begin), line.size());
+	return {line.substr(begin, end - begin), line.substr(end)};
+}
+
+}
+
+ShaderPreprocessor::ShaderPreprocessor(const fs::path& root)
+	: root(fs::weakly_canonical(root))
+{
+}
+
+std::string ShaderPreprocessor::getKey(const fs::path& path) const
+{
+	return fs::weakly_canonical(path.is_absolute() ? path : root / path).lexically_relative(root).generic_string();
+}
+
+std::string ShaderPreprocessor::process(const fs::path& file, std::vector<std::string>& files)
+{
+	TRACE_SCOPE("ShaderPreprocessor::process");
+	std::string out;
+	std::set<std::string> included;
+	std::vector<std::string> stack;
+	expand(getKey(file), files, included, stack, out);
+	return out;
+}
+
+const ShaderPreprocessor::CachedFile& ShaderPreprocessor::load(const std::string& file)
+{
+	fs::path path = root / file;
+	if (!fs::exists(path)) {
+		throw std::runtime_error("file " + path.string() + " does not exist");
+	}
+	auto it = cache.find(file);
+	if (it == cache.end() || it->second.modified != fs::last_write_time(path)) {
+		refresh(file);
+	}
+	return cache.at(file);
+}
+
+bool ShaderPreprocessor::refresh(const std::string& file)
+{
+	fs::path path = root / file;
+	auto it = cache.find(file);
+	if (!fs::exists(path)) {
+		if (it != cache.end()) {
+			for (const Include& include: it->second.includes) {
+				dependents[include.file].erase(file);
+			}
+			cache.erase(it);
+		}
+		return true;
+	}
+
+	fs::file_time_type modified = fs::last_write_time(path);
+	std::string text = ReadFile(path);
+	uint64_t hash = HashText(text);
+	if (it != cache.end() && it->second.hash == hash) {
+		// touched but not changed, e.g. saved again without edits
+		it->second.modified = modified;
+		return false;
+	}
+
+	CachedFile& cached = cache[file];
+	for (const Include& include: cached.includes) {
+		dependents[include.file].erase(file);
+	}
+	cached = CachedFile {};
+	cached.modified = modified;
+	cached.hash = hash;
+	parse(file, text, cached);
+	for (const Include& include: cached.includes) {
+		dependents[include.file].insert(file);
+	}
+	return true;
+}
+
+void ShaderPreprocessor::parse(const std::string& file, const std::string& text, CachedFile& cached)
+{
+	std::istringstream stream(text);
+	std::string line;
+	while (std::getline(stream, line)) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		auto [directive, rest] = SplitDirective(line);
+		if (directive == "include") {
+			size_t begin = rest.find_first_of("\"<");
+			size_t end = begin == std::string::npos ? begin : rest.find(rest[begin] == '<' ? '>' : '"', begin + 1);
+			if (end == std::string::npos) {
+				throw std::runtime_error(file + ":" + std::to_string(cached.lines.size() + 1) + ": malformed #include");
+			}
+			cached.includes.push_back({cached.lines.size(), getKey(rest.substr(begin + 1, end - begin - 1))});
+		} else if (directive == "pragma" && rest.find("once") != std::string::npos) {
+			cached.once = true;
+			line.clear();
+		}
+		cached.lines.push_back(line);
+	}
+}
+
+void ShaderPreprocessor::expand(const std::string& file, std::vector<std::string>& files, std::set<std::string>& included,
+	std::vector<std::string>& stack, std::string& out)
+{
+	const CachedFile& cached = load(file);
+	if (cached.once && included.count(file)) {
+		return;
+	}
+	if (std::find(stack.begin(), stack.end(), file) != stack.end()) {
+		throw std::runtime_error("include cycle through " + file);
+	}
+	included.insert(file);
+	stack.push_back(file);
+
+	std::string id = std::to_string(files.size());
+	files.push_back(file);
+
+	// #line may not come before #version, so the top level file switches after it
+	bool top_level = stack.size() == 1;
+	auto version = std::find_if(cached.lines.begin(), cached.lines.end(), [](const std::string& line) {
+		return SplitDirective(line).first == "version";
+	});
+	size_t switch_after = top_level && version != cached.lines.end() ? version - cached.lines.begin() : std::string::npos;
+	if (switch_after == std::string::npos) {
+		out += "#line 1 " + id + "\n";
+	}
+
+	auto include = cached.includes.begin();
+	for (size_t line = 0; line < cached.lines.size(); ++line) {
+		if (include != cached.includes.end() && include->line == line) {
+			if (!fs::exists(root / include->file)) {
+				throw std::runtime_error(file + ":" + std::to_string(line + 1) + ": can't find " + include->file);
+			}
+			expand(include->file, files, included, stack, out);
+			out += "#line " + std::to_string(line + 2) + " " + id + "\n";
+			++include;
+			continue;
+		}
+		out += cached.lines[line];
+		out += '\n';
+		if (line == switch_after) {
+			out += "#line " + std::to_string(line + 2) + " " + id + "\n";
+		}
+	}
+	stack.pop_back();
+}
+
+std::set<std::string> ShaderPreprocessor::update(const std::vector<fs::path>& changed)
+{
+	TRACE_SCOPE("ShaderPreprocessor::update");
+	std::vector<std::string> stack;
+	for (const fs::path& path: changed) {
+		std::string file = getKey(path);
+		if (!cache.count(file) || refresh(file)) {
+			stack.push_back(file);
+		}
+	}
+
+	std::set<std::string> affected;
+	while (!stack.empty()) {
+		std::string file = std::move(stack.back());
+		stack.pop_back();
+		if (!affected.insert(file).second) {
+			continue;
+		}
+		auto it = dependents.find(file);
+		if (it != dependents.end()) {
+			stack.insert(stack.end(), it->second.begin(), it->second.end());
+		}
+	}
+	return affected;
+}
+
+std::string MapSourceNames(const std::string& log, const std::vector<std::string>& files)
+{
+	static const std::regex location(R"(^(\s*(?:ERROR:|WARNING:)?\s*)(\d+)([:(]\d+))");
+	std::istringstream stream(log);
+	std::string out;
+	std::string line;
+	while (std::getline(stream, line)) {
+		std::smatch match;
+		if (std::regex_search(line, match, location)) {
+			size_t id = std::stoul(match[2].str());
+			if (id < files.size()) {
+				line = match[1].str() + files[id] + match[3].str() + match.suffix().str();
+			}
+		}
+		out += line;
+		out += '\n';
+	}
+	return out;
+}
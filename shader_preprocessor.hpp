@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Expands #include "file" directives, with paths relative to the root directory
+// (assets), and skips files marked #pragma once that were already included into the
+// same program. Every file gets a source string number that #line directives switch
+// to, so compile errors can be mapped back to file names with MapSourceNames().
+//
+// Files are parsed once and cached until their modification time changes and their
+// content hash with it. The includes form a reverse dependency graph, so update() can
+// tell which files are affected by a change anywhere below them.
+class ShaderPreprocessor
+{
+public:
+	explicit ShaderPreprocessor(const std::filesystem::path& root);
+
+	// Expands file, relative to the root. files holds the names of the source string
+	// numbers of the program so far and is appended to, share it between the shaders
+	// of one program. Throws std::runtime_error for missing files and include cycles.
+	std::string process(const std::filesystem::path& file, std::vector<std::string>& files);
+
+	// Re-reads the cached files among changed (absolute paths, e.g. from the file
+	// watcher) and returns, relative to the root, every file whose content changed or
+	// that transitively includes one. Unknown and deleted files count as changed.
+	std::set<std::string> update(const std::vector<std::filesystem::path>& changed);
+
+private:
+	struct Include {
+		// index into lines
+		size_t line;
+		// relative to the root
+		std::string file;
+	};
+
+	struct CachedFile {
+		std::filesystem::file_time_type modified;
+		uint64_t hash = 0;
+		std::vector<std::string> lines;
+		std::vector<Include> includes;
+		bool once = false;
+	};
+
+	const CachedFile& load(const std::string& file);
+	// Whether the content differs from the cache, reparses and reconnects the graph if so
+	bool refresh(const std::string& file);
+	void parse(const std::string& file, const std::string& text, CachedFile& cached);
+	void expand(const std::string& file, std::vector<std::string>& files, std::set<std::string>& included,
+		std::vector<std::string>& stack, std::string& out);
+	std::string getKey(const std::filesystem::path& path) const;
+
+	std::filesystem::path root;
+	std::map<std::string, CachedFile> cache;
+	// file to the files including it directly
+	std::map<std::string, std::set<std::string>> dependents;
+};
+
+// Replaces source string numbers at the start of driver log lines ("1:12(3): error",
+// "1(12) : error" or "ERROR: 1:12:") with the file names they stand for
+std::string MapSourceNames(const std::string& log, const std::vector<std::string>& files);
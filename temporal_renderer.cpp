@@ -0,0 +1,170 @@
+#include "temporal_renderer.hpp"
+#include "shader_compiler.hpp"
+#include "trace.hpp"
+
+#include <imgui.h>
+
+namespace {
+
+// subset offsets inside a factor sized block, diagonals first so every other frame covers both axes
+const int half_phases[][2] = {{0, 0}, {1, 0}};
+const int quarter_phases[][2] = {{0, 0}, {1, 1}, {1, 0}, {0, 1}};
+
+const char* const reconstruct_fragment_source = R"(#version 460 core
+layout (location=0) in vec2 uv;
+out vec4 out_color;
+uniform sampler2D Current;
+uniform sampler2D History;
+uniform ivec2 Factor;
+uniform ivec2 Phase;
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	ivec2 low = pixel / Factor;
+	vec3 current = texelFetch(Current, low, 0).rgb;
+	if (pixel % Factor == Phase) {
+		out_color = vec4(current, 1.0);
+		return;
+	}
+	ivec2 last = textureSize(Current, 0) - 1;
+	vec3 lo = current;
+	vec3 hi = current;
+	for (int y = -1; y <= 1; ++y) {
+		for (int x = -1; x <= 1; ++x) {
+			vec3 neighbour = texelFetch(Current, clamp(low + ivec2(x, y), ivec2(0), last), 0).rgb;
+			lo = min(lo, neighbour);
+			hi = max(hi, neighbour);
+		}
+	}
+	out_color = vec4(clamp(texelFetch(History, pixel, 0).rgb, lo, hi), 1.0);
+}
+)";
+
+std::unique_ptr<mogl::Texture> CreateTarget(int width, int height)
+{
+	auto texture = std::make_unique<mogl::Texture>(GL_TEXTURE_2D);
+	texture->setStorage2D(1, GL_RGBA16F, width, height);
+	return texture;
+}
+
+}
+
+const char* ToString(TemporalRenderer::Mode mode)
+{
+	switch (mode) {
+	case TemporalRenderer::Mode::Off:
+		return "off";
+	case TemporalRenderer::Mode::Half:
+		return "half";
+	case TemporalRenderer::Mode::Quarter:
+		return "quarter";
+	default:
+		return "unknown";
+	}
+}
+
+TemporalRenderer::TemporalRenderer()
+	: reconstruct_program(CompileProgram(fullscreen_vertex_source, reconstruct_fragment_source))
+{
+	reconstruct_program.setUniform<GLint>("Current", 0);
+	reconstruct_program.setUniform<GLint>("History", 1);
+}
+
+void TemporalRenderer::reset()
+{
+	history_valid = false;
+	subset_frames_since_reset = 0;
+}
+
+bool TemporalRenderer::isConverged() const
+{
+	int phase_count = mode == Mode::Quarter ? 4 : 2;
+	return history_valid && subset_frames_since_reset >= phase_count;
+}
+
+void TemporalRenderer::allocate(int width_, int height_)
+{
+	TRACE_SCOPE("TemporalRenderer::allocate");
+	width = width_;
+	height = height_;
+	allocated_mode = mode;
+	factor[0] = 2;
+	factor[1] = mode == Mode::Quarter ? 2 : 1;
+	phase = 0;
+
+	current = CreateTarget((width + factor[0] - 1) / factor[0], (height + factor[1] - 1) / factor[1]);
+	current_frame_buffer.setTexture(GL_COLOR_ATTACHMENT0, *current);
+	for (size_t i = 0; i < history.size(); ++i) {
+		history[i] = CreateTarget(width, height);
+		history_frame_buffers[i].setTexture(GL_COLOR_ATTACHMENT0, *history[i]);
+	}
+	reconstruct_program.setUniform<GLint>("Factor", factor[0], factor[1]);
+	reset();
+}
+
+void TemporalRenderer::render(int width_, int height_, const std::function<void(const View& view)>& draw_scene)
+{
+	TRACE_SCOPE("TemporalRenderer::render");
+	if (width_ <= 0 || height_ <= 0) {
+		return;
+	}
+	if (width_ != width || height_ != height || mode != allocated_mode) {
+		allocate(width_, height_);
+	}
+
+	GLint output_frame_buffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &output_frame_buffer);
+	mogl::FrameBuffer& target = history_frame_buffers[history_write];
+
+	int low_width = (width + factor[0] - 1) / factor[0];
+	int low_height = (height + factor[1] - 1) / factor[1];
+	if (!history_valid) {
+		target.bind(GL_DRAW_FRAMEBUFFER);
+		glViewport(0, 0, width, height);
+		draw_scene(View {width, height, low_width, low_height, {(float)width, (float)height}, {0, 0}});
+		history_valid = true;
+		++full_frames;
+	} else {
+		const int (*phases)[2] = mode == Mode::Quarter ? quarter_phases : half_phases;
+		int phase_count = mode == Mode::Quarter ? 4 : 2;
+		const int* offset = phases[phase];
+		phase = (phase + 1) % phase_count;
+
+		float full_width = (float)(low_width * factor[0]);
+		float full_height = (float)(low_height * factor[1]);
+		View view {low_width, low_height, low_width, low_height, {full_width, full_height}, {
+			(offset[0] + 0.5f - factor[0] * 0.5f) / full_width,
+			(offset[1] + 0.5f - factor[1] * 0.5f) / full_height,
+		}};
+		current_frame_buffer.bind(GL_DRAW_FRAMEBUFFER);
+		glViewport(0, 0, low_width, low_height);
+		draw_scene(view);
+
+		target.bind(GL_DRAW_FRAMEBUFFER);
+		glViewport(0, 0, width, height);
+		reconstruct_program.setUniform<GLint>("Phase", offset[0], offset[1]);
+		reconstruct_program.use();
+		current->bind(0);
+		history[1 - history_write]->bind(1);
+		glDisable(GL_DEPTH_TEST);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		++subset_frames;
+		++subset_frames_since_reset;
+	}
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, output_frame_buffer);
+	glBlitNamedFramebuffer(target.getHandle(), output_frame_buffer,
+		0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	history_write = 1 - history_write;
+}
+
+void TemporalRenderer::drawControls()
+{
+	int current_mode = (int)mode;
+	const char* modes[] = {ToString(Mode::Off), ToString(Mode::Half), ToString(Mode::Quarter)};
+	ImGui::Combo("Temporal shading", &current_mode, modes, IM_ARRAYSIZE(modes));
+	mode = (Mode)current_mode;
+	if (mode != Mode::Off) {
+		ImGui::Text("%d subset frames, %d full frames", subset_frames, full_frames);
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <mogl/mogl.hpp>
+#include <array>
+#include <functional>
+#include <memory>
+
+// Shades a rotating 1/2 or 1/4 subset of the pixels per frame and reconstructs the
+// rest from a history buffer. The subset is rendered at reduced size with its UVs
+// jittered onto the subset's pixel centres (vertex.glsl adds Jitter to out_uv), so
+// the shader sees the full Resolution and must derive positions from the UVs rather
+// than gl_FragCoord. Pixels not shaded this frame keep their history, clamped to the
+// neighbourhood of the fresh samples to reject stale colours. There is no motion, so
+// the history is reprojected in place. reset() shades every pixel for one frame.
+class TemporalRenderer
+{
+public:
+	enum class Mode {
+		Off,
+		// every other column per frame
+		Half,
+		// one pixel of every 2x2 block per frame
+		Quarter,
+	};
+
+	struct View {
+		// size of the framebuffer to render into
+		int width;
+		int height;
+		// size of the render graph's buffers, the subset size even when every pixel is
+		// shaded, so a reset doesn't reallocate them and lose their feedback history
+		int buffer_width;
+		int buffer_height;
+		// what the shader should see as Resolution
+		float resolution[2];
+		// in UV units, added to out_uv
+		float jitter[2];
+	};
+
+	Mode mode = Mode::Off;
+
+	TemporalRenderer();
+
+	// Shades every pixel on the next frame, for discontinuous changes
+	void reset();
+
+	// draw_scene renders the scene into the bound framebuffer, the reconstructed image
+	// is blitted into the framebuffer that was bound at the call
+	void render(int width, int height, const std::function<void(const View& view)>& draw_scene);
+
+	// Whether every pixel was shaded since the last reset
+	bool isConverged() const;
+
+	// Must be called inside an ImGui window
+	void drawControls();
+
+private:
+	void allocate(int width, int height);
+
+	int width = 0;
+	int height = 0;
+	Mode allocated_mode = Mode::Off;
+	int factor[2] = {1, 1};
+	int phase = 0;
+	bool history_valid = false;
+	int full_frames = 0;
+	int subset_frames = 0;
+	int subset_frames_since_reset = 0;
+	size_t history_write = 0;
+	std::unique_ptr<mogl::Texture> current;
+	std::array<std::unique_ptr<mogl::Texture>, 2> history;
+	mogl::FrameBuffer current_frame_buffer;
+	std::array<mogl::FrameBuffer, 2> history_frame_buffers;
+	mogl::ShaderProgram reconstruct_program;
+};
+
+const char* ToString(TemporalRenderer::Mode mode);
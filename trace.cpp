@@ -0,0 +1,218 @@
+#include "trace.hpp"
+
+#ifdef SKY_CONTEST_TRACE
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace trace {
+
+namespace {
+
+struct Event {
+	const char* name;
+	uint64_t begin;
+	uint64_t end;
+};
+
+// Single producer ring, the reader tolerates concurrent writes by discarding any
+// slot that may have been overwritten while it was copying. The slots are relaxed
+// atomics so this check is a seqlock rather than a data race: the fence in push()
+// orders the previous written update before the slot stores, the one in snapshot()
+// orders the slot loads before the second written load.
+struct Buffer {
+	static constexpr size_t capacity = 1 << 16;
+
+	struct Slot {
+		std::atomic<const char*> name {nullptr};
+		std::atomic<uint64_t> begin {0};
+		std::atomic<uint64_t> end {0};
+	};
+
+	std::string name;
+	uint32_t id = 0;
+	std::array<Slot, capacity> events;
+	std::atomic<uint64_t> written {0};
+
+	void push(const Event& event)
+	{
+		uint64_t index = written.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		Slot& slot = events[index % capacity];
+		slot.name.store(event.name, std::memory_order_relaxed);
+		slot.begin.store(event.begin, std::memory_order_relaxed);
+		slot.end.store(event.end, std::memory_order_relaxed);
+		written.store(index + 1, std::memory_order_release);
+	}
+
+	std::vector<Event> snapshot() const
+	{
+		uint64_t end = written.load(std::memory_order_acquire);
+		uint64_t begin = end > capacity ? end - capacity : 0;
+		std::vector<Event> result;
+		result.reserve(end - begin);
+		for (uint64_t i = begin; i < end; ++i) {
+			const Slot& slot = events[i % capacity];
+			result.push_back({slot.name.load(std::memory_order_relaxed), slot.begin.load(std::memory_order_relaxed),
+				slot.end.load(std::memory_order_relaxed)});
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t now = written.load(std::memory_order_relaxed);
+		// the push of index now may be halfway through the slot of index now - capacity
+		uint64_t overwritten = now + 1 > capacity ? now + 1 - capacity : 0;
+		if (overwritten > begin) {
+			result.erase(result.begin(), result.begin() + std::min<uint64_t>(overwritten - begin, result.size()));
+		}
+		return result;
+	}
+};
+
+struct Registry {
+	std::mutex mutex;
+	// never shrinks, so buffers of finished threads stay valid for export
+	std::vector<std::unique_ptr<Buffer>> buffers;
+
+	Buffer& create(std::string name)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto buffer = std::make_unique<Buffer>();
+		buffer->id = (uint32_t)buffers.size() + 1;
+		buffer->name = name.empty() ? "Thread " + std::to_string(buffer->id) : std::move(name);
+		buffers.push_back(std::move(buffer));
+		return *buffers.back();
+	}
+};
+
+Registry& GetRegistry()
+{
+	static Registry registry;
+	return registry;
+}
+
+const auto epoch = std::chrono::steady_clock::now();
+
+thread_local Buffer* thread_buffer = nullptr;
+thread_local std::vector<std::pair<const char*, uint64_t>> open_zones;
+
+Buffer& GetThreadBuffer()
+{
+	if (!thread_buffer) {
+		thread_buffer = &GetRegistry().create({});
+	}
+	return *thread_buffer;
+}
+
+Buffer& GetGpuBuffer()
+{
+	static Buffer& buffer = GetRegistry().create("GPU");
+	return buffer;
+}
+
+void WriteEscaped(std::ostream& stream, const std::string& str)
+{
+	for (char c: str) {
+		if (c == '"' || c == '\\') {
+			stream << '\\';
+		}
+		stream << c;
+	}
+}
+
+}
+
+uint64_t Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void SetThreadName(const char* name)
+{
+	if (thread_buffer) {
+		std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+		thread_buffer->name = name;
+	} else {
+		thread_buffer = &GetRegistry().create(name);
+	}
+}
+
+void Record(const char* name, uint64_t begin, uint64_t end)
+{
+	GetThreadBuffer().push({name, begin, end});
+}
+
+void BeginZone(const char* name)
+{
+	open_zones.emplace_back(name, Now());
+}
+
+void EndZone()
+{
+	if (open_zones.empty()) {
+		return;
+	}
+	auto zone = open_zones.back();
+	open_zones.pop_back();
+	Record(zone.first, zone.second, Now());
+}
+
+void RecordGpu(const char* name, uint64_t begin, uint64_t end)
+{
+	GetGpuBuffer().push({name, begin, end});
+}
+
+void WriteChromeTrace(const std::filesystem::path& path)
+{
+	std::vector<Buffer*> buffers;
+	{
+		std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+		for (auto& buffer: GetRegistry().buffers) {
+			buffers.push_back(buffer.get());
+		}
+	}
+
+	std::ofstream file(path);
+	if (!file) {
+		throw std::runtime_error("failed to open " + path.string());
+	}
+	file << std::fixed << std::setprecision(3);
+	file << "{\"traceEvents\":[\n";
+	bool first = true;
+	auto separator = [&]() -> std::ostream& {
+		if (!first) {
+			file << ",\n";
+		}
+		first = false;
+		return file;
+	};
+	for (Buffer* buffer: buffers) {
+		std::string name;
+		{
+			std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+			name = buffer->name;
+		}
+		separator() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+			<< ",\"args\":{\"name\":\"";
+		WriteEscaped(file, name);
+		file << "\"}}";
+		for (const Event& event: buffer->snapshot()) {
+			separator() << "{\"name\":\"";
+			WriteEscaped(file, event.name);
+			file << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+				<< ",\"ts\":" << event.begin / 1000.0 << ",\"dur\":" << (event.end - event.begin) / 1000.0 << "}";
+		}
+	}
+	file << "\n]}\n";
+}
+
+}
+
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+// Scoped CPU instrumentation zones. Every thread records into its own lock-free ring
+// buffer, WriteChromeTrace dumps all of them as Chrome trace_event JSON (load it in
+// chrome://tracing or ui.perfetto.dev). Build with SKY_CONTEST_TRACE=OFF to compile
+// every TRACE_* macro out.
+
+#ifdef SKY_CONTEST_TRACE
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+// name must be a string literal
+#define TRACE_SCOPE(name) trace::Zone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) trace::SetThreadName(name)
+
+namespace trace {
+
+// Nanoseconds on the steady clock, the time base of every zone
+uint64_t Now();
+
+void SetThreadName(const char* name);
+
+void Record(const char* name, uint64_t begin, uint64_t end);
+
+// Unscoped variant for callbacks from code that can't use Zone (efsw hooks)
+void BeginZone(const char* name);
+void EndZone();
+
+// GPU zones go to a separate "GPU" track, begin and end must already be converted
+// to the Now() time base. Only one thread may record GPU zones.
+void RecordGpu(const char* name, uint64_t begin, uint64_t end);
+
+void WriteChromeTrace(const std::filesystem::path& path);
+
+class Zone
+{
+public:
+	explicit Zone(const char* name) : name(name), begin(Now()) {}
+	~Zone() { Record(name, begin, Now()); }
+
+	Zone(const Zone&) = delete;
+	Zone& operator=(const Zone&) = delete;
+
+private:
+	const char* name;
+	uint64_t begin;
+};
+
+}
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+
+#endif
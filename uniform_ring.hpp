@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <mogl/mogl.hpp>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+// Uniform buffer split into FramesInFlight slices that stay persistently and coherently
+// mapped. Every frame writes one contiguous T into the next slice and binds it with
+// bindBufferRange, a fence per slice keeps the CPU from overwriting data the GPU has
+// not consumed yet, which also caps how far the CPU can run ahead of the GPU.
+template <class T, size_t FramesInFlight = 3>
+class UniformRing
+{
+public:
+	explicit UniformRing(GLuint binding)
+		: binding(binding)
+	{
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		stride = (sizeof(T) + alignment - 1) / alignment * alignment;
+
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		buffer.setStorage(stride * FramesInFlight, nullptr, flags);
+		mapped = (uint8_t*)buffer.mapRange(0, stride * FramesInFlight, flags);
+		if (!mapped) {
+			throw std::runtime_error("failed to map the uniform ring buffer");
+		}
+	}
+
+	~UniformRing()
+	{
+		if (mapped) {
+			buffer.unmap();
+		}
+	}
+
+	UniformRing(const UniformRing&) = delete;
+	UniformRing& operator=(const UniformRing&) = delete;
+
+	// Copies value into the current slice and binds it, waits only if the GPU is
+	// still FramesInFlight frames behind
+	void upload(const T& value)
+	{
+		if (auto& fence = fences[slot]) {
+			if (fence->waitClientSync(0, 0) == GL_TIMEOUT_EXPIRED) {
+				++stall_count;
+				while (fence->waitClientSync(GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+				}
+			}
+			fence.reset();
+		}
+		std::memcpy(mapped + slot * stride, &value, sizeof(T));
+		buffer.bindBufferRange(binding, slot * stride, sizeof(T));
+	}
+
+	// Marks the current slice as in use by every command issued so far and moves on
+	void advance()
+	{
+		fences[slot] = std::make_unique<mogl::Fence>(GL_SYNC_GPU_COMMANDS_COMPLETE);
+		slot = (slot + 1) % FramesInFlight;
+	}
+
+	// Number of uploads that had to wait for the GPU
+	uint64_t getStallCount() const
+	{
+		return stall_count;
+	}
+
+private:
+	mogl::UniformBuffer buffer;
+	std::array<std::unique_ptr<mogl::Fence>, FramesInFlight> fences;
+	uint8_t* mapped = nullptr;
+	GLintptr stride = 0;
+	GLuint binding;
+	size_t slot = 0;
+	uint64_t stall_count = 0;
+};
@@ -0,0 +1,322 @@
+#include "video_capture.hpp"
+#include "trace.hpp"
+
+#include <imgui.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SKY_CONTEST_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const GLbitfield persistent_read_flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+// BT.601 studio range in 8.8 fixed point, every intermediate fits in 16 bits
+inline uint8_t Luma(int r, int g, int b)
+{
+	return (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+inline uint8_t ChromaU(int r, int g, int b)
+{
+	return (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+inline uint8_t ChromaV(int r, int g, int b)
+{
+	return (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+// Converts a 2x2 block at column x of two rows
+inline void ConvertBlock(const uint8_t* top, const uint8_t* bottom, int x, uint8_t* y_top, uint8_t* y_bottom, uint8_t* u, uint8_t* v)
+{
+	const uint8_t* p[4] = {top + x * 4, top + x * 4 + 4, bottom + x * 4, bottom + x * 4 + 4};
+	y_top[x] = Luma(p[0][0], p[0][1], p[0][2]);
+	y_top[x + 1] = Luma(p[1][0], p[1][1], p[1][2]);
+	y_bottom[x] = Luma(p[2][0], p[2][1], p[2][2]);
+	y_bottom[x + 1] = Luma(p[3][0], p[3][1], p[3][2]);
+	int r = (p[0][0] + p[1][0] + p[2][0] + p[3][0] + 2) >> 2;
+	int g = (p[0][1] + p[1][1] + p[2][1] + p[3][1] + 2) >> 2;
+	int b = (p[0][2] + p[1][2] + p[2][2] + p[3][2] + 2) >> 2;
+	u[x / 2] = ChromaU(r, g, b);
+	v[x / 2] = ChromaV(r, g, b);
+}
+
+#ifdef SKY_CONTEST_SSE2
+struct Channels {
+	__m128i r;
+	__m128i g;
+	__m128i b;
+};
+
+// 8 RGBA pixels as 16-bit lanes per channel
+inline Channels Unpack(const uint8_t* pixels)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+	__m128i lo = _mm_loadu_si128((const __m128i*)pixels);
+	__m128i hi = _mm_loadu_si128((const __m128i*)(pixels + 16));
+	auto channel = [&](int shift) {
+		return _mm_packs_epi32(
+			_mm_and_si128(_mm_srli_epi32(lo, shift), mask),
+			_mm_and_si128(_mm_srli_epi32(hi, shift), mask));
+	};
+	return {channel(0), channel(8), channel(16)};
+}
+
+// The largest sum is 56228, so the unsigned 16-bit lanes don't overflow
+inline __m128i Luma(const Channels& c)
+{
+	__m128i sum = _mm_add_epi16(
+		_mm_add_epi16(_mm_mullo_epi16(c.r, _mm_set1_epi16(66)), _mm_mullo_epi16(c.g, _mm_set1_epi16(129))),
+		_mm_add_epi16(_mm_mullo_epi16(c.b, _mm_set1_epi16(25)), _mm_set1_epi16(128)));
+	return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+}
+
+// Rounded average of the 2x2 blocks of 16 pixels in two rows, as 8 lanes
+inline __m128i Average(__m128i top_lo, __m128i bottom_lo, __m128i top_hi, __m128i bottom_hi)
+{
+	const __m128i ones = _mm_set1_epi16(1);
+	__m128i sum = _mm_packs_epi32(
+		_mm_madd_epi16(_mm_add_epi16(top_lo, bottom_lo), ones),
+		_mm_madd_epi16(_mm_add_epi16(top_hi, bottom_hi), ones));
+	return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+// Signed, the magnitude of the sum is at most 28560
+inline __m128i Chroma(__m128i r, __m128i g, __m128i b, short cr, short cg, short cb)
+{
+	__m128i sum = _mm_add_epi16(
+		_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)), _mm_mullo_epi16(g, _mm_set1_epi16(cg))),
+		_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(cb)), _mm_set1_epi16(128)));
+	return _mm_add_epi16(_mm_srai_epi16(sum, 8), _mm_set1_epi16(128));
+}
+#endif
+
+}
+
+void ConvertRGBAToYUV420(const uint8_t* rgba, int width, int height, uint8_t* y_plane, uint8_t* u_plane, uint8_t* v_plane)
+{
+	const size_t stride = (size_t)width * 4;
+	for (int row = 0; row < height; row += 2) {
+		const uint8_t* top = rgba + (height - 1 - row) * stride;
+		const uint8_t* bottom = top - stride;
+		uint8_t* y_top = y_plane + (size_t)row * width;
+		uint8_t* y_bottom = y_top + width;
+		uint8_t* u = u_plane + (size_t)row / 2 * (width / 2);
+		uint8_t* v = v_plane + (size_t)row / 2 * (width / 2);
+		int x = 0;
+#ifdef SKY_CONTEST_SSE2
+		for (; x + 16 <= width; x += 16) {
+			Channels top_lo = Unpack(top + x * 4);
+			Channels top_hi = Unpack(top + x * 4 + 32);
+			Channels bottom_lo = Unpack(bottom + x * 4);
+			Channels bottom_hi = Unpack(bottom + x * 4 + 32);
+			_mm_storeu_si128((__m128i*)(y_top + x), _mm_packus_epi16(Luma(top_lo), Luma(top_hi)));
+			_mm_storeu_si128((__m128i*)(y_bottom + x), _mm_packus_epi16(Luma(bottom_lo), Luma(bottom_hi)));
+			__m128i r = Average(top_lo.r, bottom_lo.r, top_hi.r, bottom_hi.r);
+			__m128i g = Average(top_lo.g, bottom_lo.g, top_hi.g, bottom_hi.g);
+			__m128i b = Average(top_lo.b, bottom_lo.b, top_hi.b, bottom_hi.b);
+			_mm_storel_epi64((__m128i*)(u + x / 2), _mm_packus_epi16(Chroma(r, g, b, -38, -74, 112), _mm_setzero_si128()));
+			_mm_storel_epi64((__m128i*)(v + x / 2), _mm_packus_epi16(Chroma(r, g, b, 112, -94, -18), _mm_setzero_si128()));
+		}
+#endif
+		for (; x < width; x += 2) {
+			ConvertBlock(top, bottom, x, y_top, y_bottom, u, v);
+		}
+	}
+}
+
+VideoCapture::VideoCapture(const std::filesystem::path& path, int width_, int height_, float fps, bool fixed_timestep)
+	: width(width_ & ~1)
+	, height(height_ & ~1)
+	, fps(fps)
+	, fixed_timestep(fixed_timestep)
+	, texture(GL_TEXTURE_2D)
+{
+	if (width <= 0 || height <= 0) {
+		throw std::runtime_error("invalid capture size");
+	}
+	if (path == "-") {
+#ifdef _WIN32
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		stream = &std::cout;
+	} else {
+		file.open(path, std::ios::binary);
+		if (!file) {
+			throw std::runtime_error("failed to open " + path.string());
+		}
+		stream = &file;
+	}
+
+	// Y4M only has rational frame rates
+	int rate_scale = std::round(fps) == fps ? 1 : 1000;
+	*stream << "YUV4MPEG2 W" << width << " H" << height << " F" << (int)std::round(fps * rate_scale) << ":" << rate_scale
+		<< " Ip A1:1 C420jpeg\n";
+
+	texture.setStorage2D(1, GL_RGBA8, width, height);
+	frame_buffer.setTexture(GL_COLOR_ATTACHMENT0, texture);
+	if (!frame_buffer.isComplete(GL_FRAMEBUFFER)) {
+		throw std::runtime_error("capture framebuffer is incomplete");
+	}
+
+	const GLsizeiptr size = (GLsizeiptr)width * height * 4;
+	for (Slot& slot: slots) {
+		slot.buffer.setStorage(size, nullptr, persistent_read_flags);
+		slot.mapped = (const uint8_t*)slot.buffer.mapRange(0, size, persistent_read_flags);
+		if (!slot.mapped) {
+			throw std::runtime_error("failed to map a capture buffer");
+		}
+	}
+
+	// one worker converts while the other waits for its turn to write
+	pipeline = std::make_unique<OrderedPipeline<Frame>>([this](Frame& frame) { writeFrame(frame); }, 2, slot_count);
+}
+
+VideoCapture::~VideoCapture()
+{
+	try {
+		finish();
+	} catch (const std::exception& error) {
+		std::cerr << "video capture: " << error.what() << std::endl;
+	}
+	pipeline.reset();
+	for (Slot& slot: slots) {
+		if (slot.mapped) {
+			slot.buffer.unmap();
+		}
+	}
+}
+
+void VideoCapture::collect(bool wait)
+{
+	while (!pending.empty()) {
+		Slot& slot = slots[pending.front()];
+		GLenum status = slot.fence->waitClientSync(0, 0);
+		while (wait && status == GL_TIMEOUT_EXPIRED) {
+			status = slot.fence->waitClientSync(GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		}
+		if (status == GL_TIMEOUT_EXPIRED) {
+			break;
+		}
+		slot.fence.reset();
+		pending.pop_front();
+
+		// the slot is released after conversion but the job stays in flight until written,
+		// so this would block on a slow sink. capture() drops frames before that can happen,
+		// except with fixed_timestep which waits for the sink on purpose.
+		pipeline->submit([this, &slot] {
+			TRACE_SCOPE("VideoCapture::convert");
+			Frame frame;
+			frame.repeat = slot.repeat;
+			frame.yuv.resize((size_t)width * height * 3 / 2);
+			uint8_t* y_plane = frame.yuv.data();
+			uint8_t* u_plane = y_plane + (size_t)width * height;
+			uint8_t* v_plane = u_plane + (size_t)width * height / 4;
+			ConvertRGBAToYUV420(slot.mapped, width, height, y_plane, u_plane, v_plane);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				slot.busy = false;
+			}
+			released.notify_all();
+			return frame;
+		});
+	}
+}
+
+void VideoCapture::writeFrame(Frame& frame)
+{
+	TRACE_SCOPE("VideoCapture::write");
+	for (int i = 0; i < frame.repeat; ++i) {
+		*stream << "FRAME\n";
+		stream->write((const char*)frame.yuv.data(), frame.yuv.size());
+	}
+	stream->flush();
+	if (!*stream) {
+		throw std::runtime_error("failed to write video frame");
+	}
+	written_frames += frame.repeat;
+}
+
+void VideoCapture::capture(float time, int source_width, int source_height)
+{
+	TRACE_SCOPE("VideoCapture::capture");
+	collect(false);
+
+	int repeat = 1;
+	if (!fixed_timestep) {
+		if (!started) {
+			started = true;
+			start_time = time;
+		}
+		// the video frame this render falls into, earlier ones were missed
+		int64_t video_frame = (int64_t)std::floor((time - start_time) * fps);
+		if (video_frame < next_video_frame) {
+			return;
+		}
+		repeat = (int)(video_frame - next_video_frame + 1);
+	}
+
+	Slot& slot = slots[next_slot];
+	if (fixed_timestep) {
+		collect(true);
+		std::unique_lock<std::mutex> lock(mutex);
+		released.wait(lock, [&] { return !slot.busy; });
+	} else {
+		// the frames read back but not submitted yet must still fit into the pipeline
+		size_t in_flight = pipeline->getInFlight() + pending.size();
+		std::lock_guard<std::mutex> lock(mutex);
+		if (slot.busy || in_flight >= slot_count) {
+			++dropped_frames;
+			return;
+		}
+	}
+
+	GLint read_frame_buffer = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_frame_buffer);
+
+	// scales if the window was resized, the video size is fixed
+	glBlitNamedFramebuffer(0, frame_buffer.getHandle(), 0, 0, source_width, source_height,
+		0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+	frame_buffer.bind(GL_READ_FRAMEBUFFER);
+	slot.buffer.bind();
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, read_frame_buffer);
+
+	slot.fence = std::make_unique<mogl::Fence>(GL_SYNC_GPU_COMMANDS_COMPLETE);
+	slot.repeat = repeat;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		slot.busy = true;
+	}
+	pending.push_back(next_slot);
+	next_slot = (next_slot + 1) % slot_count;
+	next_video_frame += repeat;
+	++captured_frames;
+}
+
+void VideoCapture::finish()
+{
+	collect(true);
+	pipeline->finish();
+}
+
+void VideoCapture::drawControls()
+{
+	ImGui::Text("Capturing %dx%d at %g FPS%s", width, height, fps, fixed_timestep ? ", fixed timestep" : "");
+	ImGui::Text("%lld frames written, %lld captured, %lld dropped", (long long)written_frames.load(),
+		(long long)captured_frames, (long long)dropped_frames);
+}
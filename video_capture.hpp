@@ -0,0 +1,97 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <mogl/mogl.hpp>
+#include "ordered_pipeline.hpp"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Records the default framebuffer into a Y4M (YUV4MPEG2) file or stdout. Each captured
+// frame is blitted to the capture size and read back into one of a ring of persistently
+// mapped pixel pack buffers. Buffers are only touched once their fence signalled, then
+// converted to YUV 4:2:0 and written on worker threads, so capture() never waits on the
+// GPU. When the ring is full, or the sink (e.g. a pipe into an encoder) is that many
+// frames behind, the frame is dropped and the next captured frame is repeated in the file
+// to keep the timing.
+//
+// With fixed_timestep every call is exactly one video frame and capture() waits instead
+// of dropping, so the video is frame perfect however slowly the shader renders.
+class VideoCapture
+{
+public:
+	// path "-" writes to stdout, e.g. to pipe into ffmpeg; width and height are rounded down to even
+	VideoCapture(const std::filesystem::path& path, int width, int height, float fps, bool fixed_timestep);
+	~VideoCapture();
+
+	VideoCapture(const VideoCapture&) = delete;
+	VideoCapture& operator=(const VideoCapture&) = delete;
+
+	// Call after drawing the scene into the default framebuffer, before the UI. time is
+	// the shader Time of the frame, ignored with fixed_timestep.
+	void capture(float time, int source_width, int source_height);
+
+	// Waits for all frames in flight and flushes them to the file
+	void finish();
+
+	// Must be called inside an ImGui window
+	void drawControls();
+
+private:
+	static constexpr size_t slot_count = 4;
+
+	struct Slot {
+		mogl::PixelPackBuffer buffer;
+		const uint8_t* mapped = nullptr;
+		std::unique_ptr<mogl::Fence> fence;
+		// number of video frames this capture stands for
+		int repeat = 1;
+		// from the read back until a worker converted it
+		bool busy = false;
+	};
+
+	struct Frame {
+		std::vector<uint8_t> yuv;
+		int repeat = 0;
+	};
+
+	// Hands pending slots whose fence signalled to the workers, in capture order
+	void collect(bool wait);
+	void writeFrame(Frame& frame);
+
+	int width;
+	int height;
+	float fps;
+	bool fixed_timestep;
+	std::ofstream file;
+	std::ostream* stream = nullptr;
+
+	mogl::Texture texture;
+	mogl::FrameBuffer frame_buffer;
+	std::array<Slot, slot_count> slots;
+	size_t next_slot = 0;
+	std::deque<size_t> pending;
+	std::mutex mutex;
+	std::condition_variable released;
+
+	bool started = false;
+	float start_time = 0;
+	int64_t next_video_frame = 0;
+	int64_t captured_frames = 0;
+	int64_t dropped_frames = 0;
+	std::atomic<int64_t> written_frames {0};
+
+	// declared last so the workers stop before the slots go away
+	std::unique_ptr<OrderedPipeline<Frame>> pipeline;
+};
+
+// Converts bottom-up RGBA rows to top-down BT.601 studio range Y, U and V planes with 2x2
+// averaged chroma. width and height must be even.
+void ConvertRGBAToYUV420(const uint8_t* rgba, int width, int height, uint8_t* y_plane, uint8_t* u_plane, uint8_t* v_plane);